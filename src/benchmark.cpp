@@ -0,0 +1,403 @@
+/* benchmark.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+#include "conf.h"
+#include "file.h"
+#include "filter.h"
+#include "util/membuffer.h"
+#include "util/simd.h"
+#include "check/dt_bench.h"
+#include "check/dt_data.h"
+
+#if !defined(SH_DENYWR)
+#define SH_DENYWR (-1)
+#endif
+
+/*************************************************************************
+// "upx --benchmark [FILE...]"
+//
+// Run all compiled-in compression methods and all filters over a
+// reproducible synthetic corpus plus the files given on the command line,
+// and print the throughput and the compression ratio as JSON to stdout.
+// Meant for regression tracking; the JSON layout may change.
+**************************************************************************/
+
+namespace {
+
+constexpr unsigned SYNTHETIC_SIZE = 2 * 1024 * 1024;
+
+struct Corpus final {
+    const char *name = nullptr;
+    MemBuffer mb;
+    unsigned len = 0;
+};
+
+// something that looks a little bit like x86 code: a small vocabulary of
+// common instructions, with call rel32 targets inside the buffer
+void fill_x86(byte *buf, unsigned len) noexcept {
+    static const byte alu_ops[4] = {0x01, 0x29, 0x39, 0x89}; // add, sub, cmp, mov
+    upx::testdata::Rng rng(0x86);
+    unsigned i = 0;
+    while (i + 8 <= len) {
+        const unsigned r = rng.next() >> 8;
+        switch (r & 7) {
+        case 0:
+        case 1: // call rel32
+            buf[i] = 0xe8;
+            set_le32(buf + i + 1, (r >> 3) % len - (i + 5));
+            i += 5;
+            break;
+        case 2: // mov reg, [ebp - disp8]
+            buf[i] = 0x8b;
+            buf[i + 1] = byte(0x45 + ((r >> 3) & 7) * 8);
+            buf[i + 2] = byte(0u - 4 * ((r >> 6) & 15));
+            i += 3;
+            break;
+        case 3: // push/pop reg
+            buf[i++] = byte(0x50 + ((r >> 3) & 15));
+            break;
+        case 4: // mov reg, imm32
+            buf[i] = byte(0xb8 + ((r >> 3) & 7));
+            set_le32(buf + i + 1, (r >> 6) & 255);
+            i += 5;
+            break;
+        case 5: // jcc rel8
+            buf[i] = byte(0x70 + ((r >> 3) & 15));
+            buf[i + 1] = byte(r >> 7);
+            i += 2;
+            break;
+        case 6: // alu reg, reg
+            buf[i] = alu_ops[(r >> 3) & 3];
+            buf[i + 1] = byte(0xc0 + ((r >> 5) & 63));
+            i += 2;
+            break;
+        default: // ret and padding
+            set_le32(buf + i, 0x909090c3);
+            i += 4;
+            break;
+        }
+    }
+    while (i < len)
+        buf[i++] = 0x90;
+}
+
+// something that looks a little bit like 32-bit ARM code
+void fill_arm(byte *buf, unsigned len) noexcept {
+    upx::testdata::Rng rng(0xa4);
+    unsigned i = 0;
+    for (; i + 4 <= len; i += 4) {
+        const unsigned r = rng.next() >> 8;
+        const unsigned rd = (r >> 2) & 7, rn = (r >> 5) & 7;
+        unsigned insn;
+        switch (r & 3) {
+        case 0: // bl
+            insn = 0xeb000000 | (((r >> 8) % (len / 4) - i / 4 - 2) & 0xffffff);
+            break;
+        case 1: // ldr rd, [rn, #imm]
+            insn = 0xe5900000 | (rn << 16) | (rd << 12) | (((r >> 8) & 31) * 4);
+            break;
+        case 2: // mov rd, rn
+            insn = 0xe1a00000 | (rd << 12) | rn;
+            break;
+        default: // add rd, rn, #imm
+            insn = 0xe2800000 | (rn << 16) | (rd << 12) | ((r >> 8) & 255);
+            break;
+        }
+        set_le32(buf + i, insn);
+    }
+    while (i < len)
+        buf[i++] = 0;
+}
+
+struct MethodEntry {
+    int method;
+    const char *name;
+};
+
+const MethodEntry methods[] = {
+    {M_NRV2B_LE32, "nrv2b"},
+    {M_NRV2D_LE32, "nrv2d"},
+    {M_NRV2E_LE32, "nrv2e"},
+#if (WITH_LZMA)
+    {M_LZMA, "lzma"},
+#endif
+#if (WITH_ZLIB)
+    {M_DEFLATE, "deflate"},
+#endif
+#if (WITH_ZSTD)
+    {M_ZSTD, "zstd"},
+#endif
+};
+
+const char *backend_name(int method) noexcept {
+    if (M_IS_LZMA(method))
+        return "lzma";
+    if (M_IS_DEFLATE(method))
+        return "zlib";
+    if (M_IS_ZSTD(method))
+        return "zstd";
+#if (WITH_NRV)
+    if (!opt->prefer_ucl)
+        return "nrv";
+#endif
+    return "ucl";
+}
+
+/*************************************************************************
+// minimal JSON output
+**************************************************************************/
+
+void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        const unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+void json_mib_s(FILE *f, const char *key, upx_uint64_t bytes, double seconds) {
+    const double mib = double(bytes) / (1024.0 * 1024.0);
+    fprintf(f, ", \"%s\": %.1f", key, seconds > 0 ? mib / seconds : 0.0);
+}
+
+// emit the separator before each element of a JSON array
+struct JsonArray final {
+    FILE *f;
+    bool first = true;
+    explicit JsonArray(FILE *ff, const char *key) : f(ff) { fprintf(f, ",\n  \"%s\": [", key); }
+    ~JsonArray() noexcept { fprintf(f, first ? "]" : "\n  ]"); }
+    void next() {
+        fputs(first ? "\n    " : ",\n    ", f);
+        first = false;
+    }
+};
+
+/*************************************************************************
+// the actual benchmarks
+**************************************************************************/
+
+void bench_method(JsonArray &out, Corpus &c, const MethodEntry &m, int level) {
+    FILE *const f = out.f;
+    const unsigned u_len = c.len;
+    MemBuffer cbuf;
+    cbuf.allocForCompression(u_len);
+    upx_compress_result_t cresult;
+    unsigned c_len = 0;
+    int r = UPX_E_OK;
+
+    out.next();
+    fprintf(f, "{\"corpus\": ");
+    json_string(f, c.name);
+    fprintf(f, ", \"method\": \"%s\", \"method_id\": %d, \"backend\": \"%s\", \"level\": %d",
+            m.name, m.method, backend_name(m.method), level);
+
+    const double t_compress = upx::bench::best_time(
+        [&]() {
+            c_len = cbuf.getSize();
+            r = upx_compress(c.mb, u_len, cbuf, &c_len, nullptr, m.method, level, nullptr,
+                             &cresult);
+        },
+        0.25, 1);
+    if (r != UPX_E_OK) {
+        fprintf(f, ", \"error\": %d}", r);
+        return;
+    }
+    fprintf(f, ", \"u_len\": %u, \"c_len\": %u, \"ratio\": %.4f", u_len, c_len,
+            double(c_len) / double(u_len));
+    json_mib_s(f, "compress_mib_s", u_len, t_compress);
+
+    MemBuffer dbuf(u_len);
+    bool ok = true;
+    const double t_decompress = upx::bench::best_time([&]() {
+        unsigned d_len = u_len;
+        r = upx_decompress(cbuf, c_len, dbuf, &d_len, m.method, &cresult);
+        ok = ok && r == UPX_E_OK && d_len == u_len;
+    });
+    ok = ok && memcmp(dbuf, c.mb, u_len) == 0;
+    if (ok)
+        json_mib_s(f, "decompress_mib_s", u_len, t_decompress);
+
+    // in-place decompression check with a generous overlap_overhead; this
+    // includes copying the compressed data to the end of the buffer
+    if (ok && c_len < u_len) {
+        const unsigned overlap_overhead = u_len / 8 + 256;
+        MemBuffer obuf(u_len + overlap_overhead);
+        const unsigned src_off = u_len + overlap_overhead - c_len;
+        const double t_overlap = upx::bench::best_time([&]() {
+            memcpy(obuf + src_off, cbuf, c_len);
+            unsigned d_len = u_len;
+            r = upx_test_overlap(obuf, c.mb, src_off, c_len, &d_len, m.method, &cresult);
+            ok = ok && r == UPX_E_OK && d_len == u_len;
+        });
+        if (ok)
+            json_mib_s(f, "test_overlap_mib_s", u_len, t_overlap);
+    }
+    fprintf(f, ", \"ok\": %s}", ok ? "true" : "false");
+}
+
+void bench_filter(JsonArray &out, Corpus &c, int id, MemBuffer &work, MemBuffer &fbuf) {
+    FILE *const f = out.f;
+    const unsigned len = c.len;
+
+    // first run: check that the filter applies, and remember the result
+    memcpy(work, c.mb, len);
+    Filter ft(opt->level);
+    ft.init(id, 0);
+    bool ok;
+    try {
+        ok = ft.filter(work, len);
+    } catch (const Throwable &) {
+        ok = false;
+    }
+    if (!ok)
+        return; // the filter does not apply to this buffer
+    const byte cto = ft.cto;
+    memcpy(fbuf, work, len);
+
+    out.next();
+    fprintf(f, "{\"corpus\": ");
+    json_string(f, c.name);
+    fprintf(f, ", \"filter_id\": \"0x%02x\", \"calls\": %u", id, ft.calls);
+
+    // timings include a memcpy() of the buffer
+    const double t_filter = upx::bench::best_time(
+        [&]() {
+            memcpy(work, c.mb, len);
+            Filter fr(opt->level);
+            fr.init(id, 0);
+            (void) fr.filter(work, len);
+        },
+        0.05, 1);
+    json_mib_s(f, "filter_mib_s", len, t_filter);
+    const double t_unfilter = upx::bench::best_time(
+        [&]() {
+            memcpy(work, fbuf, len);
+            Filter fr(opt->level);
+            fr.init(id, 0);
+            fr.cto = cto;
+            fr.unfilter(work, len);
+        },
+        0.05, 1);
+    ok = memcmp(work, c.mb, len) == 0;
+    if (ok)
+        json_mib_s(f, "unfilter_mib_s", len, t_unfilter);
+    fprintf(f, ", \"ok\": %s}", ok ? "true" : "false");
+}
+
+} // namespace
+
+void do_benchmark(int i, int argc, char *argv[]) {
+    const int level = opt->level > 0 ? opt->level : 7;
+
+    // collect the corpus
+    const unsigned max_corpus = 2 + unsigned(argc - i);
+    std::unique_ptr<Corpus[]> corpus(new Corpus[max_corpus]);
+    unsigned ncorpus = 0;
+    corpus[ncorpus].name = "synthetic-x86";
+    corpus[ncorpus].mb.alloc(SYNTHETIC_SIZE);
+    corpus[ncorpus].len = SYNTHETIC_SIZE;
+    fill_x86(corpus[ncorpus].mb, SYNTHETIC_SIZE);
+    ncorpus += 1;
+    corpus[ncorpus].name = "synthetic-arm";
+    corpus[ncorpus].mb.alloc(SYNTHETIC_SIZE);
+    corpus[ncorpus].len = SYNTHETIC_SIZE;
+    fill_arm(corpus[ncorpus].mb, SYNTHETIC_SIZE);
+    ncorpus += 1;
+    for (; i < argc; i++) {
+        const char *iname = argv[i];
+        try {
+            InputFile fi;
+            fi.sopen(iname, O_RDONLY | O_BINARY, SH_DENYWR);
+            const upx_off_t size = fi.st_size();
+            if (size <= 0)
+                continue;
+            Corpus &c = corpus[ncorpus];
+            c.len = mem_size_get_n(1, size);
+            c.mb.alloc(c.len);
+            fi.readx(c.mb, c.len);
+            c.name = iname;
+            ncorpus += 1;
+        } catch (const Throwable &e) {
+            printErr(iname, e);
+            (void) main_set_exit_code(EXIT_ERROR);
+        }
+    }
+
+    FILE *const f = stdout;
+    fprintf(f, "{\n  \"upx_version\": \"%s\", \"level\": %d, \"simd_level\": %d",
+            UPX_VERSION_STRING, level, upx::simd_get_level());
+    {
+        JsonArray out(f, "corpus");
+        for (unsigned k = 0; k < ncorpus; k++) {
+            out.next();
+            fprintf(f, "{\"name\": ");
+            json_string(f, corpus[k].name);
+            fprintf(f, ", \"bytes\": %u}", corpus[k].len);
+        }
+    }
+    {
+        JsonArray out(f, "methods");
+        for (unsigned k = 0; k < ncorpus; k++)
+            for (const MethodEntry &m : methods)
+                bench_method(out, corpus[k], m, level);
+    }
+    {
+        JsonArray out(f, "filters");
+        for (unsigned k = 0; k < ncorpus; k++) {
+            MemBuffer work(corpus[k].len), fbuf(corpus[k].len);
+            for (int id = 1; id < 256; id++)
+                if (Filter::isValidFilter(id))
+                    bench_filter(out, corpus[k], id, work, fbuf);
+        }
+    }
+    fprintf(f, "\n}\n");
+    fflush(f);
+}
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("benchmark corpus") {
+    constexpr unsigned N = 65536;
+    MemBuffer a(N), b(N);
+    fill_x86(a, N);
+    fill_x86(b, N);
+    CHECK(memcmp(a, b, N) == 0); // reproducible
+    CHECK(upx_estimate_compressed_size(a, N) < N);
+    fill_arm(a, N);
+    fill_arm(b, N);
+    CHECK(memcmp(a, b, N) == 0);
+    CHECK(upx_estimate_compressed_size(a, N) < N);
+}
+
+/* vim:set ts=4 sw=4 et: */
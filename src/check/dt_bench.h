@@ -0,0 +1,69 @@
+/* dt_bench.h -- helpers for the micro benchmarks
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+
+// The micro benchmarks are doctest cases named "bench ..." that are
+// skipped by default. Run them with a release build like this:
+//
+//   upx --dt-no-skip --dt-test-case="bench*" --dt-exit
+
+#pragma once
+#include <chrono>
+
+namespace upx {
+namespace bench {
+
+// run func() a number of times and return the best time of a single run in seconds
+template <class Func>
+double best_time(Func &&func, double min_total_seconds = 0.25, unsigned min_runs = 3) {
+    typedef std::chrono::steady_clock clock;
+    double best = 0, total = 0;
+    for (unsigned runs = 0; runs < min_runs || total < min_total_seconds; runs++) {
+        const auto t0 = clock::now();
+        func();
+        const double t = std::chrono::duration<double>(clock::now() - t0).count();
+        if (runs == 0 || t < best)
+            best = t;
+        total += t;
+    }
+    return best;
+}
+
+inline void report(const char *name, const char *variant, upx_uint64_t bytes, double seconds) {
+    const double mib = double(bytes) / (1024.0 * 1024.0);
+    printf("%-40s %-8s %10.1f MiB/s\n", name, variant, seconds > 0 ? mib / seconds : 0.0);
+}
+
+inline void report_items(const char *name, const char *variant, upx_uint64_t items,
+                         double seconds) {
+    const double k = double(items) / 1000.0;
+    printf("%-40s %-8s %10.1f k/s\n", name, variant, seconds > 0 ? k / seconds : 0.0);
+}
+
+} // namespace bench
+} // namespace upx
+
+/* vim:set ts=4 sw=4 et: */
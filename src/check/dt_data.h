@@ -0,0 +1,60 @@
+/* dt_data.h -- deterministic test data
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+
+// The doctests and the synthetic "--benchmark" corpus need data that is
+// the same on every platform and in every run; rand() is not, so use the
+// classic ANSI C linear congruential generator directly.
+
+#pragma once
+
+namespace upx {
+namespace testdata {
+
+class Rng final {
+public:
+    explicit Rng(upx_uint32_t seed) noexcept : state(seed) {}
+    // the full 32-bit state; prefer the high bits, the low bits are weak
+    upx_uint32_t next() noexcept {
+        state = state * 1103515245 + 12345;
+        return state;
+    }
+
+private:
+    upx_uint32_t state;
+};
+
+// fill "buf" with pseudo-random bytes, i.e. data that does not compress
+inline void fill_random(byte *buf, size_t len, upx_uint32_t seed) noexcept {
+    Rng rng(seed);
+    for (size_t i = 0; i < len; i++)
+        buf[i] = byte(rng.next() >> 23);
+}
+
+} // namespace testdata
+} // namespace upx
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,270 @@
+/* dt_filter.cpp -- filter checks and benchmarks
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+
+#include "../conf.h"
+#include "../filter.h"
+#include "../util/membuffer.h"
+#include "../util/simd.h"
+#include "dt_bench.h"
+#include "dt_data.h"
+
+/*************************************************************************
+// util
+**************************************************************************/
+
+namespace {
+
+// something that looks a little bit like x86 code: lots of calls, jumps
+// and jcc with targets inside and outside of the buffer
+void fill_x86_like(byte *buf, unsigned len, unsigned seed) {
+    upx::testdata::Rng rng(seed);
+    for (unsigned i = 0; i < len; i++)
+        buf[i] = byte(rng.next() >> 24);
+    for (unsigned i = 0; i + 6 <= len;) {
+        seed = rng.next();
+        const unsigned r = (seed >> 16) & 255;
+        if (r < 24) {
+            // call/jmp rel32
+            buf[i] = byte(r < 16 ? 0xe8 : 0xe9);
+            const unsigned target = (r & 1) ? (seed >> 8) % len : seed;
+            set_le32(buf + i + 1, target - (i + 5));
+            i += 5;
+        } else if (r < 32) {
+            // jcc rel32
+            buf[i] = 0x0f;
+            buf[i + 1] = byte(0x80 + (r & 15));
+            set_le32(buf + i + 2, ((seed >> 8) % len) - (i + 6));
+            i += 6;
+        } else
+            i += 1 + (r & 7);
+    }
+}
+
+struct FilterResult {
+    int ok; // 1: success, 0: filter failed, -1: exception
+    unsigned calls, noncalls, wrongcalls, lastcall;
+    byte cto;
+};
+
+FilterResult run_filter(int mode, int id, unsigned addvalue, byte *buf, unsigned len) {
+    FilterResult r = {};
+    Filter f(9);
+    f.init(id, addvalue);
+    try {
+        if (mode == 0)
+            r.ok = f.filter(buf, len) ? 1 : 0;
+        else if (mode == 1) {
+            f.cto = 0x42; // arbitrary
+            f.unfilter(buf, len);
+            r.ok = 1;
+        } else
+            r.ok = f.scan(buf, len) ? 1 : 0;
+    } catch (const Throwable &) {
+        r.ok = -1;
+    }
+    r.calls = f.calls;
+    r.noncalls = f.noncalls;
+    r.wrongcalls = f.wrongcalls;
+    r.lastcall = f.lastcall;
+    r.cto = f.cto;
+    return r;
+}
+
+bool same_result(const FilterResult &a, const FilterResult &b) {
+    return a.ok == b.ok && a.calls == b.calls && a.noncalls == b.noncalls &&
+           a.wrongcalls == b.wrongcalls && a.lastcall == b.lastcall && a.cto == b.cto;
+}
+
+// x86 calltrick filters with SIMD kernels
+const int calltrick_filters[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x11,
+                                 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x24, 0x25,
+                                 0x26, 0x36, 0x46, 0x49};
+
+// delta filters with SIMD kernels
+const int sub_filters[] = {0x90, 0x91, 0x92, 0x93, 0xa0, 0xa1, 0xa2, 0xa3, 0xb0, 0xb1, 0xb2, 0xb3};
+
+} // namespace
+
+/*************************************************************************
+// the SIMD calltrick kernels must be bit-identical to the scalar code
+**************************************************************************/
+
+TEST_CASE("filter calltrick SIMD") {
+    const int level = upx::simd_get_level();
+    const unsigned len = 65536 + 13;
+    MemBuffer orig(len), a(len), b(len);
+    for (unsigned seed = 1; seed <= 3; seed++) {
+        fill_x86_like(orig, len, seed);
+        for (const int id : calltrick_filters) {
+            const unsigned addvalue = (seed & 1) ? 0 : 0x1000;
+            for (int mode = 0; mode < 3; mode++) {
+                memcpy(a, orig, len);
+                memcpy(b, orig, len);
+                upx::simd_set_limit(upx::SIMD_NONE);
+                const FilterResult ra = run_filter(mode, id, addvalue, a, len);
+                upx::simd_set_limit(level);
+                const FilterResult rb = run_filter(mode, id, addvalue, b, len);
+                CHECK(same_result(ra, rb));
+                CHECK(memcmp(a, b, len) == 0);
+            }
+        }
+    }
+    upx::simd_set_limit(upx::SIMD_AVX2);
+}
+
+/*************************************************************************
+// the SIMD delta kernels must be bit-identical to the scalar code
+**************************************************************************/
+
+TEST_CASE("filter sub SIMD") {
+    const int level = upx::simd_get_level();
+    const unsigned max_len = 1024 + 7;
+    MemBuffer orig(max_len), a(max_len), b(max_len);
+    fill_x86_like(orig, max_len, 4);
+    for (const unsigned len : {5u, 17u, 33u, 64u, 100u, max_len}) {
+        for (const int id : sub_filters) {
+            for (int mode = 0; mode < 3; mode++) {
+                memcpy(a, orig, len);
+                memcpy(b, orig, len);
+                upx::simd_set_limit(upx::SIMD_NONE);
+                const FilterResult ra = run_filter(mode, id, 0, a, len);
+                upx::simd_set_limit(level);
+                const FilterResult rb = run_filter(mode, id, 0, b, len);
+                CHECK(same_result(ra, rb));
+                CHECK(memcmp(a, b, len) == 0);
+            }
+        }
+    }
+    upx::simd_set_limit(upx::SIMD_AVX2);
+}
+
+/*************************************************************************
+// Filter::undo() must restore the original buffer
+**************************************************************************/
+
+TEST_CASE("Filter::undo") {
+    const unsigned len = 65536 + 13;
+    MemBuffer orig(len), buf(len);
+    FilterUndoLog undo_log;
+    for (int pass = 0; pass < 2; pass++) {
+        fill_x86_like(orig, len, 5);
+        if (pass == 1) // lots of calls: the undo log overflows
+            for (unsigned i = 0; i + 5 <= len; i += 5) {
+                orig[i] = 0xe8;
+                set_le32(orig + i + 1, 0u - (i + 5));
+            }
+        memcpy(buf, orig, len);
+        undo_log.reset();
+        for (const int id : calltrick_filters) {
+            Filter f(9);
+            f.init(id, 0x1000);
+            f.undo_log = &undo_log;
+            bool ok = false;
+            try {
+                ok = f.filter(buf, len);
+            } catch (const Throwable &) {
+                memcpy(buf, orig, len);
+                continue;
+            }
+            if (ok) {
+                CHECK(f.adler == upx_adler32(orig, len));
+                f.undo();
+            }
+            CHECK(memcmp(buf, orig, len) == 0);
+        }
+        for (const int id : sub_filters) {
+            Filter f(9);
+            f.init(id, 0);
+            f.undo_log = &undo_log;
+            CHECK(f.filter(buf, len));
+            f.undo(); // not logged - uses unfilter()
+            CHECK(memcmp(buf, orig, len) == 0);
+        }
+    }
+}
+
+/*************************************************************************
+// benchmarks
+**************************************************************************/
+
+TEST_CASE("bench filter calltrick" * doctest::skip()) {
+    const int level = upx::simd_get_level();
+    const unsigned len = 16 * 1024 * 1024;
+    MemBuffer orig(len), buf(len);
+    fill_x86_like(orig, len, 1);
+    static const char *const level_names[] = {"scalar", "sse2", "ssse3", "avx2"};
+    for (const int id : {0x13, 0x16, 0x26, 0x36, 0x49}) {
+        char name[64];
+        snprintf(name, sizeof(name), "filter 0x%02x filter+unfilter", id);
+        for (int l = upx::SIMD_NONE; l <= level; l++) {
+            if (l == upx::SIMD_SSSE3)
+                continue; // no separate kernels
+            upx::simd_set_limit(l);
+            const double t = upx::bench::best_time([&]() {
+                memcpy(buf, orig, len);
+                Filter f(9);
+                f.init(id, 0);
+                if (f.filter(buf, len))
+                    f.unfilter(buf, len);
+            });
+            upx::bench::report(name, level_names[l], len, t);
+        }
+    }
+    upx::simd_set_limit(upx::SIMD_AVX2);
+}
+
+TEST_CASE("bench filter sub" * doctest::skip()) {
+    const int level = upx::simd_get_level();
+    const unsigned len = 16 * 1024 * 1024;
+    MemBuffer orig(len), buf(len);
+    fill_x86_like(orig, len, 1);
+    static const char *const level_names[] = {"scalar", "sse2", "ssse3", "avx2"};
+    for (const int id : {0x90, 0x92, 0xa1, 0xb3}) {
+        for (int undo = 0; undo <= 1; undo++) {
+            char name[64];
+            snprintf(name, sizeof(name), "filter 0x%02x %s", id, undo ? "unfilter" : "filter");
+            for (int l = upx::SIMD_NONE; l <= level; l++) {
+                if (l == upx::SIMD_SSSE3)
+                    continue; // no separate kernels
+                upx::simd_set_limit(l);
+                memcpy(buf, orig, len);
+                const double t = upx::bench::best_time([&]() {
+                    Filter f(9);
+                    f.init(id, 0);
+                    if (undo)
+                        f.unfilter(buf, len);
+                    else
+                        (void) f.filter(buf, len);
+                });
+                upx::bench::report(name, level_names[l], len, t);
+            }
+        }
+    }
+    upx::simd_set_limit(upx::SIMD_AVX2);
+}
+
+/* vim:set ts=4 sw=4 et: */
@@ -27,6 +27,7 @@
 #include "../conf.h"
 #include "compress.h"
 #include "../util/membuffer.h"
+#include "../util/stats.h"
 
 /*************************************************************************
 //
@@ -36,6 +37,8 @@ unsigned upx_adler32(const void *buf, unsigned len, unsigned adler) {
     if (len == 0)
         return adler;
     assert(buf != nullptr);
+    if (len >= 64 && upx_simd_adler32(buf, len, &adler))
+        return adler;
 #if 1
     return upx_ucl_adler32(buf, len, adler);
 #else
@@ -64,6 +67,7 @@ unsigned upx_crc32(const void *buf, unsigned len, unsigned crc)
 int upx_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsigned *dst_len,
                  upx_callback_t *cb, int method, int level, const upx_compress_config_t *cconf,
                  upx_compress_result_t *cresult) {
+    upx::PhaseTimer timer(upx::STATS_COMPRESS);
     int r = UPX_E_ERROR;
     upx_compress_result_t cresult_buffer;
 
@@ -111,6 +115,10 @@ int upx_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsigned
     else if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method))
         r = upx_ucl_compress(src, src_len, dst, dst_len, cb, method, level, cconf, cresult);
 #endif
+#if (WITH_ZLIB)
+    else if (M_IS_DEFLATE(method))
+        r = upx_zlib_compress(src, src_len, dst, dst_len, cb, method, level, cconf, cresult);
+#endif
 #if (WITH_ZSTD)
     else if (M_IS_ZSTD(method))
         r = upx_zstd_compress(src, src_len, dst, dst_len, cb, method, level, cconf, cresult);
@@ -133,6 +141,7 @@ int upx_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsigned
 
 int upx_decompress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsigned *dst_len,
                    int method, const upx_compress_result_t *cresult) {
+    upx::PhaseTimer timer(upx::STATS_DECOMPRESS);
     int r = UPX_E_ERROR;
 
     assert(*dst_len > 0);
@@ -211,6 +220,10 @@ int upx_test_overlap(const upx_bytep buf, const upx_bytep tbuf, unsigned src_off
     else if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method))
         r = upx_ucl_test_overlap(buf, tbuf, src_off, src_len, dst_len, method, cresult);
 #endif
+#if (WITH_ZLIB)
+    else if (M_IS_DEFLATE(method))
+        r = upx_zlib_test_overlap(buf, tbuf, src_off, src_len, dst_len, method, cresult);
+#endif
 #if (WITH_ZSTD)
     else if (M_IS_ZSTD(method))
         r = upx_zstd_test_overlap(buf, tbuf, src_off, src_len, dst_len, method, cresult);
@@ -223,4 +236,107 @@ int upx_test_overlap(const upx_bytep buf, const upx_bytep tbuf, unsigned src_off
     return r;
 }
 
+/*************************************************************************
+// Compute the minimal src_off for upx_test_overlap() in a single
+// decompression pass. Returns UPX_E_NOT_YET_IMPLEMENTED if the method
+// does not support this; callers then have to search by using
+// upx_test_overlap().
+**************************************************************************/
+
+int upx_min_overlap(const upx_bytep src, unsigned src_len, unsigned *dst_len, unsigned *src_off,
+                    int method, const upx_compress_result_t *cresult) {
+    int r = UPX_E_NOT_YET_IMPLEMENTED;
+
+    if (cresult && cresult->debug.method == 0)
+        cresult = nullptr;
+
+    assert(*dst_len > 0);
+    *src_off = 0;
+
+    const unsigned orig_dst_len = *dst_len;
+    if (__acc_cte(false)) {
+    }
+#if (WITH_UCL)
+    // the NRV bitstream parser does not depend on the actual library
+    else if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method))
+        r = upx_ucl_min_overlap(src, src_len, dst_len, src_off, method, cresult);
+#endif
+#if (WITH_ZLIB)
+    else if (M_IS_DEFLATE(method))
+        r = upx_zlib_min_overlap(src, src_len, dst_len, src_off, method, cresult);
+#endif
+    // LZMA: LzmaDecode() is a one-shot decoder without any hooks, so
+    // there is no way to track the read/write positions; same for bzip2 and zstd
+
+    assert_noexcept(*dst_len <= orig_dst_len);
+    return r;
+}
+
+/*************************************************************************
+// reusable compressor contexts, see compress.h
+**************************************************************************/
+
+static upx_std_atomic(unsigned) context_limit{1};
+
+unsigned upx_compress_get_context_limit(void) noexcept { return context_limit; }
+
+void upx_compress_set_context_limit(unsigned n) noexcept {
+    context_limit = n;
+    // drop the contexts that are now over the limit
+    upx_compress_release_contexts();
+}
+
+void upx_compress_release_contexts(void) noexcept {
+#if (WITH_LZMA)
+    upx_lzma_release_contexts();
+#endif
+#if (WITH_ZLIB)
+    upx_zlib_release_contexts();
+#endif
+#if (WITH_ZSTD)
+    upx_zstd_release_contexts();
+#endif
+}
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("upx_compress_context_pool") {
+    struct Ctx final {
+        explicit Ctx(int *live_) noexcept : live(live_) { *live += 1; }
+        ~Ctx() noexcept { *live -= 1; }
+        int *live;
+    };
+    int live = 0;
+    const unsigned saved_limit = upx_compress_get_context_limit();
+    upx_compress_set_context_limit(3);
+    upx_compress_context_pool<Ctx, 2> pool;
+    CHECK(pool.get() == nullptr);
+    Ctx *a = new Ctx(&live);
+    Ctx *b = new Ctx(&live);
+    Ctx *c = new Ctx(&live);
+    pool.put(a);
+    pool.put(b);
+    pool.put(c); // pool is full, so "c" gets deleted
+    CHECK(live == 2);
+    CHECK(pool.get() == b);
+    CHECK(pool.get() == a);
+    CHECK(pool.get() == nullptr);
+    CHECK(pool.getReuseCounter() == 2);
+    pool.put(a);
+    pool.put(b);
+    pool.release();
+    CHECK(live == 0);
+    CHECK(pool.get() == nullptr);
+    // the runtime limit is below N
+    upx_compress_set_context_limit(1);
+    pool.put(new Ctx(&live));
+    pool.put(new Ctx(&live));
+    CHECK(live == 1);
+    pool.release();
+    CHECK(live == 0);
+    upx_compress_set_context_limit(saved_limit);
+}
+
 /* vim:set ts=4 sw=4 et: */
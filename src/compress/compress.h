@@ -26,6 +26,81 @@
 
 #pragma once
 
+/*************************************************************************
+// reusable compressor contexts
+**************************************************************************/
+
+// Setting up a compressor allocates and clears big tables (the LZMA match
+// finder, the zlib deflate state, a ZSTD_CCtx), and compressWithFilters()
+// and the block splitting call the compressors very often. So the backends
+// keep idle contexts in a small pool: a compress call takes one for its
+// exclusive use, resets it and gives it back when done. As a context is
+// never shared, this works for any number of worker threads.
+// An idle LZMA encoder holds its dictionary-sized match finder, so a pool
+// keeps no more idle contexts than there are compression threads (see
+// upx_compress_set_context_limit()), and do_files() frees them at the end.
+unsigned upx_compress_get_context_limit(void) noexcept;
+void upx_compress_set_context_limit(unsigned n) noexcept;
+
+template <class T, unsigned N = 256>
+class upx_compress_context_pool final {
+public:
+    explicit upx_compress_context_pool() noexcept = default;
+    ~upx_compress_context_pool() noexcept { release(); }
+    // returns nullptr if there is no idle context
+    T *get() noexcept {
+#if WITH_THREADS
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        if (nidle == 0)
+            return nullptr;
+        reuse_counter += 1;
+        return idle[--nidle];
+    }
+    void put(T *ctx) noexcept {
+        if (ctx == nullptr)
+            return;
+        {
+#if WITH_THREADS
+            std::lock_guard<std::mutex> guard(lock);
+#endif
+            if (nidle < N && nidle < upx_compress_get_context_limit()) {
+                idle[nidle++] = ctx;
+                return;
+            }
+        }
+        delete ctx;
+    }
+    // free all idle contexts
+    void release() noexcept {
+        for (;;) {
+            T *ctx;
+            {
+#if WITH_THREADS
+                std::lock_guard<std::mutex> guard(lock);
+#endif
+                if (nidle == 0)
+                    break;
+                ctx = idle[--nidle];
+            }
+            delete ctx;
+        }
+    }
+    upx_uint64_t getReuseCounter() const noexcept { return reuse_counter; }
+
+private:
+    T *idle[N] = {};
+    unsigned nidle = 0;
+    upx_std_atomic(upx_uint64_t) reuse_counter{0};
+#if WITH_THREADS
+    std::mutex lock;
+#endif
+    UPX_CXX_DISABLE_COPY_MOVE(upx_compress_context_pool)
+};
+
+// free the idle contexts of all compressors
+void upx_compress_release_contexts(void) noexcept;
+
 // clang-format off
 
 /*************************************************************************
@@ -56,6 +131,7 @@ int upx_bzip2_test_overlap ( const upx_bytep buf,
 #if (WITH_LZMA)
 int upx_lzma_init(void);
 const char *upx_lzma_version_string(void);
+void upx_lzma_release_contexts(void) noexcept;
 int upx_lzma_compress      ( const upx_bytep src, unsigned  src_len,
                                    upx_bytep dst, unsigned *dst_len,
                                    upx_callback_t *cb,
@@ -95,6 +171,9 @@ int upx_nrv_test_overlap   ( const upx_bytep buf,
                              const upx_compress_result_t *cresult );
 #endif
 
+// compress_adler32.cpp
+bool upx_simd_adler32(const void *buf, unsigned len, unsigned *adler) noexcept;
+
 #if (WITH_UCL)
 int upx_ucl_init(void);
 const char *upx_ucl_version_string(void);
@@ -114,6 +193,11 @@ int upx_ucl_test_overlap   ( const upx_bytep buf,
                                    unsigned *dst_len,
                                    int method,
                              const upx_compress_result_t *cresult );
+int upx_ucl_min_overlap     ( const upx_bytep src, unsigned  src_len,
+                                   unsigned *dst_len,
+                                   unsigned *src_off,
+                                   int method,
+                             const upx_compress_result_t *cresult );
 unsigned upx_ucl_adler32(const void *buf, unsigned len, unsigned adler);
 unsigned upx_ucl_crc32  (const void *buf, unsigned len, unsigned crc);
 #endif
@@ -121,6 +205,7 @@ unsigned upx_ucl_crc32  (const void *buf, unsigned len, unsigned crc);
 #if (WITH_ZLIB)
 int upx_zlib_init(void);
 const char *upx_zlib_version_string(void);
+void upx_zlib_release_contexts(void) noexcept;
 int upx_zlib_compress      ( const upx_bytep src, unsigned  src_len,
                                    upx_bytep dst, unsigned *dst_len,
                                    upx_callback_t *cb,
@@ -137,6 +222,11 @@ int upx_zlib_test_overlap  ( const upx_bytep buf,
                                    unsigned *dst_len,
                                    int method,
                              const upx_compress_result_t *cresult );
+int upx_zlib_min_overlap    ( const upx_bytep src, unsigned  src_len,
+                                   unsigned *dst_len,
+                                   unsigned *src_off,
+                                   int method,
+                             const upx_compress_result_t *cresult );
 unsigned upx_zlib_adler32(const void *buf, unsigned len, unsigned adler);
 unsigned upx_zlib_crc32  (const void *buf, unsigned len, unsigned crc);
 #endif
@@ -144,6 +234,7 @@ unsigned upx_zlib_crc32  (const void *buf, unsigned len, unsigned crc);
 #if (WITH_ZSTD)
 int upx_zstd_init(void);
 const char *upx_zstd_version_string(void);
+void upx_zstd_release_contexts(void) noexcept;
 int upx_zstd_compress      ( const upx_bytep src, unsigned  src_len,
                                    upx_bytep dst, unsigned *dst_len,
                                    upx_callback_t *cb,
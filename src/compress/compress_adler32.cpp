@@ -0,0 +1,276 @@
+/* compress_adler32.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+
+#include "../conf.h"
+#include "compress.h"
+#include "../util/simd.h"
+#if WITH_SIMD
+#include <immintrin.h>
+#endif
+
+/*************************************************************************
+// adler32 - vectorized versions of upx_ucl_adler32()
+//
+// For a block of n bytes the sums are
+//   s1' = s1 + sum(b[i])
+//   s2' = s2 + n * s1 + sum((n - i) * b[i])
+// and pmaddubsw computes the weighted sum with a vector of taps.
+// As in zlib at most NMAX bytes are summed up before the modulo.
+**************************************************************************/
+
+namespace {
+
+constexpr unsigned ADLER_BASE = 65521; // largest prime smaller than 65536
+constexpr unsigned ADLER_NMAX = 5552;  // max n with 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1
+
+unsigned adler_scalar(const byte *b, unsigned len, unsigned s1, unsigned s2) noexcept {
+    while (len > 0) {
+        unsigned n = UPX_MIN(len, ADLER_NMAX);
+        len -= n;
+        do {
+            s1 += *b++;
+            s2 += s1;
+        } while (--n);
+        s1 %= ADLER_BASE;
+        s2 %= ADLER_BASE;
+    }
+    return (s2 << 16) | s1;
+}
+
+#if WITH_SIMD
+
+upx_simd_target("ssse3") unsigned adler_ssse3(const byte *b, unsigned len, unsigned s1,
+                                              unsigned s2) noexcept {
+    const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18,
+                                       17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    unsigned blocks = len / 32;
+    len -= blocks * 32;
+    while (blocks > 0) {
+        unsigned n = UPX_MIN(blocks, ADLER_NMAX / 32);
+        blocks -= n;
+        __m128i v_ps = _mm_setr_epi32(int(s1 * n), 0, 0, 0);
+        __m128i v_s2 = _mm_setr_epi32(int(s2), 0, 0, 0);
+        __m128i v_s1 = _mm_setzero_si128();
+        do {
+            const __m128i bytes1 = _mm_loadu_si128((const __m128i *) b);
+            const __m128i bytes2 = _mm_loadu_si128((const __m128i *) (b + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+            b += 32;
+        } while (--n);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+        // horizontal sums
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        s1 += unsigned(_mm_cvtsi128_si32(v_s1));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        s2 = unsigned(_mm_cvtsi128_si32(v_s2));
+        s1 %= ADLER_BASE;
+        s2 %= ADLER_BASE;
+    }
+    return adler_scalar(b, len, s1, s2);
+}
+
+upx_simd_target("avx2") unsigned adler_avx2(const byte *b, unsigned len, unsigned s1,
+                                            unsigned s2) noexcept {
+    const __m256i tap1 = _mm256_setr_epi8(64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51,
+                                          50, 49, 48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37,
+                                          36, 35, 34, 33);
+    const __m256i tap2 = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19,
+                                          18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3,
+                                          2, 1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    unsigned blocks = len / 64;
+    len -= blocks * 64;
+    while (blocks > 0) {
+        unsigned n = UPX_MIN(blocks, ADLER_NMAX / 64);
+        blocks -= n;
+        __m256i v_ps = _mm256_setr_epi32(int(s1 * n), 0, 0, 0, 0, 0, 0, 0);
+        __m256i v_s2 = _mm256_setr_epi32(int(s2), 0, 0, 0, 0, 0, 0, 0);
+        __m256i v_s1 = _mm256_setzero_si256();
+        do {
+            const __m256i bytes1 = _mm256_loadu_si256((const __m256i *) b);
+            const __m256i bytes2 = _mm256_loadu_si256((const __m256i *) (b + 32));
+            v_ps = _mm256_add_epi32(v_ps, v_s1);
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes1, zero));
+            v_s2 = _mm256_add_epi32(v_s2,
+                                    _mm256_madd_epi16(_mm256_maddubs_epi16(bytes1, tap1), ones));
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes2, zero));
+            v_s2 = _mm256_add_epi32(v_s2,
+                                    _mm256_madd_epi16(_mm256_maddubs_epi16(bytes2, tap2), ones));
+            b += 64;
+        } while (--n);
+        v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 6));
+        // horizontal sums
+        __m128i h_s1 = _mm_add_epi32(_mm256_castsi256_si128(v_s1),
+                                     _mm256_extracti128_si256(v_s1, 1));
+        __m128i h_s2 = _mm_add_epi32(_mm256_castsi256_si128(v_s2),
+                                     _mm256_extracti128_si256(v_s2, 1));
+        h_s1 = _mm_add_epi32(h_s1, _mm_shuffle_epi32(h_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        s1 += unsigned(_mm_cvtsi128_si32(h_s1));
+        h_s2 = _mm_add_epi32(h_s2, _mm_shuffle_epi32(h_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        h_s2 = _mm_add_epi32(h_s2, _mm_shuffle_epi32(h_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        s2 = unsigned(_mm_cvtsi128_si32(h_s2));
+        s1 %= ADLER_BASE;
+        s2 %= ADLER_BASE;
+    }
+    return adler_ssse3(b, len, s1, s2);
+}
+
+#endif // WITH_SIMD
+
+} // namespace
+
+// returns adler32 if there is a SIMD version for this CPU, else "false"
+bool upx_simd_adler32(const void *buf, unsigned len, unsigned *adler) noexcept {
+#if WITH_SIMD
+    const int level = upx::simd_get_level();
+    if (level < upx::SIMD_SSSE3)
+        return false;
+    const byte *const b = (const byte *) buf;
+    const unsigned s1 = *adler & 0xffff;
+    const unsigned s2 = (*adler >> 16) & 0xffff;
+    if (level >= upx::SIMD_AVX2)
+        *adler = adler_avx2(b, len, s1, s2);
+    else
+        *adler = adler_ssse3(b, len, s1, s2);
+    return true;
+#else
+    UNUSED(buf);
+    UNUSED(len);
+    UNUSED(adler);
+    return false;
+#endif
+}
+
+/*************************************************************************
+// upx_adler32_combine: the adler32 of the concatenation A+B, given
+// adler1 = adler32(A), adler2 = adler32(B) (starting with 1) and
+// len2 = len(B); see adler32_combine() in zlib
+**************************************************************************/
+
+unsigned upx_adler32_combine(unsigned adler1, unsigned adler2, unsigned len2) noexcept {
+    const unsigned rem = len2 % ADLER_BASE;
+    unsigned sum1 = adler1 & 0xffff;
+    unsigned sum2 = unsigned((upx_uint64_t(rem) * sum1) % ADLER_BASE);
+    sum1 += (adler2 & 0xffff) + ADLER_BASE - 1;
+    sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + ADLER_BASE - rem;
+    if (sum1 >= ADLER_BASE)
+        sum1 -= ADLER_BASE;
+    if (sum1 >= ADLER_BASE)
+        sum1 -= ADLER_BASE;
+    if (sum2 >= 2 * ADLER_BASE)
+        sum2 -= 2 * ADLER_BASE;
+    if (sum2 >= ADLER_BASE)
+        sum2 -= ADLER_BASE;
+    return sum1 | (sum2 << 16);
+}
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#include "../util/membuffer.h"
+#include "../check/dt_bench.h"
+#include "../check/dt_data.h"
+
+TEST_CASE("upx_adler32 SIMD") {
+    constexpr unsigned N = 3 * ADLER_NMAX + 123;
+    MemBuffer buf(N);
+    // worst case for the sums: all bytes 0xff
+    memset(buf, 0xff, N);
+    const int level = upx::simd_get_level();
+    for (int pass = 0; pass < 2; pass++) {
+        for (const unsigned len : {0u, 1u, 31u, 32u, 63u, 64u, 65u, 1000u, ADLER_NMAX, N}) {
+            for (const unsigned adler : {1u, 0u, 0xfff0fff0u}) {
+                const unsigned expected = adler_scalar(buf, len, adler & 0xffff, adler >> 16);
+                CHECK(upx_ucl_adler32(buf, len, adler) == expected);
+                CHECK(upx_adler32(buf, len, adler) == expected);
+                for (int l = upx::SIMD_SSSE3; l <= level; l++) {
+                    upx::simd_set_limit(l);
+                    unsigned a = adler;
+                    CHECK(upx_simd_adler32(buf, len, &a));
+                    CHECK(a == expected);
+                }
+                upx::simd_set_limit(upx::SIMD_AVX2);
+            }
+        }
+        // pseudo-random data
+        upx::testdata::fill_random(buf, N, 0x12345678);
+    }
+}
+
+TEST_CASE("upx_adler32_combine") {
+    constexpr unsigned N = 2 * ADLER_NMAX + 7;
+    MemBuffer buf(N);
+    for (unsigned i = 0; i < N; i++)
+        buf[i] = byte(i * 7 + (i >> 8));
+    const unsigned full = upx_adler32(buf, N);
+    for (const unsigned split : {0u, 1u, 100u, ADLER_NMAX, N - 1, N}) {
+        const unsigned a1 = upx_adler32(buf, split);
+        const unsigned a2 = upx_adler32(buf + split, N - split);
+        CHECK(upx_adler32_combine(a1, a2, N - split) == full);
+    }
+    CHECK(upx_adler32_combine(0x12345678, 1, 0) == 0x12345678);
+}
+
+TEST_CASE("bench adler32" * doctest::skip()) {
+    constexpr unsigned N = 16 * 1024 * 1024;
+    MemBuffer buf(N);
+    upx::testdata::fill_random(buf, N, 0x12345678);
+    volatile unsigned sink = 0;
+    const double t_ucl = upx::bench::best_time([&]() { sink = upx_ucl_adler32(buf, N, 1); });
+    upx::bench::report("adler32", "ucl", N, t_ucl);
+    const int level = upx::simd_get_level();
+    for (int l = upx::SIMD_SSSE3; l <= level; l++) {
+        upx::simd_set_limit(l);
+        const double t = upx::bench::best_time([&]() { sink = upx_adler32(buf, N, 1); });
+        upx::bench::report("adler32", l == upx::SIMD_AVX2 ? "avx2" : "ssse3", N, t);
+    }
+    upx::simd_set_limit(upx::SIMD_AVX2);
+    // put that into perspective: a fast compression of the same data
+    MemBuffer obuf;
+    obuf.allocForCompression(N);
+    const double t_compress = upx::bench::best_time(
+        [&]() {
+            unsigned o_len = 0;
+            (void) upx_compress(buf, N, obuf, &o_len, nullptr, M_NRV2B_LE32, 1, nullptr,
+                                nullptr);
+        },
+        0, 1);
+    upx::bench::report("upx_compress nrv2b level 1", "", N, t_compress);
+    UNUSED(sink);
+}
+
+/* vim:set ts=4 sw=4 et: */
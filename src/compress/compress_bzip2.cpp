@@ -67,8 +67,11 @@ int upx_bzip2_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, uns
     assert(method == M_BZIP2);
     assert(level > 0);
     assert(cresult != nullptr);
-    UNUSED(cb_parm);
     int r = UPX_E_ERROR;
+    // a budget limits the output, see upx_callback_t; bzip2 gets one more
+    // byte so that it can finish if the result fits exactly
+    const unsigned dst_limit = cb_parm ? cb_parm->limitOutput(*dst_len) : *dst_len;
+    const bool limited = dst_limit < *dst_len;
     const bzip2_compress_config_t *const lcconf = cconf_parm ? &cconf_parm->conf_bzip2 : nullptr;
     bzip2_compress_result_t *const res = &cresult->result_bzip2;
     res->reset();
@@ -85,7 +88,11 @@ int upx_bzip2_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, uns
 
     char *dest = (char *) dst;
     char *source = (char *) const_cast<byte *>(src);
-    r = BZ2_bzBuffToBuffCompress(dest, dst_len, source, src_len, blockSize100k, 0, 0);
+    unsigned out_len = limited ? dst_limit + 1 : dst_limit;
+    r = BZ2_bzBuffToBuffCompress(dest, &out_len, source, src_len, blockSize100k, 0, 0);
+    if (limited && (r == BZ_OUTBUFF_FULL || (r == BZ_OK && out_len > dst_limit)))
+        return UPX_E_ABORTED;
+    *dst_len = out_len;
     return convert_errno_from_bzip2(r);
 }
 
@@ -0,0 +1,159 @@
+/* compress_estimate.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+#include "../conf.h"
+#include <cmath> // std::log2
+
+/*************************************************************************
+// Quickly estimate the compressed size of a buffer.
+//
+// This runs a greedy LZ parse with a small hash table over some sampled
+// windows of the input, and charges the literals by their order-0 entropy
+// and the matches by a rough NRV-like bit cost. The result is not meant
+// to be close to any real compressor - it only needs to rank different
+// filterings of the same data, see Packer::compressWithFilters().
+**************************************************************************/
+
+namespace {
+
+constexpr unsigned EST_WINDOW_SIZE = 65536;
+constexpr unsigned EST_MAX_WINDOWS = 16;
+constexpr unsigned EST_HASH_BITS = 13;
+constexpr unsigned EST_MIN_MATCH = 4;
+constexpr unsigned EST_MAX_MATCH = 273;
+
+inline unsigned est_bitlen(unsigned x) noexcept {
+    unsigned n = 0;
+    while (x) {
+        n++;
+        x >>= 1;
+    }
+    return n;
+}
+
+inline unsigned est_hash(const byte *p) noexcept {
+    return (get_le32(p) * 0x9e3779b1u) >> (32 - EST_HASH_BITS);
+}
+
+struct EstState final {
+    upx_uint64_t literal_counts[256] = {};
+    upx_uint64_t nliterals = 0;
+    upx_uint64_t match_bits = 0;
+    unsigned table[1u << EST_HASH_BITS]; // window position + 1, 0 means empty
+
+    void window(const byte *buf, unsigned len) noexcept {
+        memset(table, 0, sizeof(table));
+        unsigned i = 0;
+        while (i < len) {
+            unsigned m_len = 0, m_off = 0;
+            if (i + EST_MIN_MATCH <= len) {
+                const unsigned h = est_hash(buf + i);
+                const unsigned cand = table[h];
+                table[h] = i + 1;
+                if (cand != 0) {
+                    const unsigned pos = cand - 1;
+                    const unsigned limit = UPX_MIN(len - i, EST_MAX_MATCH);
+                    while (m_len < limit && buf[pos + m_len] == buf[i + m_len])
+                        m_len++;
+                    m_off = i - pos;
+                }
+            }
+            if (m_len >= EST_MIN_MATCH) {
+                // flag + offset + gamma coded length
+                match_bits += 2 + est_bitlen(m_off) + 2 * est_bitlen(m_len - EST_MIN_MATCH + 1);
+                i += m_len;
+            } else {
+                literal_counts[buf[i]]++;
+                nliterals++;
+                i++;
+            }
+        }
+    }
+
+    upx_uint64_t bits() const noexcept {
+        double lit_bits = double(nliterals); // one flag bit per literal
+        if (nliterals != 0) {
+            const double n = double(nliterals);
+            for (unsigned b = 0; b < 256; b++)
+                if (literal_counts[b] != 0)
+                    lit_bits += double(literal_counts[b]) * std::log2(n / double(literal_counts[b]));
+        }
+        return upx_uint64_t(lit_bits) + match_bits;
+    }
+};
+
+} // namespace
+
+unsigned upx_estimate_compressed_size(const byte *buf, unsigned len) {
+    if (len == 0)
+        return 0;
+    EstState st;
+
+    // use up to EST_MAX_WINDOWS evenly spaced windows
+    const unsigned nwindows_total = (len + EST_WINDOW_SIZE - 1) / EST_WINDOW_SIZE;
+    const unsigned nwindows = UPX_MIN(nwindows_total, EST_MAX_WINDOWS);
+    upx_uint64_t sampled = 0;
+    for (unsigned w = 0; w < nwindows; w++) {
+        const unsigned idx = unsigned(upx_uint64_t(w) * nwindows_total / nwindows);
+        const unsigned off = idx * EST_WINDOW_SIZE;
+        const unsigned wlen = UPX_MIN(len - off, EST_WINDOW_SIZE);
+        st.window(buf + off, wlen);
+        sampled += wlen;
+    }
+
+    // extrapolate
+    const upx_uint64_t bytes = (st.bits() + 7) / 8;
+    const upx_uint64_t est = bytes * len / sampled;
+    return unsigned(UPX_MIN(est, upx_uint64_t(len)));
+}
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#include "../util/membuffer.h"
+#include "../check/dt_data.h"
+
+TEST_CASE("upx_estimate_compressed_size") {
+    constexpr unsigned N = 65536;
+    MemBuffer buf(N);
+    CHECK(upx_estimate_compressed_size(buf, 0) == 0);
+    // constant data compresses very well
+    memset(buf, 0, N);
+    const unsigned est_zero = upx_estimate_compressed_size(buf, N);
+    CHECK(est_zero < N / 64);
+    // pseudo-random data does not compress
+    upx::testdata::fill_random(buf, N, 0x12345678);
+    const unsigned est_random = upx_estimate_compressed_size(buf, N);
+    CHECK(est_random > N - N / 16);
+    CHECK(est_random <= N);
+    // repeating the random data every 4 KiB makes it compressible again
+    for (unsigned i = 4096; i < N; i++)
+        buf[i] = buf[i - 4096];
+    CHECK(upx_estimate_compressed_size(buf, N) < N / 8);
+}
+
+/* vim:set ts=4 sw=4 et: */
@@ -260,11 +260,17 @@ struct ProgressInfo final : public ICompressProgressInfo, public CMyUnknownImp {
     MY_UNKNOWN_IMP
     STDMETHOD(SetRatioInfo)(const UInt64 *inSize, const UInt64 *outSize) override;
     upx_callback_t *cb = nullptr;
+    unsigned src_len = 0;
+    bool aborted = false;
 };
 
 STDMETHODIMP ProgressInfo::SetRatioInfo(const UInt64 *inSize, const UInt64 *outSize) {
     if (cb && cb->nprogress)
         cb->nprogress(cb, (unsigned) *inSize, (unsigned) *outSize);
+    if (cb && cb->overBudget((unsigned) *inSize, (unsigned) *outSize, src_len)) {
+        aborted = true;
+        return E_ABORT;
+    }
     return S_OK;
 }
 
@@ -288,6 +294,22 @@ STDMETHODIMP ProgressInfo::SetRatioInfo(const UInt64 *inSize, const UInt64 *outS
 #pragma GCC diagnostic pop
 #endif
 
+namespace MyLzma {
+// reusable encoders, see compress.h; CEncoder::Create() keeps the match finder
+// if the dictionary size and the number of fast bytes did not change
+struct EncoderContext final {
+    NCompress::NLZMA::CEncoder enc;
+    unsigned dict_size;
+    unsigned num_fast_bytes;
+    unsigned match_finder_cycles;
+};
+
+} // namespace MyLzma
+
+static upx_compress_context_pool<MyLzma::EncoderContext> lzma_contexts;
+
+void upx_lzma_release_contexts(void) noexcept { lzma_contexts.release(); }
+
 int upx_lzma_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsigned *dst_len,
                       upx_callback_t *cb, int method, int level,
                       const upx_compress_config_t *cconf_parm, upx_compress_result_t *cresult) {
@@ -304,14 +326,17 @@ int upx_lzma_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsi
     MyLzma::InStream is;
     is.AddRef();
     is.Init(src, src_len);
+    // a budget limits the output, see upx_callback_t
+    const unsigned dst_limit = cb ? cb->limitOutput(*dst_len) : *dst_len;
     MyLzma::OutStream os;
     os.AddRef();
-    os.Init(dst, *dst_len);
+    os.Init(dst, dst_limit);
     MyLzma::ProgressInfo progress;
     progress.AddRef();
     progress.cb = cb; // progress.Init()
+    progress.src_len = src_len;
 
-    NCompress::NLZMA::CEncoder enc;
+    MyLzma::EncoderContext *ctx = nullptr;
     constexpr unsigned NPROPS = 8;
     static const PROPID propIDs[NPROPS] = {
         NCoderPropID::kPosStateBits,      // 0  pb    _posStateBits(2)
@@ -339,15 +364,30 @@ int upx_lzma_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsi
     assert(NCompress::NLZMA::FindMatchFinder(matchfinder) >= 0);
     pr[7].bstrVal = ACC_PCAST(BSTR, ACC_UNCONST_CAST(wchar_t *, matchfinder));
 
+    // reuse an idle encoder, unless its match finder would get rebuilt anyway
+    ctx = lzma_contexts.get();
+    if (ctx != nullptr &&
+        (ctx->dict_size != res->dict_size || ctx->num_fast_bytes != res->num_fast_bytes ||
+         ctx->match_finder_cycles != res->match_finder_cycles)) {
+        delete ctx;
+        ctx = nullptr;
+    }
+    if (ctx == nullptr) {
+        ctx = new MyLzma::EncoderContext;
+        ctx->dict_size = res->dict_size;
+        ctx->num_fast_bytes = res->num_fast_bytes;
+        ctx->match_finder_cycles = res->match_finder_cycles;
+    }
+
     try {
-        if (enc.SetCoderProperties(propIDs, pr, NPROPS) != S_OK)
+        if (ctx->enc.SetCoderProperties(propIDs, pr, NPROPS) != S_OK)
             goto error;
         // encode properties in LZMA-style (5 bytes)
-        if (enc.WriteCoderProperties(&os) != S_OK)
+        if (ctx->enc.WriteCoderProperties(&os) != S_OK)
             goto error;
         if (os.overflow) {
             // r = UPX_E_OUTPUT_OVERRUN;
-            r = UPX_E_NOT_COMPRESSIBLE;
+            r = dst_limit < *dst_len ? UPX_E_ABORTED : UPX_E_NOT_COMPRESSIBLE;
             goto error;
         }
         assert(os.b_pos == 5);
@@ -360,7 +400,7 @@ int upx_lzma_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsi
         os.WriteByte(Byte((res->lit_pos_bits << 4) | res->lit_context_bits));
 
         // compress
-        rh = enc.Code(&is, &os, nullptr, nullptr, &progress);
+        rh = ctx->enc.Code(&is, &os, nullptr, nullptr, &progress);
 
     } catch (...) {
         rh = E_OUTOFMEMORY;
@@ -370,16 +410,23 @@ int upx_lzma_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsi
     assert(os.b_pos <= *dst_len);
     if (rh == E_OUTOFMEMORY)
         r = UPX_E_OUT_OF_MEMORY;
+    else if (progress.aborted)
+        r = UPX_E_ABORTED;
     else if (os.overflow) {
-        assert(os.b_pos == *dst_len);
+        assert(os.b_pos == dst_limit);
         // r = UPX_E_OUTPUT_OVERRUN;
-        r = UPX_E_NOT_COMPRESSIBLE;
+        r = dst_limit < *dst_len ? UPX_E_ABORTED : UPX_E_NOT_COMPRESSIBLE;
     } else if (rh == S_OK) {
         assert(is.b_pos == src_len);
         r = UPX_E_OK;
     }
 
 error:
+    // keep the encoder for the next call unless something went wrong
+    if (r == UPX_E_OK || r == UPX_E_ABORTED || r == UPX_E_NOT_COMPRESSIBLE)
+        lzma_contexts.put(ctx);
+    else
+        delete ctx;
     *dst_len = (unsigned) os.b_pos;
     NO_printf("\nlzma_compress: %d: %u %u %u %u %u, %u - > %u\n", r, res->pos_bits,
               res->lit_pos_bits, res->lit_context_bits, res->dict_size, res->num_probs, src_len,
@@ -523,4 +570,60 @@ TEST_CASE("upx_lzma_decompress") {
     UNUSED(r);
 }
 
+#if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && 1
+
+#include "../check/dt_data.h"
+
+static int lzma_budget_compress(const MemBuffer &u_buf, MemBuffer &c_buf, unsigned *c_len,
+                                upx_callback_t *cb) {
+    const unsigned u_len = u_buf.getSize();
+    upx_compress_result_t cresult;
+    *c_len = c_buf.getSize();
+    return upx_lzma_compress(raw_bytes(u_buf, u_len), u_len, raw_bytes(c_buf, *c_len), c_len, cb,
+                             M_LZMA, 2, NULL_cconf, &cresult);
+}
+
+TEST_CASE("upx_lzma_compress budget") {
+    const unsigned u_len = 65536;
+    MemBuffer u_buf, c_buf;
+    u_buf.alloc(u_len);
+    c_buf.allocForCompression(u_len);
+    upx::testdata::Rng rng(1);
+    for (unsigned i = 0; i < u_len; i++)
+        u_buf[i] = (byte) ((rng.next() >> 24) & 0x0f); // compressible, but not too much
+    upx_callback_t cb;
+    cb.reset();
+    unsigned c_len, len;
+    CHECK(lzma_budget_compress(u_buf, c_buf, &c_len, &cb) == UPX_E_OK);
+    CHECK((c_len > 1000 && c_len < u_len));
+    // the output limit is exact
+    cb.max_out = c_len;
+    CHECK(lzma_budget_compress(u_buf, c_buf, &len, &cb) == UPX_E_OK);
+    CHECK(len == c_len);
+    cb.max_out = c_len - 1;
+    CHECK(lzma_budget_compress(u_buf, c_buf, &len, &cb) == UPX_E_ABORTED);
+    // projected size
+    cb.reset();
+    cb.max_projected = c_len / 2;
+    CHECK(lzma_budget_compress(u_buf, c_buf, &len, &cb) == UPX_E_ABORTED);
+    cb.min_in = u_len + 1; // never reached
+    CHECK(lzma_budget_compress(u_buf, c_buf, &len, &cb) == UPX_E_OK);
+    CHECK(len == c_len);
+    // a warm encoder that is reused after the aborted runs above gives
+    // the same result as a new one
+    MemBuffer c_buf2;
+    c_buf2.allocForCompression(u_len);
+    const upx_uint64_t reused = lzma_contexts.getReuseCounter();
+    CHECK(lzma_budget_compress(u_buf, c_buf2, &len, nullptr) == UPX_E_OK);
+    CHECK(lzma_contexts.getReuseCounter() == reused + 1);
+    CHECK((len == c_len && memcmp(c_buf, c_buf2, c_len) == 0));
+    upx_lzma_release_contexts();
+    c_buf2.clear();
+    CHECK(lzma_budget_compress(u_buf, c_buf2, &len, nullptr) == UPX_E_OK);
+    CHECK(lzma_contexts.getReuseCounter() == reused + 1);
+    CHECK((len == c_len && memcmp(c_buf, c_buf2, c_len) == 0));
+}
+
+#endif // DEBUG
+
 /* vim:set ts=4 sw=4 et: */
@@ -238,6 +238,216 @@ int upx_ucl_test_overlap(const upx_bytep buf, const upx_bytep tbuf, unsigned src
     return convert_errno_from_ucl(r);
 }
 
+/*************************************************************************
+// min_overlap - compute the minimal src_off for upx_ucl_test_overlap()
+// in a single pass.
+//
+// This is a plain bitstream parser for the NRV2B/NRV2D/NRV2E formats
+// that does not write any output; it just tracks the maximum distance
+// by which the write pointer runs ahead of the read pointer, i.e. it
+// checks exactly the same condition as ucl_nrv2X_test_overlap().
+**************************************************************************/
+
+namespace {
+
+template <int N>
+struct NrvBitReader final {
+    const upx_bytep src;
+    unsigned src_len;
+    unsigned ilen = 0;
+    unsigned bb = 0;
+    unsigned bc = 0;
+    bool overrun = false;
+
+    explicit NrvBitReader(const upx_bytep s, unsigned l) noexcept : src(s), src_len(l) {}
+
+    unsigned getbyte() noexcept {
+        if very_unlikely (ilen >= src_len) {
+            overrun = true;
+            return 0;
+        }
+        return src[ilen++];
+    }
+    unsigned getbit() noexcept {
+        if (N == 8) {
+            if (bb & 0x7f)
+                bb *= 2;
+            else
+                bb = getbyte() * 2 + 1;
+            return (bb >> 8) & 1;
+        } else if (N == 16) {
+            bb *= 2;
+            if (bb & 0xffff)
+                return (bb >> 16) & 1;
+            unsigned b0 = getbyte();
+            unsigned b1 = getbyte();
+            bb = (b0 + b1 * 256) * 2 + 1;
+            return (bb >> 16) & 1;
+        } else {
+            if (bc > 0)
+                return (bb >> --bc) & 1;
+            if very_unlikely (ilen + 4 > src_len || ilen + 4 < ilen) {
+                overrun = true;
+                return 0;
+            }
+            bc = 31;
+            bb = get_le32(src + ilen);
+            ilen += 4;
+            return (bb >> 31) & 1;
+        }
+    }
+};
+
+template <int N, char V>
+int nrv_min_overlap(const upx_bytep src, unsigned src_len, unsigned *dst_len,
+                    unsigned *src_off) noexcept {
+    NrvBitReader<N> r(src, src_len);
+    const unsigned oend = *dst_len;
+    unsigned olen = 0;
+    unsigned last_m_off = 1;
+    unsigned max_gap = 0;
+    int ret = UPX_E_OK;
+    auto track_gap = [&]() noexcept {
+        if (olen > r.ilen && olen - r.ilen > max_gap)
+            max_gap = olen - r.ilen;
+    };
+
+#define FAIL(x, e)                                                                                 \
+    if very_unlikely (x) {                                                                         \
+        ret = e;                                                                                   \
+        goto done;                                                                                 \
+    }
+
+    for (;;) {
+        unsigned m_off, m_len;
+
+        while (r.getbit()) {
+            FAIL(r.overrun || r.ilen >= src_len, UPX_E_INPUT_OVERRUN)
+            FAIL(olen >= oend, UPX_E_OUTPUT_OVERRUN)
+            track_gap();
+            olen++;
+            r.ilen++;
+        }
+        m_off = 1;
+        if (V == 'b') {
+            do {
+                m_off = m_off * 2 + r.getbit();
+                FAIL(r.overrun, UPX_E_INPUT_OVERRUN)
+                FAIL(m_off > 0xffffffu + 3, UPX_E_LOOKBEHIND_OVERRUN)
+            } while (!r.getbit());
+        } else {
+            for (;;) {
+                m_off = m_off * 2 + r.getbit();
+                FAIL(r.overrun, UPX_E_INPUT_OVERRUN)
+                FAIL(m_off > 0xffffffu + 3, UPX_E_LOOKBEHIND_OVERRUN)
+                if (r.getbit())
+                    break;
+                m_off = (m_off - 1) * 2 + r.getbit();
+            }
+        }
+        if (m_off == 2) {
+            m_off = last_m_off;
+            m_len = (V == 'b') ? 0 : r.getbit();
+        } else {
+            m_off = (m_off - 3) * 256 + r.getbyte();
+            FAIL(r.overrun, UPX_E_INPUT_OVERRUN)
+            if (m_off == 0xffffffffu)
+                break; // EOF marker
+            m_len = 0;
+            if (V != 'b') {
+                m_len = (m_off ^ 0xffffffffu) & 1;
+                m_off >>= 1;
+            }
+            last_m_off = ++m_off;
+        }
+        if (V == 'e') {
+            if (m_len)
+                m_len = 1 + r.getbit();
+            else if (r.getbit())
+                m_len = 3 + r.getbit();
+            else {
+                m_len++;
+                do {
+                    m_len = m_len * 2 + r.getbit();
+                    FAIL(r.overrun, UPX_E_INPUT_OVERRUN)
+                    FAIL(m_len >= oend, UPX_E_OUTPUT_OVERRUN)
+                } while (!r.getbit());
+                m_len += 3;
+            }
+        } else {
+            if (V == 'b')
+                m_len = r.getbit();
+            m_len = m_len * 2 + r.getbit();
+            if (m_len == 0) {
+                m_len++;
+                do {
+                    m_len = m_len * 2 + r.getbit();
+                    FAIL(r.overrun, UPX_E_INPUT_OVERRUN)
+                    FAIL(m_len >= oend, UPX_E_OUTPUT_OVERRUN)
+                } while (!r.getbit());
+                m_len += 2;
+            }
+        }
+        FAIL(r.overrun, UPX_E_INPUT_OVERRUN)
+        m_len += (m_off > (V == 'b' ? 0xd00u : 0x500u));
+        FAIL(m_len >= oend - olen, UPX_E_OUTPUT_OVERRUN) // olen + m_len + 1 > oend
+        FAIL(m_off > olen, UPX_E_LOOKBEHIND_OVERRUN)
+        olen += m_len + 1;
+        track_gap();
+    }
+    if (r.ilen != src_len)
+        ret = r.ilen < src_len ? UPX_E_INPUT_NOT_CONSUMED : UPX_E_INPUT_OVERRUN;
+
+#undef FAIL
+done:
+    *dst_len = olen;
+    *src_off = max_gap;
+    return ret;
+}
+
+} // namespace
+
+int upx_ucl_min_overlap(const upx_bytep src, unsigned src_len, unsigned *dst_len,
+                        unsigned *src_off, int method, const upx_compress_result_t *cresult) {
+    int r;
+
+    switch (method) {
+    case M_NRV2B_8:
+        r = nrv_min_overlap<8, 'b'>(src, src_len, dst_len, src_off);
+        break;
+    case M_NRV2B_LE16:
+        r = nrv_min_overlap<16, 'b'>(src, src_len, dst_len, src_off);
+        break;
+    case M_NRV2B_LE32:
+        r = nrv_min_overlap<32, 'b'>(src, src_len, dst_len, src_off);
+        break;
+    case M_NRV2D_8:
+        r = nrv_min_overlap<8, 'd'>(src, src_len, dst_len, src_off);
+        break;
+    case M_NRV2D_LE16:
+        r = nrv_min_overlap<16, 'd'>(src, src_len, dst_len, src_off);
+        break;
+    case M_NRV2D_LE32:
+        r = nrv_min_overlap<32, 'd'>(src, src_len, dst_len, src_off);
+        break;
+    case M_NRV2E_8:
+        r = nrv_min_overlap<8, 'e'>(src, src_len, dst_len, src_off);
+        break;
+    case M_NRV2E_LE16:
+        r = nrv_min_overlap<16, 'e'>(src, src_len, dst_len, src_off);
+        break;
+    case M_NRV2E_LE32:
+        r = nrv_min_overlap<32, 'e'>(src, src_len, dst_len, src_off);
+        break;
+    default:
+        throwInternalError("unknown decompression method");
+        return UPX_E_ERROR;
+    }
+
+    UNUSED(cresult);
+    return r;
+}
+
 /*************************************************************************
 // misc
 **************************************************************************/
@@ -275,6 +485,7 @@ unsigned upx_ucl_crc32(const void *buf, unsigned len, unsigned crc) {
 #if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && 1
 
 #include "../util/membuffer.h"
+#include "../check/dt_data.h"
 
 static bool check_ucl(const int method, const unsigned expected_c_len) {
     const unsigned u_len = 16384;
@@ -307,10 +518,48 @@ static bool check_ucl(const int method, const unsigned expected_c_len) {
                            &d_len, method, nullptr);
     if (r == 0)
         return false;
+    return true;
+}
 
-    // TODO: rewrite Packer::findOverlapOverhead() so that we can test it here
-    // unsigned x_len = d_len;
-    // r = upx_ucl_test_overlap(c_buf, u_buf, c_extra, c_len, &x_len, method, nullptr);
+// upx_ucl_min_overlap() must agree exactly with upx_ucl_test_overlap()
+static bool check_ucl_min_overlap(const int method) {
+    const unsigned u_len = 16384;
+    MemBuffer u_buf, c_buf, x_buf;
+    unsigned c_len, x_len, src_off;
+    upx_compress_result_t cresult;
+    int r;
+    const int level = 3; // don't waste time
+
+    // some mix of literals and matches
+    u_buf.alloc(u_len);
+    memset(u_buf, 0, u_len);
+    upx::testdata::Rng rng(0x12345678);
+    for (unsigned i = 0; i < u_len; i++) {
+        const unsigned x = rng.next() >> 16;
+        u_buf[i] = (i & 2048) ? byte(x) : (x & 7) ? u_buf[i / 2] : byte(i);
+    }
+    c_buf.allocForCompression(u_len);
+    c_len = c_buf.getSize();
+    r = upx_ucl_compress(raw_bytes(u_buf, u_len), u_len, raw_bytes(c_buf, c_len), &c_len, nullptr,
+                         method, level, NULL_cconf, &cresult);
+    if (r != 0 || c_len >= u_len)
+        return false;
+
+    x_len = u_len;
+    r = upx_ucl_min_overlap(raw_bytes(c_buf, c_len), c_len, &x_len, &src_off, method, nullptr);
+    if (r != 0 || x_len != u_len || src_off == 0)
+        return false;
+
+    x_buf.alloc(src_off + c_len);
+    for (unsigned off = src_off - 1; off <= src_off; off++) {
+        memcpy(x_buf + off, c_buf, c_len);
+        x_len = u_len;
+        r = upx_ucl_test_overlap(raw_bytes(x_buf, off + c_len), nullptr, off, c_len, &x_len,
+                                 method, nullptr);
+        const bool ok = (r == 0 && x_len == u_len);
+        if (ok != (off == src_off))
+            return false;
+    }
     return true;
 }
 
@@ -326,6 +575,18 @@ TEST_CASE("compress_ucl") {
     CHECK(check_ucl(M_NRV2E_LE32, 34));
 }
 
+TEST_CASE("upx_ucl_min_overlap") {
+    CHECK(check_ucl_min_overlap(M_NRV2B_8));
+    CHECK(check_ucl_min_overlap(M_NRV2B_LE16));
+    CHECK(check_ucl_min_overlap(M_NRV2B_LE32));
+    CHECK(check_ucl_min_overlap(M_NRV2D_8));
+    CHECK(check_ucl_min_overlap(M_NRV2D_LE16));
+    CHECK(check_ucl_min_overlap(M_NRV2D_LE32));
+    CHECK(check_ucl_min_overlap(M_NRV2E_8));
+    CHECK(check_ucl_min_overlap(M_NRV2E_LE16));
+    CHECK(check_ucl_min_overlap(M_NRV2E_LE32));
+}
+
 #endif // DEBUG
 
 TEST_CASE("upx_ucl_decompress") {
@@ -72,6 +72,26 @@ static int convert_errno_from_zlib(int zr) {
     return UPX_E_ERROR;
 }
 
+/*************************************************************************
+// reusable deflate states, see compress.h
+**************************************************************************/
+
+namespace {
+struct ZlibContext final {
+    z_stream s;
+    // deflateReset() keeps these parameters
+    int level;
+    int window_bits;
+    int mem_level;
+    int strategy;
+    ~ZlibContext() noexcept { (void) deflateEnd(&s); }
+};
+} // namespace
+
+static upx_compress_context_pool<ZlibContext> zlib_contexts;
+
+void upx_zlib_release_contexts(void) noexcept { zlib_contexts.release(); }
+
 /*************************************************************************
 //
 **************************************************************************/
@@ -82,9 +102,12 @@ int upx_zlib_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsi
     assert(method == M_DEFLATE);
     assert(level > 0);
     assert(cresult != nullptr);
-    UNUSED(cb_parm);
     int r = UPX_E_ERROR;
     int zr;
+    // a budget limits the output, see upx_callback_t; deflate() gets one more
+    // byte so that it can finish if the result fits exactly
+    const unsigned dst_limit = cb_parm ? cb_parm->limitOutput(*dst_len) : *dst_len;
+    const bool limited = dst_limit < *dst_len;
     const zlib_compress_config_t *const lcconf = cconf_parm ? &cconf_parm->conf_zlib : nullptr;
     zlib_compress_result_t *const res = &cresult->result_zlib;
     res->reset();
@@ -102,29 +125,45 @@ int upx_zlib_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsi
         upx::oassign(strategy, lcconf->strategy);
     }
 
-    z_stream s;
-    s.zalloc = (alloc_func) nullptr;
-    s.zfree = (free_func) nullptr;
+    // reuse an idle deflate state with the same parameters
+    ZlibContext *ctx = zlib_contexts.get();
+    if (ctx != nullptr && (ctx->level != level || ctx->window_bits != (int) window_bits ||
+                           ctx->mem_level != (int) mem_level || ctx->strategy != (int) strategy)) {
+        delete ctx;
+        ctx = nullptr;
+    }
+    const bool reuse = ctx != nullptr;
+    if (!reuse) {
+        ctx = new ZlibContext;
+        mem_clear(&ctx->s);
+        ctx->level = level;
+        ctx->window_bits = window_bits;
+        ctx->mem_level = mem_level;
+        ctx->strategy = strategy;
+    }
+    z_stream &s = ctx->s;
+    if (reuse)
+        zr = deflateReset(&s);
+    else
+        zr = (int) deflateInit2(&s, level, Z_DEFLATED, 0 - (int) window_bits, mem_level, strategy);
     s.next_in = src;
     s.avail_in = src_len;
     s.next_out = dst;
-    s.avail_out = *dst_len;
+    s.avail_out = limited ? dst_limit + 1 : dst_limit;
     s.total_in = s.total_out = 0;
-
-    zr = (int) deflateInit2(&s, level, Z_DEFLATED, 0 - (int) window_bits, mem_level, strategy);
     if (zr != Z_OK)
         goto error;
     assert(s.state->level == level);
     zr = deflate(&s, Z_FINISH);
+    if (limited && (zr == Z_STREAM_END ? s.total_out > dst_limit : s.avail_out == 0)) {
+        r = UPX_E_ABORTED;
+        goto done;
+    }
     if (zr != Z_STREAM_END)
         goto error;
-    zr = deflateEnd(&s);
-    if (zr != Z_OK)
-        goto error;
     r = UPX_E_OK;
     goto done;
 error:
-    (void) deflateEnd(&s);
     r = convert_errno_from_zlib(zr);
     if (r == UPX_E_OK)
         r = UPX_E_ERROR;
@@ -136,6 +175,11 @@ done:
     assert(s.total_in <= src_len);
     assert(s.total_out <= *dst_len);
     *dst_len = s.total_out;
+    // keep the deflate state for the next call unless something went wrong
+    if (r == UPX_E_OK || r == UPX_E_ABORTED)
+        zlib_contexts.put(ctx);
+    else
+        delete ctx;
     return r;
 }
 
@@ -216,6 +260,69 @@ int upx_zlib_test_overlap(const upx_bytep buf, const upx_bytep tbuf, unsigned sr
     return UPX_E_OK;
 }
 
+/*************************************************************************
+// min_overlap - compute the minimal src_off for upx_zlib_test_overlap()
+// in a single pass by feeding the input one byte at a time
+**************************************************************************/
+
+int upx_zlib_min_overlap(const upx_bytep src, unsigned src_len, unsigned *dst_len,
+                         unsigned *src_off, int method, const upx_compress_result_t *cresult) {
+    assert(method == M_DEFLATE);
+    UNUSED(method);
+    UNUSED(cresult);
+    int r = UPX_E_ERROR;
+    int zr;
+    unsigned max_gap = 0;
+
+    MemBuffer b(*dst_len);
+    z_stream s;
+    s.zalloc = (alloc_func) nullptr;
+    s.zfree = (free_func) nullptr;
+    s.next_in = src;
+    s.avail_in = 0;
+    s.next_out = raw_bytes(b, *dst_len);
+    s.avail_out = *dst_len;
+    s.total_in = s.total_out = 0;
+
+    zr = inflateInit2(&s, -15);
+    if (zr != Z_OK)
+        goto error;
+    for (;;) {
+        // all output of this step may overwrite input up to and including
+        // the byte that was just consumed
+        s.avail_in = s.total_in < src_len ? 1 : 0;
+        zr = inflate(&s, Z_NO_FLUSH);
+        if (s.total_out > s.total_in && s.total_out - s.total_in > max_gap)
+            max_gap = unsigned(s.total_out - s.total_in);
+        if (zr == Z_STREAM_END)
+            break;
+        if (zr == Z_BUF_ERROR && s.total_in >= src_len) {
+            zr = -7; // UPX extra
+            goto error;
+        }
+        if (zr != Z_OK)
+            goto error;
+    }
+    zr = inflateEnd(&s);
+    if (zr != Z_OK)
+        goto error;
+    r = UPX_E_OK;
+    goto done;
+error:
+    (void) inflateEnd(&s);
+    r = convert_errno_from_zlib(zr);
+    if (r == UPX_E_OK)
+        r = UPX_E_ERROR;
+done:
+    if (r == UPX_E_OK) {
+        if (s.total_in != src_len)
+            r = UPX_E_INPUT_NOT_CONSUMED;
+    }
+    *dst_len = unsigned(s.total_out);
+    *src_off = max_gap;
+    return r;
+}
+
 /*************************************************************************
 // misc
 **************************************************************************/
@@ -53,6 +53,21 @@ static int convert_errno_from_zstd(size_t zr) {
     return UPX_E_ERROR;
 }
 
+/*************************************************************************
+// reusable compression contexts, see compress.h
+**************************************************************************/
+
+namespace {
+struct ZstdContext final {
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ~ZstdContext() noexcept { (void) ZSTD_freeCCtx(cctx); }
+};
+} // namespace
+
+static upx_compress_context_pool<ZstdContext> zstd_contexts;
+
+void upx_zstd_release_contexts(void) noexcept { zstd_contexts.release(); }
+
 /*************************************************************************
 // TODO later: use advanced compression API for compression finetuning
 **************************************************************************/
@@ -63,9 +78,10 @@ int upx_zstd_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsi
     assert(method == M_ZSTD);
     assert(level > 0);
     assert(cresult != nullptr);
-    UNUSED(cb_parm);
     int r = UPX_E_ERROR;
     size_t zr;
+    // a budget limits the output, see upx_callback_t
+    const unsigned dst_limit = cb_parm ? cb_parm->limitOutput(*dst_len) : *dst_len;
     const zstd_compress_config_t *const lcconf = cconf_parm ? &cconf_parm->conf_zstd : nullptr;
     zstd_compress_result_t *const res = &cresult->result_zstd;
     res->reset();
@@ -79,16 +95,32 @@ int upx_zstd_compress(const upx_bytep src, unsigned src_len, upx_bytep dst, unsi
         UNUSED(lcconf);
     }
 
-    zr = ZSTD_compress(dst, *dst_len, src, src_len, level);
+    ZstdContext *ctx = zstd_contexts.get();
+    if (ctx == nullptr)
+        ctx = new ZstdContext;
+    if (ctx->cctx == nullptr) {
+        delete ctx;
+        *dst_len = 0;
+        return UPX_E_OUT_OF_MEMORY;
+    }
+    // same result as ZSTD_compress(), which uses a temporary context
+    zr = ZSTD_compressCCtx(ctx->cctx, dst, dst_limit, src, src_len, level);
     if (ZSTD_isError(zr)) {
-        *dst_len = 0; // TODO ???
         r = convert_errno_from_zstd(zr);
         assert(r != UPX_E_OK);
+        if (r == UPX_E_OUTPUT_OVERRUN && dst_limit < *dst_len)
+            r = UPX_E_ABORTED;
+        *dst_len = 0; // TODO ???
     } else {
         assert(zr <= *dst_len);
         *dst_len = (unsigned) zr;
         r = UPX_E_OK;
     }
+    // keep the context for the next call unless something went wrong
+    if (r == UPX_E_OK || r == UPX_E_ABORTED)
+        zstd_contexts.put(ctx);
+    else
+        delete ctx;
 
     return r;
 }
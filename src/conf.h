@@ -88,7 +88,7 @@ static_assert((char) (-1) == 255);
 #define upx_is_constant_evaluated __builtin_is_constant_evaluated
 #endif
 
-// multithreading (UPX currently does not use multithreading)
+// multithreading; see "--threads" and "-j"
 #if (WITH_THREADS)
 #define upx_thread_local     thread_local
 #define upx_std_atomic(Type) std::atomic<Type>
@@ -249,6 +249,15 @@ typedef upx_int64_t upx_off_t;
 #define STDERR_FILENO (fileno(stderr))
 #endif
 
+// memory mapped input files; see InputFile::map()
+#ifndef WITH_MMAP
+#if (ACC_OS_POSIX) && !defined(__wasi__)
+#define WITH_MMAP 1
+#else
+#define WITH_MMAP 0
+#endif
+#endif
+
 #if !(HAVE_STRCASECMP) && (HAVE_STRICMP) && !defined(strcasecmp)
 #define strcasecmp stricmp
 #endif
@@ -507,6 +516,7 @@ using upx::tribool;
 #define UPX_E_INPUT_NOT_CONSUMED  (-8)
 #define UPX_E_NOT_YET_IMPLEMENTED (-9)
 #define UPX_E_INVALID_ARGUMENT    (-10)
+#define UPX_E_ABORTED             (-11) // compression budget exceeded, see upx_callback_t
 
 // Executable formats (info: big endian types are >= 128); DO NOT CHANGE
 #define UPX_F_DOS_COM             1
@@ -631,8 +641,27 @@ typedef void(__acc_cdecl *upx_progress_func_t)(upx_callback_t *, unsigned, unsig
 struct upx_callback_t final {
     upx_progress_func_t nprogress;
     void *user;
+    // Optional compression budget (0 means no limit): give up as soon as the
+    // output exceeds "max_out" bytes, or when after at least "min_in" input
+    // bytes the output projects to more than "max_projected" bytes.
+    // Compressors that can stop early then return UPX_E_ABORTED; the others
+    // (NRV and UCL) ignore the budget.
+    unsigned max_out;
+    unsigned max_projected;
+    unsigned min_in;
 
     void reset() noexcept { mem_clear(this); }
+    unsigned limitOutput(unsigned dst_len) const noexcept {
+        return (max_out != 0 && max_out < dst_len) ? max_out : dst_len;
+    }
+    bool overBudget(unsigned in_len, unsigned out_len, unsigned src_len) const noexcept {
+        if (max_out != 0 && out_len > max_out)
+            return true;
+        if (max_projected != 0 && in_len != 0 && in_len >= min_in &&
+            upx_uint64_t(out_len) * src_len / in_len > max_projected)
+            return true;
+        return false;
+    }
 };
 
 /*************************************************************************
@@ -815,6 +844,9 @@ void infoWriting(const char *what, upx_int64_t size);
 void do_one_file(const char *iname, char *oname) may_throw;
 int do_files(int i, int argc, char *argv[]) may_throw;
 
+// benchmark.cpp
+void do_benchmark(int i, int argc, char *argv[]) may_throw;
+
 // help.cpp
 extern const char gitrev[];
 void show_header();
@@ -845,8 +877,19 @@ int upx_test_overlap       ( const upx_bytep buf,
                                    unsigned *dst_len,
                                    int method,
                              const upx_compress_result_t *cresult );
+int upx_min_overlap        ( const upx_bytep src, unsigned  src_len,
+                                   unsigned *dst_len,
+                                   unsigned *src_off,
+                                   int method,
+                             const upx_compress_result_t *cresult );
 // clang-format on
 
+// compress/compress_adler32.cpp
+unsigned upx_adler32_combine(unsigned adler1, unsigned adler2, unsigned len2) noexcept;
+
+// compress/compress_estimate.cpp
+unsigned upx_estimate_compressed_size(const byte *buf, unsigned len);
+
 #include "util/snprintf.h" // must get included first!
 #include "util/util.h"
 #include "options.h"
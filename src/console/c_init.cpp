@@ -130,12 +130,90 @@ void con_fprintf(FILE *f, const char *format, ...) {
     upx_safe_vsnprintf(buf, sizeof(buf), format, args);
     va_end(args);
 
+    if (con_capture_fputs(f, buf))
+        return;
     if (con == me)
         init(f, -1, -1);
     assert(con != me);
     con->print0(f, buf);
 }
 
+/*************************************************************************
+// capture console output ("-j" batch mode)
+//
+// Each record starts with a kind byte and a stream byte ('1' == stdout,
+// '2' == stderr), followed by a NUL-terminated string for CAP_TEXT and
+// CAP_RAW, or by the ASCII-encoded color for CAP_FG.
+**************************************************************************/
+
+enum { CAP_TEXT = 't', CAP_RAW = 'r', CAP_FG = 'c' };
+
+static upx_thread_local ConsoleCapture *con_capture = nullptr;
+
+static void capture_put(ConsoleCapture *c, int kind, FILE *f, const char *s) noexcept {
+    const size_t slen = strlen(s) + 1;
+    if (c->len + 2 + slen > c->capacity) {
+        size_t new_capacity = UPX_MAX(c->capacity * 2, c->len + 2 + slen + 1024);
+        char *new_buf = (char *) ::realloc(c->buf, new_capacity);
+        if (new_buf == nullptr) // out of memory - silently drop the message
+            return;
+        c->buf = new_buf;
+        c->capacity = new_capacity;
+    }
+    c->buf[c->len++] = (char) kind;
+    c->buf[c->len++] = f == stderr ? '2' : '1';
+    memcpy(c->buf + c->len, s, slen);
+    c->len += slen;
+}
+
+void con_capture_begin(ConsoleCapture *c) noexcept { con_capture = c; }
+
+bool con_capture_active() noexcept { return con_capture != nullptr; }
+
+bool con_capture_fputs(FILE *f, const char *s, bool raw) noexcept {
+    if (con_capture == nullptr || (f != stdout && f != stderr))
+        return false;
+    capture_put(con_capture, raw ? CAP_RAW : CAP_TEXT, f, s);
+    return true;
+}
+
+int con_set_fg(FILE *f, int fg) {
+    if (con_capture != nullptr && (f == stdout || f == stderr)) {
+        char buf[16];
+        upx_safe_snprintf(buf, sizeof(buf), "%d", fg);
+        capture_put(con_capture, CAP_FG, f, buf);
+        return -1; // restore startup fg
+    }
+    return con->set_fg(f, fg);
+}
+
+void con_capture_flush(ConsoleCapture *c) noexcept {
+    ConsoleCapture *const saved = con_capture;
+    con_capture = nullptr;
+    for (size_t i = 0; i + 2 < c->len;) {
+        const int kind = c->buf[i];
+        FILE *const f = c->buf[i + 1] == '2' ? stderr : stdout;
+        const char *const s = c->buf + i + 2;
+        if (kind == CAP_TEXT)
+            con_fprintf(f, "%s", s);
+        else if (kind == CAP_RAW)
+            fputs(s, f);
+        else if (kind == CAP_FG)
+            (void) con_set_fg(f, atoi(s));
+        i += 2 + strlen(s) + 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    c->len = 0;
+    con_capture = saved;
+}
+
+void con_capture_free(ConsoleCapture *c) noexcept {
+    ::free(c->buf);
+    c->buf = nullptr;
+    c->len = c->capacity = 0;
+}
+
 #endif /* USE_CONSOLE */
 
 /* vim:set ts=4 sw=4 et: */
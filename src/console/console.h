@@ -157,13 +157,30 @@ extern console_t console_ansi_mono;
 extern console_t console_ansi_color;
 extern console_t console_screen;
 
-#define con_fg(f, x) con->set_fg(f, x)
+int con_set_fg(FILE *f, int fg);
+#define con_fg(f, x) con_set_fg(f, x)
+
+// "-j" batch mode: capture all console output of the current thread so that
+// the output of each file can be printed in one go; see do_files() in work.cpp
+struct ConsoleCapture {
+    char *buf; // sequence of records, see c_init.cpp
+    size_t len;
+    size_t capacity;
+};
+void con_capture_begin(ConsoleCapture *c) noexcept; // nullptr stops capturing
+bool con_capture_active() noexcept;
+bool con_capture_fputs(FILE *f, const char *s, bool raw = false) noexcept;
+void con_capture_flush(ConsoleCapture *c) noexcept; // print captured output and clear
+void con_capture_free(ConsoleCapture *c) noexcept;
 
 #else
 
 #define con_fg(f, x) 0
 #define con_fprintf  fprintf
 
+inline bool con_capture_active() noexcept { return false; }
+inline bool con_capture_fputs(FILE *, const char *, bool = false) noexcept { return false; }
+
 #endif /* USE_CONSOLE */
 
 /* vim:set ts=4 sw=4 et: */
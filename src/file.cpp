@@ -27,6 +27,11 @@
 
 #include "conf.h"
 #include "file.h"
+#include "util/membuffer.h"
+#include "util/stats.h"
+#if WITH_MMAP
+#include <sys/mman.h>
+#endif
 
 /*************************************************************************
 // static file-related util functions; will throw on error
@@ -168,7 +173,10 @@ upx_off_t FileBase::st_size() const { return _length; }
 // InputFile
 **************************************************************************/
 
+InputFile::~InputFile() may_throw { unmap(); }
+
 void InputFile::sopen(const char *name, int flags, int shflags) {
+    unmap();
     closex();
     _name = name;
     _flags = flags;
@@ -190,7 +198,31 @@ void InputFile::sopen(const char *name, int flags, int shflags) {
 int InputFile::read(SPAN_P(void) buf, upx_int64_t blen) {
     if (!isOpen() || blen < 0)
         throwIOException("bad read");
+    upx::PhaseTimer timer(upx::STATS_READ);
     int len = (int) mem_size(1, blen); // sanity check
+    if (_view_ptr != nullptr) {
+        void *const p = raw_bytes(buf, len);
+        if (_view_is_mmap || _view_pos + len <= _view_size) {
+            const upx_off_t avail = _view_pos < _view_size ? _view_size - _view_pos : 0;
+            if (len > avail)
+                len = (int) avail;
+            if (len > 0)
+                memcpy(p, _view_ptr + _view_pos, len);
+            _view_pos += len;
+            return len;
+        }
+        // not covered by the header cache
+        if (_fd_pos != _view_pos && ::lseek(_fd, _view_pos, SEEK_SET) < 0)
+            throwIOException("seek error", errno);
+        _fd_pos = -1;
+        errno = 0;
+        long l = acc_safe_hread(_fd, p, len);
+        if (errno)
+            throwIOException("read error", errno);
+        _view_pos += l;
+        _fd_pos = _view_pos;
+        return (int) l;
+    }
     errno = 0;
     long l = acc_safe_hread(_fd, raw_bytes(buf, len), len);
     if (errno)
@@ -206,17 +238,54 @@ int InputFile::readx(SPAN_P(void) buf, upx_int64_t blen) {
 }
 
 upx_off_t InputFile::seek(upx_off_t off, int whence) {
-    upx_off_t pos = super::seek(off, whence);
+    upx_off_t pos;
+    if (_view_ptr != nullptr) {
+        // same as FileBase::seek(), but only move the view position
+        if (!isOpen())
+            throwIOException("bad seek 1");
+        mem_size_assert(1, off >= 0 ? off : -off); // sanity check
+        if (whence == SEEK_SET) {
+            if (off < 0)
+                throwIOException("bad seek 2");
+            off += _offset;
+        } else if (whence == SEEK_END) {
+            if (off > 0)
+                throwIOException("bad seek 3");
+            off += _offset + _length;
+        } else if (whence == SEEK_CUR) {
+            off += _view_pos;
+        } else
+            throwInternalError("bad seek: whence");
+        if (off < 0)
+            throwIOException("seek error", EINVAL);
+        _view_pos = off;
+        pos = off - _offset;
+    } else
+        pos = super::seek(off, whence);
     if (_length < pos)
         throwIOException("bad seek 4");
     return pos;
 }
 
+upx_off_t InputFile::tell() const {
+    if (_view_ptr == nullptr)
+        return super::tell();
+    if (!isOpen())
+        throwIOException("bad tell");
+    return _view_pos - _offset;
+}
+
 upx_off_t InputFile::st_size_orig() const { return _length_orig; }
 
 int InputFile::dupFd() may_throw {
     if (!isOpen())
         throwIOException("bad dup");
+    // the new fd shares the file position, so sync it with the view position
+    if (_view_ptr != nullptr) {
+        if (::lseek(_fd, _view_pos, SEEK_SET) < 0)
+            throwIOException("seek error", errno);
+        _fd_pos = -1; // the caller may move it
+    }
 #if defined(HAVE_DUP) && (HAVE_DUP + 0 == 0)
     errno = ENOSYS;
     int r = -1;
@@ -228,6 +297,106 @@ int InputFile::dupFd() may_throw {
     return r;
 }
 
+bool InputFile::map() noexcept {
+    if (isMapped())
+        return true;
+#if WITH_MMAP
+    if (!isOpen() || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        !mem_size_valid_bytes(st.st_size))
+        return false;
+    const upx_off_t pos = _view_ptr ? _view_pos : ::lseek(_fd, 0, SEEK_CUR);
+    if (pos < 0)
+        return false;
+    void *p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+    unmap(); // drop the header cache, if any
+    _view_ptr = (const byte *) p;
+    _view_size = st.st_size;
+    _view_pos = pos;
+    _view_is_mmap = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool InputFile::cacheHeader(unsigned len) noexcept {
+    if (_view_ptr != nullptr)
+        return true;
+    if (!isOpen() || !S_ISREG(st.st_mode) || st.st_size <= 0 || len == 0)
+        return false;
+    const upx_off_t pos = ::lseek(_fd, 0, SEEK_CUR);
+    if (pos < 0 || ::lseek(_fd, 0, SEEK_SET) != 0)
+        return false;
+    len = unsigned(UPX_MIN(upx_off_t(len), upx_off_t(st.st_size)));
+    byte *p = (byte *) ::malloc(len);
+    long l = -1;
+    if (p != nullptr) {
+        errno = 0;
+        l = acc_safe_hread(_fd, p, len);
+        if (errno)
+            l = -1;
+    }
+    if (l <= 0) {
+        ::free(p);
+        (void) ::lseek(_fd, pos, SEEK_SET);
+        return false;
+    }
+    _header_cache = p;
+    _view_ptr = p;
+    _view_size = l;
+    _view_pos = pos;
+    _view_is_mmap = false;
+    _fd_pos = l;
+    return true;
+}
+
+void InputFile::unmap() noexcept {
+    if (_view_ptr == nullptr)
+        return;
+    if (isOpen())
+        (void) ::lseek(_fd, _view_pos, SEEK_SET); // hand the position back to the fd
+#if WITH_MMAP
+    if (_view_is_mmap)
+        (void) ::munmap((void *) _view_ptr, size_t(_view_size));
+#endif
+    upx::owner_free(_header_cache);
+    _view_ptr = nullptr;
+    _view_size = 0;
+    _view_pos = 0;
+    _view_is_mmap = false;
+    _fd_pos = -1;
+}
+
+const byte *InputFile::getMappedExtent() const noexcept {
+    if (!isMapped() || _offset < 0 || _length < 0 || _offset + _length > _view_size)
+        return nullptr;
+    return _view_ptr + _offset;
+}
+
+const byte *InputFile::getCachedHeader(unsigned *len) const noexcept {
+    *len = 0;
+    if (_view_ptr == nullptr)
+        return nullptr;
+    *len = unsigned(UPX_MIN(_view_size, upx_off_t(UPX_RSIZE_MAX)));
+    return _view_ptr;
+}
+
+void InputFile::readIntoMemBuffer(MemBuffer &mb, upx_int64_t len) {
+    if (mb.getVoidPtr() == nullptr) {
+        if (isMapped() && len > 0 && _view_pos + len <= _view_size) {
+            upx::PhaseTimer timer(upx::STATS_READ);
+            if (mb.allocMapped(_fd, _view_pos, len)) {
+                _view_pos += len;
+                return;
+            }
+        }
+        mb.alloc(len);
+    }
+    readx(mb, len);
+}
+
 /*************************************************************************
 // OutputFile
 **************************************************************************/
@@ -277,6 +446,7 @@ void OutputFile::write(SPAN_0(const void) buf, upx_int64_t blen) {
     // allow nullptr if blen == 0
     if (blen == 0)
         return;
+    upx::PhaseTimer timer(upx::STATS_WRITE);
     int len = (int) mem_size(1, blen); // sanity check
     errno = 0;
 #if WITH_XSPAN >= 2
@@ -391,4 +561,103 @@ TEST_CASE("file") {
     CHECK(fo.getBytesWritten() == 0);
 }
 
+#if WITH_MMAP
+TEST_CASE("InputFile::map") {
+    InputFile fi;
+    CHECK(!fi.map()); // not open
+    CHECK(fi.getMappedExtent() == nullptr);
+    // character devices, pipes, etc. fall back to the read path
+    fi.open("/dev/null", O_RDONLY | O_BINARY);
+    CHECK(!fi.map());
+    CHECK(!fi.isMapped());
+    MemBuffer mb;
+    CHECK_THROWS(fi.readIntoMemBuffer(mb, 16)); // EOF
+    fi.unmap(); // no-op
+    fi.closex();
+}
+
+TEST_CASE("InputFile::map regular file") {
+    // a temporary file of a bit more than 3 pages of 64 KiB, so that
+    // allocMapped() gets a page-aligned offset on all systems
+    const char *tmpdir = getenv("TMPDIR");
+    char name[ACC_FN_PATH_MAX + 1];
+    upx_safe_snprintf(name, sizeof(name), "%s/upx-test-map-XXXXXX",
+                      (tmpdir && tmpdir[0]) ? tmpdir : "/tmp");
+    const int fd = ::mkstemp(name);
+    REQUIRE(fd >= 0);
+    const unsigned size = 3 * 65536 + 123;
+    MemBuffer data(size);
+    for (unsigned i = 0; i < size; i++)
+        data[i] = (byte) (i * 7 + (i >> 8));
+    const bool written = ::write(fd, raw_bytes(data, size), size) == (ssize_t) size;
+    (void) ::close(fd);
+    if (!written)
+        (void) ::unlink(name);
+    REQUIRE(written);
+
+    InputFile fm, fr; // mapped and plain read path
+    fm.open(name, O_RDONLY | O_BINARY);
+    fr.open(name, O_RDONLY | O_BINARY);
+    CHECK(fm.cacheHeader(64));
+    CHECK(fm.map()); // replaces the header cache
+    CHECK(fm.isMapped());
+    CHECK(!fr.isMapped());
+    CHECK(fm.getMappedExtent() != nullptr);
+
+    // read/seek/tell, including seeks past the old header cache
+    const unsigned offsets[] = {0, 1, 63, 64, 4096 + 7, 65536, size - 10};
+    byte bm[16], br[16];
+    for (unsigned off : offsets) {
+        CHECK(fm.seek(off, SEEK_SET) == off);
+        CHECK(fr.seek(off, SEEK_SET) == off);
+        const int lm = fm.read(bm, sizeof(bm));
+        const int lr = fr.read(br, sizeof(br));
+        CHECK(lm == lr);
+        CHECK(lm == (int) UPX_MIN(16u, size - off));
+        CHECK(memcmp(bm, br, lm) == 0);
+        CHECK(memcmp(bm, data + off, lm) == 0);
+        CHECK(fm.tell() == fr.tell());
+    }
+    CHECK(fm.seek(-20, SEEK_END) == size - 20);
+    CHECK(fm.seek(4, SEEK_CUR) == size - 16);
+    fm.readx(bm, 16);
+    CHECK(memcmp(bm, data + (size - 16), 16) == 0);
+
+    // a page-aligned read references the file, other reads copy
+    {
+        MemBuffer mb;
+        fm.seek(65536, SEEK_SET);
+        fm.readIntoMemBuffer(mb, 65536);
+        CHECK(mb.isMapped());
+        CHECK(fm.tell() == 2 * 65536);
+        CHECK_NOTHROW(mb.checkState()); // no guard bytes around a mapping
+        CHECK(memcmp(mb, data + 65536, 65536) == 0);
+        mb.dealloc(); // munmap()
+        CHECK(!mb.isMapped());
+        fm.seek(100, SEEK_SET);
+        fm.readIntoMemBuffer(mb, 1000);
+        CHECK(!mb.isMapped());
+        CHECK(memcmp(mb, data + 100, 1000) == 0);
+    }
+
+    // dupFd() hands the view position to the new fd
+    fm.seek(12345, SEEK_SET);
+    const int dfd = fm.dupFd();
+    CHECK(::lseek(dfd, 0, SEEK_CUR) == 12345);
+    CHECK(::read(dfd, bm, 16) == 16);
+    CHECK(memcmp(bm, data + 12345, 16) == 0);
+    (void) ::close(dfd);
+    // the mapping does not depend on the fd position
+    fm.readx(br, 16);
+    CHECK(memcmp(br, data + 12345, 16) == 0);
+
+    fm.unmap();
+    CHECK(!fm.isMapped());
+    CHECK(fm.tell() == 12345 + 16); // the fd takes over the position
+    fm.closex();
+    fr.closex();
+    (void) ::unlink(name);
+}
+#endif
+
 /* vim:set ts=4 sw=4 et: */
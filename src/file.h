@@ -44,7 +44,7 @@ public:
     const char *getName() const noexcept { return _name; }
 
     virtual upx_off_t seek(upx_off_t off, int whence);
-    upx_off_t tell() const;
+    virtual upx_off_t tell() const;
     virtual upx_off_t st_size() const; // { return _length; }
     virtual void set_extent(upx_off_t offset, upx_off_t length);
 
@@ -78,6 +78,7 @@ class InputFile final : public FileBase {
 
 public:
     explicit InputFile() noexcept = default;
+    virtual ~InputFile() may_throw override;
 
     void sopen(const char *name, int flags, int shflags);
     void open(const char *name, int flags) { sopen(name, flags, -1); }
@@ -86,12 +87,44 @@ public:
     int readx(SPAN_P(void) buf, upx_int64_t blen);
 
     virtual upx_off_t seek(upx_off_t off, int whence) override;
+    virtual upx_off_t tell() const override;
     upx_off_t st_size_orig() const;
 
     noinline int dupFd() may_throw;
 
+    // Optional read-only mapping of the whole file. Only works for regular
+    // files; returns false (and nothing changes) for pipes, stdin, etc.
+    // While mapped, read()/seek()/tell() are served from the mapping.
+    bool map() noexcept;
+    bool isMapped() const noexcept { return _view_ptr != nullptr && _view_is_mmap; }
+    // the current extent [0, st_size()) of the mapping, or nullptr if not mapped
+    const byte *getMappedExtent() const noexcept;
+
+    // Keep a copy of the first "len" bytes of the file. Reads that are fully
+    // inside the cache and all seeks then don't need a system call; this is
+    // used when probing the file header with many different packers.
+    bool cacheHeader(unsigned len) noexcept;
+    // the start of the file (ignoring any extent) from the mapping or the
+    // header cache, or nullptr if neither is active
+    const byte *getCachedHeader(unsigned *len) const noexcept;
+
+    // drop the mapping or header cache and go back to plain fd reads
+    void unmap() noexcept;
+
+    // read "len" bytes at the current position into "mb", allocating it if needed;
+    // if mapped then a fresh "mb" references the file instead of holding a copy
+    void readIntoMemBuffer(MemBuffer &mb, upx_int64_t len) may_throw;
+
 protected:
     upx_off_t _length_orig = 0;
+    // while _view_ptr is set, the file position is _view_pos and not the
+    // position of _fd; _fd_pos caches the latter (or -1 if unknown)
+    const byte *_view_ptr = nullptr; // mmap()ed file or _header_cache
+    upx_off_t _view_size = 0;
+    upx_off_t _view_pos = 0;
+    upx_off_t _fd_pos = -1;
+    bool _view_is_mmap = false;
+    OwningPointer(byte) _header_cache = nullptr;
 };
 
 /*************************************************************************
@@ -28,6 +28,7 @@
 #include "conf.h"
 #include "filter.h"
 #include "file.h"
+#include "util/stats.h"
 
 /*************************************************************************
 // util
@@ -105,8 +106,14 @@ void Filter::init(int id_, unsigned addvalue_) noexcept {
 }
 
 bool Filter::filter(SPAN_0(byte) xbuf, unsigned buf_len_) {
+    upx::PhaseTimer timer(upx::STATS_FILTER);
     byte *const buf_ = raw_bytes(xbuf, buf_len_);
     initFilter(this, buf_, buf_len_);
+    FilterUndoLog *const ul = this->undo_log;
+    if (ul) {
+        ul->count = 0;
+        ul->complete = false;
+    }
 
     const FilterImpl::FilterEntry *const fe = FilterImpl::getFilter(id);
     if (fe == nullptr)
@@ -122,13 +129,38 @@ bool Filter::filter(SPAN_0(byte) xbuf, unsigned buf_len_) {
 
     // save checksum
     this->adler = 0;
-    if (clevel != 1)
-        this->adler = upx_adler32(this->buf, this->buf_len);
+    if (clevel != 1) {
+        if (ul && ul->adler_buf == this->buf && ul->adler_len == this->buf_len)
+            this->adler = ul->adler;
+        else {
+            this->adler = upx_adler32(this->buf, this->buf_len);
+            if (ul) {
+                ul->adler_buf = this->buf;
+                ul->adler_len = this->buf_len;
+                ul->adler = this->adler;
+            }
+        }
+    }
+
+    // prepare the undo log; a CTO filter changes at most every 5th byte,
+    // but typical code has far fewer calls, so just fall back on overflow
+    if (ul) {
+        const unsigned capacity = this->buf_len / 16 + 64;
+        if (ul->capacity < capacity) {
+            ul->entries.dealloc();
+            ul->entries.alloc(8ull * capacity);
+            ul->capacity = capacity;
+        }
+        ul->buf = this->buf;
+        ul->recording = true;
+    }
 
     NO_printf("filter: %02x %p %d\n", this->id, this->buf, this->buf_len);
     // OutputFile::dump("filter.dat", buf, buf_len);
     int r = (*fe->do_filter)(this);
     NO_printf("filter: %02x %d\n", fe->id, r);
+    if (ul)
+        ul->recording = false;
     if (r > 0)
         throwFilterException();
     if (r == 0)
@@ -137,6 +169,7 @@ bool Filter::filter(SPAN_0(byte) xbuf, unsigned buf_len_) {
 }
 
 void Filter::unfilter(SPAN_0(byte) xbuf, unsigned buf_len_, bool verify_checksum) {
+    upx::PhaseTimer timer(upx::STATS_FILTER);
     byte *const buf_ = raw_bytes(xbuf, buf_len_);
     initFilter(this, buf_, buf_len_);
 
@@ -166,6 +199,24 @@ void Filter::unfilter(SPAN_0(byte) xbuf, unsigned buf_len_, bool verify_checksum
     }
 }
 
+void Filter::undo() {
+    FilterUndoLog *const ul = this->undo_log;
+    if (ul == nullptr || !ul->complete || ul->buf != this->buf) {
+        unfilter(this->buf, this->buf_len, true);
+        return;
+    }
+    // restore the original bytes in reverse order
+    const byte *const entries = ul->entries.raw_ptr();
+    for (unsigned i = ul->count; i-- > 0;) {
+        const byte *const e = entries + 8 * i;
+        const unsigned off = get_ne32(e);
+        assert(off + ul->width <= this->buf_len);
+        memcpy(this->buf + off, e + 4, ul->width);
+    }
+    ul->count = 0;
+    ul->complete = false;
+}
+
 void Filter::verifyUnfilter() {
     // Note:
     //   This verify is just because of complete paranoia that there
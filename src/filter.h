@@ -26,6 +26,9 @@
  */
 
 #pragma once
+#include "util/membuffer.h"
+
+class FilterUndoLog;
 
 /*************************************************************************
 // A filter is a reversible operation that modifies a given
@@ -53,6 +56,9 @@ public:
     void unfilter(SPAN_0(byte) buf, unsigned buf_len, bool verify_checksum = false);
     void verifyUnfilter();
     bool scan(SPAN_0(const byte) buf, unsigned buf_len);
+    // restore the buffer after a successful filter(); uses the undo_log
+    // if possible, else does a verified unfilter()
+    void undo();
 
     static bool isValidFilter(int filter_id);
     static bool isValidFilter(int filter_id, const int *allowed_filters);
@@ -85,10 +91,64 @@ public:
     // Read only.
     int id;
 
+    // Optional, see FilterUndoLog below.
+    FilterUndoLog *undo_log = nullptr;
+
 private:
     int clevel; // compression level
 };
 
+/*************************************************************************
+// FilterUndoLog records the original bytes of all changes done by
+// Filter::filter(), so that Filter::undo() can restore the buffer
+// without another pass over it. It also remembers the adler32 of the
+// unfiltered buffer, which is the same for all filters tried on it.
+//
+// Only filters that call start() support this; for all other filters
+// (and if the log overflows) undo() falls back to a verified unfilter().
+**************************************************************************/
+
+class FilterUndoLog final {
+public:
+    explicit FilterUndoLog() noexcept {}
+
+    // forget the cached adler32, e.g. after the buffer was modified
+    void reset() noexcept { adler_buf = nullptr; }
+
+    // called by the filter implementations
+    forceinline void start(unsigned width_) noexcept {
+        if (recording) {
+            width = width_;
+            complete = true;
+        }
+    }
+    forceinline void save(const byte *p) noexcept {
+        if (!recording)
+            return;
+        if very_unlikely (count >= capacity) {
+            complete = recording = false; // overflow
+            return;
+        }
+        byte *e = entries.raw_ptr() + 8 * count++;
+        set_ne32(e, (unsigned) (p - buf));
+        memcpy(e + 4, p, width);
+    }
+
+private:
+    friend class Filter;
+    MemBuffer entries; // 8 bytes per entry: offset and original bytes
+    unsigned capacity = 0;
+    unsigned count = 0;
+    unsigned width = 0;
+    bool recording = false;
+    bool complete = false;
+    const byte *buf = nullptr;
+    // cached adler32 of the unfiltered buffer
+    const byte *adler_buf = nullptr;
+    unsigned adler_len = 0;
+    unsigned adler = 0;
+};
+
 /*************************************************************************
 // We don't want a full OO interface here because of
 // certain implementation speed reasons.
@@ -29,126 +29,145 @@
 // 16-bit calltrick ("naive")
 **************************************************************************/
 
-#define CT16(f, cond, addvalue, get, set)                                                          \
+#define CT16(f, kind, cond, addvalue, get, set)                                                    \
     byte *b = f->buf;                                                                              \
     byte *b_end = b + f->buf_len - 3;                                                              \
+    const unsigned end = (unsigned) (b_end - f->buf);                                              \
+    FilterUndoLog *const ul = f->undo_log;                                                         \
+    if (ul)                                                                                        \
+        ul->start(2);                                                                              \
     do {                                                                                           \
         if (cond) {                                                                                \
             b += 1;                                                                                \
             unsigned a = (unsigned) (b - f->buf);                                                  \
             f->lastcall = a;                                                                       \
+            if (ul)                                                                                \
+                ul->save(b);                                                                       \
             set(b, get(b) + (addvalue));                                                           \
             f->calls++;                                                                            \
             b += 2 - 1;                                                                            \
         }                                                                                          \
-    } while (++b < b_end);                                                                         \
+        b = f->buf + filter_find(kind, f->buf, (unsigned) (b + 1 - f->buf), end);                  \
+    } while (b < b_end);                                                                           \
     if (f->lastcall)                                                                               \
         f->lastcall += 2;                                                                          \
     return 0;
 
 // filter: e8, e9, e8e9
-static int f_ct16_e8(Filter *f) { CT16(f, (*b == 0xe8), a + f->addvalue, get_le16, set_le16) }
+static int f_ct16_e8(Filter *f) {
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_le16, set_le16)
+}
 
-static int f_ct16_e9(Filter *f) { CT16(f, (*b == 0xe9), a + f->addvalue, get_le16, set_le16) }
+static int f_ct16_e9(Filter *f) {
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_le16, set_le16)
+}
 
 static int f_ct16_e8e9(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le16, set_le16)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le16, set_le16)
 }
 
 // unfilter: e8, e9, e8e9
-static int u_ct16_e8(Filter *f) { CT16(f, (*b == 0xe8), 0 - a - f->addvalue, get_le16, set_le16) }
+static int u_ct16_e8(Filter *f) {
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), 0 - a - f->addvalue, get_le16, set_le16)
+}
 
-static int u_ct16_e9(Filter *f) { CT16(f, (*b == 0xe9), 0 - a - f->addvalue, get_le16, set_le16) }
+static int u_ct16_e9(Filter *f) {
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), 0 - a - f->addvalue, get_le16, set_le16)
+}
 
 static int u_ct16_e8e9(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_le16, set_le16)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_le16, set_le16)
 }
 
 // scan: e8, e9, e8e9
-static int s_ct16_e8(Filter *f) { CT16(f, (*b == 0xe8), a + f->addvalue, get_le16, set_dummy) }
+static int s_ct16_e8(Filter *f) {
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_le16, set_dummy)
+}
 
-static int s_ct16_e9(Filter *f) { CT16(f, (*b == 0xe9), a + f->addvalue, get_le16, set_dummy) }
+static int s_ct16_e9(Filter *f) {
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_le16, set_dummy)
+}
 
 static int s_ct16_e8e9(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le16, set_dummy)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le16, set_dummy)
 }
 
 // filter: e8, e9, e8e9 with bswap le->be
 static int f_ct16_e8_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe8), a + f->addvalue, get_le16, set_be16)
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_le16, set_be16)
 }
 
 static int f_ct16_e9_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe9), a + f->addvalue, get_le16, set_be16)
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_le16, set_be16)
 }
 
 static int f_ct16_e8e9_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le16, set_be16)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le16, set_be16)
 }
 
 // unfilter: e8, e9, e8e9 with bswap le->be
 static int u_ct16_e8_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe8), 0 - a - f->addvalue, get_be16, set_le16)
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), 0 - a - f->addvalue, get_be16, set_le16)
 }
 
 static int u_ct16_e9_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe9), 0 - a - f->addvalue, get_be16, set_le16)
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), 0 - a - f->addvalue, get_be16, set_le16)
 }
 
 static int u_ct16_e8e9_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_be16, set_le16)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_be16, set_le16)
 }
 
 // scan: e8, e9, e8e9 with bswap le->be
 static int s_ct16_e8_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe8), a + f->addvalue, get_be16, set_dummy)
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_be16, set_dummy)
 }
 
 static int s_ct16_e9_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe9), a + f->addvalue, get_be16, set_dummy)
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_be16, set_dummy)
 }
 
 static int s_ct16_e8e9_bswap_le(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_be16, set_dummy)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_be16, set_dummy)
 }
 
 // filter: e8, e9, e8e9 with bswap be->le
 static int f_ct16_e8_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe8), a + f->addvalue, get_be16, set_le16)
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_be16, set_le16)
 }
 
 static int f_ct16_e9_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe9), a + f->addvalue, get_be16, set_le16)
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_be16, set_le16)
 }
 
 static int f_ct16_e8e9_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_be16, set_le16)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_be16, set_le16)
 }
 
 // unfilter: e8, e9, e8e9 with bswap be->le
 static int u_ct16_e8_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe8), 0 - a - f->addvalue, get_le16, set_be16)
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), 0 - a - f->addvalue, get_le16, set_be16)
 }
 
 static int u_ct16_e9_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe9), 0 - a - f->addvalue, get_le16, set_be16)
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), 0 - a - f->addvalue, get_le16, set_be16)
 }
 
 static int u_ct16_e8e9_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_le16, set_be16)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_le16, set_be16)
 }
 
 // scan: e8, e9, e8e9 with bswap be->le
 static int s_ct16_e8_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe8), a + f->addvalue, get_le16, set_dummy)
+    CT16(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_le16, set_dummy)
 }
 
 static int s_ct16_e9_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe9), a + f->addvalue, get_le16, set_dummy)
+    CT16(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_le16, set_dummy)
 }
 
 static int s_ct16_e8e9_bswap_be(Filter *f) {
-    CT16(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le16, set_dummy)
+    CT16(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le16, set_dummy)
 }
 
 #undef CT16
@@ -157,126 +176,145 @@ static int s_ct16_e8e9_bswap_be(Filter *f) {
 // 32-bit calltrick ("naive")
 **************************************************************************/
 
-#define CT32(f, cond, addvalue, get, set)                                                          \
+#define CT32(f, kind, cond, addvalue, get, set)                                                    \
     byte *b = f->buf;                                                                              \
     byte *b_end = b + f->buf_len - 5;                                                              \
+    const unsigned end = (unsigned) (b_end - f->buf);                                              \
+    FilterUndoLog *const ul = f->undo_log;                                                         \
+    if (ul)                                                                                        \
+        ul->start(4);                                                                              \
     do {                                                                                           \
         if (cond) {                                                                                \
             b += 1;                                                                                \
             unsigned a = (unsigned) (b - f->buf);                                                  \
             f->lastcall = a;                                                                       \
+            if (ul)                                                                                \
+                ul->save(b);                                                                       \
             set(b, get(b) + (addvalue));                                                           \
             f->calls++;                                                                            \
             b += 4 - 1;                                                                            \
         }                                                                                          \
-    } while (++b < b_end);                                                                         \
+        b = f->buf + filter_find(kind, f->buf, (unsigned) (b + 1 - f->buf), end);                  \
+    } while (b < b_end);                                                                           \
     if (f->lastcall)                                                                               \
         f->lastcall += 4;                                                                          \
     return 0;
 
 // filter: e8, e9, e8e9
-static int f_ct32_e8(Filter *f) { CT32(f, (*b == 0xe8), a + f->addvalue, get_le32, set_le32) }
+static int f_ct32_e8(Filter *f) {
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_le32, set_le32)
+}
 
-static int f_ct32_e9(Filter *f) { CT32(f, (*b == 0xe9), a + f->addvalue, get_le32, set_le32) }
+static int f_ct32_e9(Filter *f) {
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_le32, set_le32)
+}
 
 static int f_ct32_e8e9(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le32, set_le32)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le32, set_le32)
 }
 
 // unfilter: e8, e9, e8e9
-static int u_ct32_e8(Filter *f) { CT32(f, (*b == 0xe8), 0 - a - f->addvalue, get_le32, set_le32) }
+static int u_ct32_e8(Filter *f) {
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), 0 - a - f->addvalue, get_le32, set_le32)
+}
 
-static int u_ct32_e9(Filter *f) { CT32(f, (*b == 0xe9), 0 - a - f->addvalue, get_le32, set_le32) }
+static int u_ct32_e9(Filter *f) {
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), 0 - a - f->addvalue, get_le32, set_le32)
+}
 
 static int u_ct32_e8e9(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_le32, set_le32)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_le32, set_le32)
 }
 
 // scan: e8, e9, e8e9
-static int s_ct32_e8(Filter *f) { CT32(f, (*b == 0xe8), a + f->addvalue, get_le32, set_dummy) }
+static int s_ct32_e8(Filter *f) {
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_le32, set_dummy)
+}
 
-static int s_ct32_e9(Filter *f) { CT32(f, (*b == 0xe9), a + f->addvalue, get_le32, set_dummy) }
+static int s_ct32_e9(Filter *f) {
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_le32, set_dummy)
+}
 
 static int s_ct32_e8e9(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le32, set_dummy)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le32, set_dummy)
 }
 
 // filter: e8, e9, e8e9 with bswap le->be
 static int f_ct32_e8_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe8), a + f->addvalue, get_le32, set_be32)
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_le32, set_be32)
 }
 
 static int f_ct32_e9_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe9), a + f->addvalue, get_le32, set_be32)
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_le32, set_be32)
 }
 
 static int f_ct32_e8e9_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le32, set_be32)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le32, set_be32)
 }
 
 // unfilter: e8, e9, e8e9 with bswap le->be
 static int u_ct32_e8_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe8), 0 - a - f->addvalue, get_be32, set_le32)
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), 0 - a - f->addvalue, get_be32, set_le32)
 }
 
 static int u_ct32_e9_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe9), 0 - a - f->addvalue, get_be32, set_le32)
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), 0 - a - f->addvalue, get_be32, set_le32)
 }
 
 static int u_ct32_e8e9_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_be32, set_le32)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_be32, set_le32)
 }
 
 // scan: e8, e9, e8e9 with bswap le->be
 static int s_ct32_e8_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe8), a + f->addvalue, get_be32, set_dummy)
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_be32, set_dummy)
 }
 
 static int s_ct32_e9_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe9), a + f->addvalue, get_be32, set_dummy)
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_be32, set_dummy)
 }
 
 static int s_ct32_e8e9_bswap_le(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_be32, set_dummy)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_be32, set_dummy)
 }
 
 // filter: e8, e9, e8e9 with bswap be->le
 static int f_ct32_e8_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe8), a + f->addvalue, get_be32, set_le32)
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_be32, set_le32)
 }
 
 static int f_ct32_e9_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe9), a + f->addvalue, get_be32, set_le32)
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_be32, set_le32)
 }
 
 static int f_ct32_e8e9_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_be32, set_le32)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_be32, set_le32)
 }
 
 // unfilter: e8, e9, e8e9 with bswap be->le
 static int u_ct32_e8_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe8), 0 - a - f->addvalue, get_le32, set_be32)
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), 0 - a - f->addvalue, get_le32, set_be32)
 }
 
 static int u_ct32_e9_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe9), 0 - a - f->addvalue, get_le32, set_be32)
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), 0 - a - f->addvalue, get_le32, set_be32)
 }
 
 static int u_ct32_e8e9_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_le32, set_be32)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), 0 - a - f->addvalue, get_le32, set_be32)
 }
 
 // scan: e8, e9, e8e9 with bswap be->le
 static int s_ct32_e8_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe8), a + f->addvalue, get_le32, set_dummy)
+    CT32(f, FILTER_FIND_E8, (*b == 0xe8), a + f->addvalue, get_le32, set_dummy)
 }
 
 static int s_ct32_e9_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe9), a + f->addvalue, get_le32, set_dummy)
+    CT32(f, FILTER_FIND_E9, (*b == 0xe9), a + f->addvalue, get_le32, set_dummy)
 }
 
 static int s_ct32_e8e9_bswap_be(Filter *f) {
-    CT32(f, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le32, set_dummy)
+    CT32(f, FILTER_FIND_E8E9, (*b == 0xe8 || *b == 0xe9), a + f->addvalue, get_le32, set_dummy)
 }
 
 #undef CT32
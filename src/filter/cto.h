@@ -54,7 +54,7 @@ static int F(Filter *f) {
         // So, a call to a destination that is outside the buffer
         // must not conflict with the mark.
         // Note that unsigned comparison checks both edges of buffer.
-        for (ic = 0; ic < size - 5; ic++) {
+        for (ic = 0; (ic = filter_find(FIND, b, ic, size - 5)) < size - 5; ic++) {
             if (!COND(b, ic))
                 continue;
             jc = get_le32(b + ic + 1) + ic + 1;
@@ -71,9 +71,12 @@ static int F(Filter *f) {
     const unsigned char cto8 = f->cto;
 #ifdef U
     const unsigned cto = (unsigned) f->cto << 24;
+    FilterUndoLog *const ul = f->undo_log;
+    if (ul)
+        ul->start(4);
 #endif
 
-    for (ic = 0; ic < size - 5; ic++) {
+    for (ic = 0; (ic = filter_find(FIND, b, ic, size - 5)) < size - 5; ic++) {
         if (!COND(b, ic))
             continue;
         jc = get_le32(b + ic + 1) + ic + 1;
@@ -81,6 +84,8 @@ static int F(Filter *f) {
         if (jc < size) {
             assert(jc + addvalue < (1u << 24)); // hi 8 bits won't be cto8
 #ifdef U
+            if (ul)
+                ul->save(b + ic + 1);
             set_be32(b + ic + 1, jc + addvalue + cto);
 #endif
             if (ic - lastnoncall < 5) {
@@ -134,7 +139,7 @@ static int U(Filter *f) {
 
     unsigned ic, jc;
 
-    for (ic = 0; ic < size5; ic++)
+    for (ic = 0; (ic = filter_find(FIND, b, ic, size5)) < size5; ic++)
         if (COND(b, ic)) {
             jc = get_be32(b + ic + 1);
             if (b[ic + 1] == f->cto) {
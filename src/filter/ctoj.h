@@ -53,7 +53,7 @@ static int F(Filter *f) {
         unsigned char buf[256];
         memset(buf, 0, 256);
 
-        for (ic = 0; ic < size - 5; ic++) {
+        for (ic = 0; (ic = filter_find(FIND, b, ic, size - 5)) < size - 5; ic++) {
             if (!COND(b, ic, lastcall))
                 continue;
             jc = get_le32(b + ic + 1) + ic + 1;
@@ -70,9 +70,12 @@ static int F(Filter *f) {
     const unsigned char cto8 = f->cto;
 #ifdef U
     const unsigned cto = (unsigned) f->cto << 24;
+    FilterUndoLog *const ul = f->undo_log;
+    if (ul)
+        ul->start(4);
 #endif
 
-    for (ic = 0; ic < size - 5; ic++) {
+    for (ic = 0; (ic = filter_find(FIND, b, ic, size - 5)) < size - 5; ic++) {
         if (!COND(b, ic, lastcall))
             continue;
         jc = get_le32(b + ic + 1) + ic + 1;
@@ -80,6 +83,8 @@ static int F(Filter *f) {
         if (jc < size) {
             assert(jc + addvalue < (1u << 24)); // hi 8 bits won't be cto8
 #ifdef U
+            if (ul)
+                ul->save(b + ic + 1);
             set_be32(b + ic + 1, jc + addvalue + cto);
 #endif
             if (ic - lastnoncall < 5) {
@@ -133,7 +138,7 @@ static int U(Filter *f) {
     //    unsigned lastcall = 0;    // lastcall is not used in COND macro
     unsigned ic, jc;
 
-    for (ic = 0; ic < size5; ic++)
+    for (ic = 0; (ic = filter_find(FIND, b, ic, size5)) < size5; ic++)
         if (COND(b, ic, lastcall)) {
             jc = get_be32(b + ic + 1);
             if (b[ic + 1] == f->cto) {
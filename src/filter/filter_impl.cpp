@@ -27,6 +27,7 @@
 
 #include "../conf.h"
 #include "../filter.h"
+#include "filter_simd.h"
 
 #define set_dummy(p, v) ((void) 0)
 #define get_8(p)        (*(p))
@@ -55,27 +56,33 @@
 **************************************************************************/
 
 #define COND(b, x) (b[x] == 0xe8)
+#define FIND       FILTER_FIND_E8
 #define F          f_cto32_e8_bswap_le
 #define U          u_cto32_e8_bswap_le
 #include "cto.h"
 #define F s_cto32_e8_bswap_le
 #include "cto.h"
+#undef FIND
 #undef COND
 
 #define COND(b, x) (b[x] == 0xe9)
+#define FIND       FILTER_FIND_E9
 #define F          f_cto32_e9_bswap_le
 #define U          u_cto32_e9_bswap_le
 #include "cto.h"
 #define F s_cto32_e9_bswap_le
 #include "cto.h"
+#undef FIND
 #undef COND
 
 #define COND(b, x) (b[x] == 0xe8 || b[x] == 0xe9)
+#define FIND       FILTER_FIND_E8E9
 #define F          f_cto32_e8e9_bswap_le
 #define U          u_cto32_e8e9_bswap_le
 #include "cto.h"
 #define F s_cto32_e8e9_bswap_le
 #include "cto.h"
+#undef FIND
 #undef COND
 
 /*************************************************************************
@@ -83,11 +90,13 @@
 **************************************************************************/
 
 #define COND(b, x, lastcall) (b[x] == 0xe8 || b[x] == 0xe9)
+#define FIND                 FILTER_FIND_E8E9
 #define F                    f_ctoj32_e8e9_bswap_le
 #define U                    u_ctoj32_e8e9_bswap_le
 #include "ctoj.h"
 #define F s_ctoj32_e8e9_bswap_le
 #include "ctoj.h"
+#undef FIND
 #undef COND
 
 /*************************************************************************
@@ -97,11 +106,13 @@
 #define COND1(b, x)        (b[x] == 0xe8 || b[x] == 0xe9)
 #define COND2(b, x, lc)    (lc != (x) && 0xf == b[(x) -1] && 0x80 <= b[x] && b[x] <= 0x8f)
 #define COND(b, x, lc, id) (COND1(b, x) || ((9 <= (0xf & (id))) && COND2(b, x, lc)))
+#define FIND               ((9 <= (0xf & id)) ? FILTER_FIND_E8E9_JCC : FILTER_FIND_E8E9)
 #define F                  f_ctok32_e8e9_bswap_le
 #define U                  u_ctok32_e8e9_bswap_le
 #include "ctok.h"
 #define F s_ctok32_e8e9_bswap_le
 #include "ctok.h"
+#undef FIND
 #undef COND
 #undef COND2
 #undef COND1
@@ -0,0 +1,314 @@
+/* filter_simd.cpp -- SIMD helpers for the filters
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   Copyright (C) 1996-2024 Laszlo Molnar
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer              Laszlo Molnar
+   <markus@oberhumer.com>               <ezerotven+github@gmail.com>
+ */
+
+#include "../conf.h"
+#include "../util/simd.h"
+#include "filter_simd.h"
+#if WITH_SIMD
+#include <immintrin.h>
+#endif
+
+/*************************************************************************
+// filter_find
+**************************************************************************/
+
+namespace {
+
+template <unsigned Kind>
+forceinline bool find_match(unsigned x) noexcept {
+    if (Kind == FILTER_FIND_E8)
+        return x == 0xe8;
+    if (Kind == FILTER_FIND_E9)
+        return x == 0xe9;
+    if (Kind == FILTER_FIND_E8E9)
+        return (x & 0xfe) == 0xe8;
+    return (x & 0xfe) == 0xe8 || (x & 0xf0) == 0x80; // FILTER_FIND_E8E9_JCC
+}
+
+template <unsigned Kind>
+unsigned find_scalar(const byte *b, unsigned ic, unsigned end) noexcept {
+    for (; ic < end; ic++)
+        if (find_match<Kind>(b[ic]))
+            return ic;
+    return end;
+}
+
+#if WITH_SIMD
+
+forceinline unsigned find_ctz(unsigned mask) noexcept {
+#if (ACC_CC_MSC)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return unsigned(index);
+#else
+    return unsigned(__builtin_ctz(mask));
+#endif
+}
+
+template <unsigned Kind>
+upx_simd_target("sse2") unsigned find_sse2(const byte *b, unsigned ic, unsigned end) noexcept {
+    const __m128i v_e8 = _mm_set1_epi8(char(0xe8));
+    const __m128i v_e9 = _mm_set1_epi8(char(0xe9));
+    const __m128i v_fe = _mm_set1_epi8(char(0xfe));
+    const __m128i v_f0 = _mm_set1_epi8(char(0xf0));
+    const __m128i v_80 = _mm_set1_epi8(char(0x80));
+    for (; end - ic >= 16; ic += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (b + ic));
+        __m128i m;
+        if (Kind == FILTER_FIND_E8)
+            m = _mm_cmpeq_epi8(v, v_e8);
+        else if (Kind == FILTER_FIND_E9)
+            m = _mm_cmpeq_epi8(v, v_e9);
+        else if (Kind == FILTER_FIND_E8E9)
+            m = _mm_cmpeq_epi8(_mm_and_si128(v, v_fe), v_e8);
+        else
+            m = _mm_or_si128(_mm_cmpeq_epi8(_mm_and_si128(v, v_fe), v_e8),
+                             _mm_cmpeq_epi8(_mm_and_si128(v, v_f0), v_80));
+        const unsigned mask = unsigned(_mm_movemask_epi8(m));
+        if (mask != 0)
+            return ic + find_ctz(mask);
+    }
+    return find_scalar<Kind>(b, ic, end);
+}
+
+template <unsigned Kind>
+upx_simd_target("avx2") unsigned find_avx2(const byte *b, unsigned ic, unsigned end) noexcept {
+    const __m256i v_e8 = _mm256_set1_epi8(char(0xe8));
+    const __m256i v_e9 = _mm256_set1_epi8(char(0xe9));
+    const __m256i v_fe = _mm256_set1_epi8(char(0xfe));
+    const __m256i v_f0 = _mm256_set1_epi8(char(0xf0));
+    const __m256i v_80 = _mm256_set1_epi8(char(0x80));
+    for (; end - ic >= 32; ic += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (b + ic));
+        __m256i m;
+        if (Kind == FILTER_FIND_E8)
+            m = _mm256_cmpeq_epi8(v, v_e8);
+        else if (Kind == FILTER_FIND_E9)
+            m = _mm256_cmpeq_epi8(v, v_e9);
+        else if (Kind == FILTER_FIND_E8E9)
+            m = _mm256_cmpeq_epi8(_mm256_and_si256(v, v_fe), v_e8);
+        else
+            m = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_and_si256(v, v_fe), v_e8),
+                                _mm256_cmpeq_epi8(_mm256_and_si256(v, v_f0), v_80));
+        const unsigned mask = unsigned(_mm256_movemask_epi8(m));
+        if (mask != 0)
+            return ic + find_ctz(mask);
+    }
+    return find_sse2<Kind>(b, ic, end);
+}
+
+#endif // WITH_SIMD
+
+template <unsigned Kind>
+forceinline unsigned find_dispatch(int level, const byte *b, unsigned ic, unsigned end) noexcept {
+    // the next opcode is often very close, so check a few bytes first
+    for (unsigned n = 0; n < 4 && ic < end; n++, ic++)
+        if (find_match<Kind>(b[ic]))
+            return ic;
+#if WITH_SIMD
+    if (level >= upx::SIMD_AVX2)
+        return find_avx2<Kind>(b, ic, end);
+    if (level >= upx::SIMD_SSE2)
+        return find_sse2<Kind>(b, ic, end);
+#endif
+    UNUSED(level);
+    return find_scalar<Kind>(b, ic, end);
+}
+
+} // namespace
+
+unsigned filter_find(unsigned kind, const byte *b, unsigned ic, unsigned end) noexcept {
+    if (ic >= end)
+        return end;
+    const int level = upx::simd_get_level();
+    switch (kind) {
+    case FILTER_FIND_E8:
+        return find_dispatch<FILTER_FIND_E8>(level, b, ic, end);
+    case FILTER_FIND_E9:
+        return find_dispatch<FILTER_FIND_E9>(level, b, ic, end);
+    case FILTER_FIND_E8E9:
+        return find_dispatch<FILTER_FIND_E8E9>(level, b, ic, end);
+    default:
+        return find_dispatch<FILTER_FIND_E8E9_JCC>(level, b, ic, end);
+    }
+}
+
+/*************************************************************************
+// filter_sub_simd
+//
+// SUB: y[k] = x[k] - x[k-N], which has no dependencies at all; run it
+// backwards so that the in-place stores never clobber x[k-N].
+// ADD: x[k] = y[k] + x[k-N], a prefix sum with stride N; inside a vector
+// this is done in log2 steps by shifting and adding, and the carry from
+// the previous vector is its last N elements repeated across the vector.
+**************************************************************************/
+
+namespace {
+
+#if WITH_SIMD && (ACC_ABI_LITTLE_ENDIAN)
+
+template <unsigned Size>
+forceinline __m128i sub_add128(__m128i a, __m128i b) noexcept {
+    return Size == 1 ? _mm_add_epi8(a, b) : Size == 2 ? _mm_add_epi16(a, b) : _mm_add_epi32(a, b);
+}
+template <unsigned Size>
+forceinline __m128i sub_sub128(__m128i a, __m128i b) noexcept {
+    return Size == 1 ? _mm_sub_epi8(a, b) : Size == 2 ? _mm_sub_epi16(a, b) : _mm_sub_epi32(a, b);
+}
+
+// scalar helpers for the remaining elements
+template <unsigned Size>
+forceinline unsigned sub_get(const byte *p) noexcept {
+    return Size == 1 ? *p : Size == 2 ? get_le16(p) : get_le32(p);
+}
+template <unsigned Size>
+forceinline void sub_set(byte *p, unsigned v) noexcept {
+    if (Size == 1)
+        *p = byte(v);
+    else if (Size == 2)
+        set_le16(p, v);
+    else
+        set_le32(p, v);
+}
+
+template <unsigned N, unsigned Size>
+upx_simd_target("sse2") void sub_sse2(byte *b, unsigned n) noexcept {
+    constexpr unsigned V = 16 / Size; // elements per vector
+    unsigned k = n;
+    for (; k >= N + V; k -= V) {
+        byte *const p = b + (k - V) * Size;
+        const __m128i x = _mm_loadu_si128((const __m128i *) p);
+        const __m128i y = _mm_loadu_si128((const __m128i *) (p - N * Size));
+        _mm_storeu_si128((__m128i *) p, sub_sub128<Size>(x, y));
+    }
+    for (; k > N; k--) {
+        byte *const p = b + (k - 1) * Size;
+        sub_set<Size>(p, sub_get<Size>(p) - sub_get<Size>(p - N * Size));
+    }
+}
+
+template <unsigned N, unsigned Size>
+upx_simd_target("avx2") void sub_avx2(byte *b, unsigned n) noexcept {
+    constexpr unsigned V = 32 / Size;
+    unsigned k = n;
+    for (; k >= N + V; k -= V) {
+        byte *const p = b + (k - V) * Size;
+        const __m256i x = _mm256_loadu_si256((const __m256i *) p);
+        const __m256i y = _mm256_loadu_si256((const __m256i *) (p - N * Size));
+        __m256i d;
+        if (Size == 1)
+            d = _mm256_sub_epi8(x, y);
+        else if (Size == 2)
+            d = _mm256_sub_epi16(x, y);
+        else
+            d = _mm256_sub_epi32(x, y);
+        _mm256_storeu_si256((__m256i *) p, d);
+    }
+    sub_sse2<N, Size>(b, k);
+}
+
+template <unsigned N, unsigned Size>
+upx_simd_target("sse2") void add_sse2(byte *b, unsigned n) noexcept {
+    constexpr unsigned V = 16 / Size;
+    constexpr unsigned S = N * Size; // stride in bytes
+    __m128i prev = _mm_setzero_si128();
+    unsigned k = 0;
+    for (; n - k >= V; k += V) {
+        byte *const p = b + k * Size;
+        __m128i x = _mm_loadu_si128((const __m128i *) p);
+        // prefix sum with stride N inside the vector
+        if (S < 16)
+            x = sub_add128<Size>(x, _mm_slli_si128(x, S & 15));
+        if (2 * S < 16)
+            x = sub_add128<Size>(x, _mm_slli_si128(x, (2 * S) & 15));
+        if (4 * S < 16)
+            x = sub_add128<Size>(x, _mm_slli_si128(x, (4 * S) & 15));
+        if (8 * S < 16)
+            x = sub_add128<Size>(x, _mm_slli_si128(x, (8 * S) & 15));
+        // carry: the last N elements of "prev", repeated
+        __m128i c = _mm_srli_si128(prev, (16 - S) & 15);
+        if (S < 16)
+            c = _mm_or_si128(c, _mm_slli_si128(c, S & 15));
+        if (2 * S < 16)
+            c = _mm_or_si128(c, _mm_slli_si128(c, (2 * S) & 15));
+        if (4 * S < 16)
+            c = _mm_or_si128(c, _mm_slli_si128(c, (4 * S) & 15));
+        if (8 * S < 16)
+            c = _mm_or_si128(c, _mm_slli_si128(c, (8 * S) & 15));
+        prev = sub_add128<Size>(x, c);
+        _mm_storeu_si128((__m128i *) p, prev);
+    }
+    for (k = UPX_MAX(k, N); k < n; k++) {
+        byte *const p = b + k * Size;
+        sub_set<Size>(p, sub_get<Size>(p) + sub_get<Size>(p - N * Size));
+    }
+}
+
+typedef void (*sub_func_t)(byte *, unsigned);
+
+template <unsigned Size>
+sub_func_t sub_select(unsigned N, bool undo, int level) noexcept {
+    static const sub_func_t funcs[3][4] = {
+        {sub_sse2<1, Size>, sub_sse2<2, Size>, sub_sse2<3, Size>, sub_sse2<4, Size>},
+        {sub_avx2<1, Size>, sub_avx2<2, Size>, sub_avx2<3, Size>, sub_avx2<4, Size>},
+        {add_sse2<1, Size>, add_sse2<2, Size>, add_sse2<3, Size>, add_sse2<4, Size>},
+    };
+    // the ADD prefix sum is a serial dependency chain, so AVX2 does not help here
+    return funcs[undo ? 2 : (level >= upx::SIMD_AVX2 ? 1 : 0)][N - 1];
+}
+
+#endif // WITH_SIMD && (ACC_ABI_LITTLE_ENDIAN)
+
+} // namespace
+
+bool filter_sub_simd(byte *b, unsigned n, unsigned N, unsigned size, bool undo) noexcept {
+#if WITH_SIMD && (ACC_ABI_LITTLE_ENDIAN)
+    const int level = upx::simd_get_level();
+    if (level < upx::SIMD_SSE2 || N < 1 || N > 4)
+        return false;
+    sub_func_t func;
+    if (size == 1)
+        func = sub_select<1>(N, undo, level);
+    else if (size == 2)
+        func = sub_select<2>(N, undo, level);
+    else if (size == 4)
+        func = sub_select<4>(N, undo, level);
+    else
+        return false;
+    func(b, n);
+    return true;
+#else
+    UNUSED(b);
+    UNUSED(n);
+    UNUSED(N);
+    UNUSED(size);
+    UNUSED(undo);
+    return false;
+#endif
+}
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,61 @@
+/* filter_simd.h -- SIMD helpers for the filters
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   Copyright (C) 1996-2024 Laszlo Molnar
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer              Laszlo Molnar
+   <markus@oberhumer.com>               <ezerotven+github@gmail.com>
+ */
+
+#pragma once
+
+/*************************************************************************
+// Find the next opcode byte for the x86 calltrick filters.
+//
+// filter_find(kind, b, ic, end) returns the smallest ic' in [ic, end)
+// where b[ic'] may match "kind", or "end" if there is none. The result
+// is a superset of the exact filter condition - the caller still has to
+// check the condition itself, so the filters stay bit-identical.
+//
+// Uses SSE2/AVX2 if available, see util/simd.h.
+**************************************************************************/
+
+enum : unsigned {
+    FILTER_FIND_E8 = 1,       // call
+    FILTER_FIND_E9 = 2,       // jmp
+    FILTER_FIND_E8E9 = 3,     // call or jmp
+    FILTER_FIND_E8E9_JCC = 4, // call, jmp or second byte of jcc (0x80..0x8f)
+};
+
+unsigned filter_find(unsigned kind, const byte *b, unsigned ic, unsigned end) noexcept;
+
+/*************************************************************************
+// Delta filters, see sub.hh.
+//
+// Apply the SUB (or for "undo" the ADD) transform to "n" little-endian
+// elements of "size" bytes with "N" interleaved channels. Returns false
+// if there is no SIMD kernel for this CPU, in which case the caller has
+// to run the scalar code.
+**************************************************************************/
+
+bool filter_sub_simd(byte *b, unsigned n, unsigned N, unsigned size, bool undo) noexcept;
+
+/* vim:set ts=4 sw=4 et: */
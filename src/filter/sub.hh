@@ -26,29 +26,31 @@
  */
 
 /*************************************************************************
-//
+// SUB/ADD use the SIMD kernels from filter_simd.cpp if available
 **************************************************************************/
 
 #define SUB(f, N, T, get, set)                                                                     \
     byte *b = f->buf;                                                                              \
     unsigned l = f->buf_len / sizeof(T);                                                           \
-    int i;                                                                                         \
-    T d[N];                                                                                        \
+    if (!filter_sub_simd(b, l, N, sizeof(T), false)) {                                             \
+        int i;                                                                                     \
+        T d[N];                                                                                    \
                                                                                                    \
-    i = N - 1;                                                                                     \
-    do                                                                                             \
-        d[i] = 0;                                                                                  \
-    while (--i >= 0);                                                                              \
+        i = N - 1;                                                                                 \
+        do                                                                                         \
+            d[i] = 0;                                                                              \
+        while (--i >= 0);                                                                          \
                                                                                                    \
-    i = N - 1;                                                                                     \
-    do {                                                                                           \
-        T delta = (T) (get(b) - d[i]);                                                             \
-        set(b, delta);                                                                             \
-        d[i] = (T) (d[i] + delta);                                                                 \
-        b += sizeof(T);                                                                            \
-        if (--i < 0)                                                                               \
-            i = N - 1;                                                                             \
-    } while (--l > 0);                                                                             \
+        i = N - 1;                                                                                 \
+        do {                                                                                       \
+            T delta = (T) (get(b) - d[i]);                                                         \
+            set(b, delta);                                                                         \
+            d[i] = (T) (d[i] + delta);                                                             \
+            b += sizeof(T);                                                                        \
+            if (--i < 0)                                                                           \
+                i = N - 1;                                                                         \
+        } while (--l > 0);                                                                         \
+    }                                                                                              \
     f->calls = (f->buf_len / sizeof(T)) - N;                                                       \
     assert((int) f->calls > 0);                                                                    \
     return 0;
@@ -56,22 +58,24 @@
 #define ADD(f, N, T, get, set)                                                                     \
     byte *b = f->buf;                                                                              \
     unsigned l = f->buf_len / sizeof(T);                                                           \
-    int i;                                                                                         \
-    T d[N];                                                                                        \
+    if (!filter_sub_simd(b, l, N, sizeof(T), true)) {                                              \
+        int i;                                                                                     \
+        T d[N];                                                                                    \
                                                                                                    \
-    i = N - 1;                                                                                     \
-    do                                                                                             \
-        d[i] = 0;                                                                                  \
-    while (--i >= 0);                                                                              \
+        i = N - 1;                                                                                 \
+        do                                                                                         \
+            d[i] = 0;                                                                              \
+        while (--i >= 0);                                                                          \
                                                                                                    \
-    i = N - 1;                                                                                     \
-    do {                                                                                           \
-        d[i] = (T) (d[i] + get(b));                                                                \
-        set(b, d[i]);                                                                              \
-        b += sizeof(T);                                                                            \
-        if (--i < 0)                                                                               \
-            i = N - 1;                                                                             \
-    } while (--l > 0);                                                                             \
+        i = N - 1;                                                                                 \
+        do {                                                                                       \
+            d[i] = (T) (d[i] + get(b));                                                            \
+            set(b, d[i]);                                                                          \
+            b += sizeof(T);                                                                        \
+            if (--i < 0)                                                                           \
+                i = N - 1;                                                                         \
+        } while (--l > 0);                                                                         \
+    }                                                                                              \
     f->calls = (f->buf_len / sizeof(T)) - N;                                                       \
     assert((int) f->calls > 0);                                                                    \
     return 0;
@@ -229,14 +229,16 @@ void show_help(int verbose) {
     con_fprintf(f,
                 "  -q     be quiet                          -v    be verbose\n"
                 "  -oFILE write output to 'FILE'\n"
+                "  -jN    process N files in parallel\n"
                 "  -f     force compression of suspicious files\n"
-                "%s%s"
+                "%s%s%s"
                 , (verbose == 0) ? "  -k     keep backup files\n" : ""
 #if 1
                 , (verbose > 0) ? "  --no-color, --mono, --color, --no-progress   change look\n" : ""
 #else
                 , ""
 #endif
+                , (verbose > 0) ? "  --stats[=json]  show time and memory used by each phase\n" : ""
                 );
 
     if (verbose > 0)
@@ -248,6 +250,12 @@ void show_help(int verbose) {
                     "  --lzma              try LZMA [slower but tighter than NRV]\n"
                     "  --brute             try all available compression methods & filters [slow]\n"
                     "  --ultra-brute       try even more compression variants [very slow]\n"
+                    "  --threads=N         try compression variants on N threads [0 = all CPUs]\n"
+                    "  --prune-filters=N   skip filters estimated N percent worse than the best\n"
+                    "  --cache-dir=DIR     reuse compression results of earlier runs stored in DIR\n"
+                    "  --winner-stats=FILE try the methods and filters that won most often first\n"
+                    "  --early-stop=N      stop when N percent better than the best in FILE\n"
+                    "  --abort-margin=N    give up on variants projected N percent worse\n"
                     "\n");
         fg = con_fg(f, FG_YELLOW);
         con_fprintf(f, "Backup options:\n");
@@ -269,6 +277,9 @@ void show_help(int verbose) {
         fg = con_fg(f, fg);
         con_fprintf(f,
                     "  --force-overwrite   force overwrite of output files\n"
+#if WITH_MMAP
+                    "  --mmap              map input files into memory instead of reading them\n"
+#endif
 #if defined(__unix__)
                     "  --link              preserve hard links (Unix only) [USE WITH CARE]\n"
                     "  --no-link           do not preserve hard links but rename files [default]\n"
@@ -337,6 +348,7 @@ void show_help(int verbose) {
         fg = con_fg(f, fg);
         con_fprintf(f,
                     "  --preserve-build-id     copy .gnu.note.build-id to compressed output\n"
+                    "  --split-blocks=SIZE     compress large segments as blocks of SIZE bytes\n"
                     "\n");
     }
     // clang-format on
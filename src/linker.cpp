@@ -58,6 +58,54 @@ static void free_array(T **array, size_t count) noexcept {
     ::free(array); // NOLINT(bugprone-multi-level-implicit-pointer-conversion)
 }
 
+/*************************************************************************
+// NameIndex
+**************************************************************************/
+
+static unsigned name_hash(const char *s) noexcept {
+    unsigned h = 0x811c9dc5; // FNV-1a
+    for (; *s; s++)
+        h = (h ^ (uchar) *s) * 0x01000193;
+    return h;
+}
+
+template <class T>
+T *ElfLinker::NameIndex<T>::find(const char *name) const noexcept {
+    if (slots == nullptr)
+        return nullptr;
+    for (unsigned i = name_hash(name) & mask;; i = (i + 1) & mask) {
+        T *item = slots[i];
+        if (item == nullptr)
+            return nullptr;
+        if (strcmp(item->name, name) == 0)
+            return item;
+    }
+}
+
+template <class T>
+void ElfLinker::NameIndex<T>::insert(T *item) may_throw {
+    // keep the load factor <= 1/2
+    if (2 * (count + 1) > mask + 1) {
+        const unsigned old_capacity = slots ? mask + 1 : 0;
+        T **const old_slots = slots;
+        const unsigned capacity = old_capacity ? 2 * old_capacity : 64;
+        // NOLINTNEXTLINE(bugprone-multi-level-implicit-pointer-conversion)
+        slots = static_cast<T **>(calloc(capacity, sizeof(T *)));
+        assert_noexcept(slots != nullptr);
+        mask = capacity - 1;
+        count = 0;
+        for (unsigned i = 0; i < old_capacity; i++)
+            if (old_slots[i] != nullptr)
+                insert(old_slots[i]);
+        ::free(old_slots); // NOLINT(bugprone-multi-level-implicit-pointer-conversion)
+    }
+    unsigned i = name_hash(item->name) & mask;
+    while (slots[i] != nullptr)
+        i = (i + 1) & mask;
+    slots[i] = item;
+    count += 1;
+}
+
 /*************************************************************************
 // Section
 **************************************************************************/
@@ -117,7 +165,118 @@ ElfLinker::~ElfLinker() noexcept {
     free_array(relocations, nrelocations);
 }
 
-void ElfLinker::init(const void *pdata_v, int plen, unsigned pxtra) {
+/*************************************************************************
+// stub templates
+//
+// Decompressing a stub and parsing its objdump text is much slower than
+// the actual linking, and Packer::compressWithFilters() calls buildLoader()
+// for every compression candidate. So each stub gets parsed only once per
+// process into a template, and init() just copies its tables.
+**************************************************************************/
+
+/*static*/ bool ElfLinker::use_stub_templates = true;
+
+namespace {
+struct StubTemplates final {
+    static constexpr unsigned MAX_TEMPLATES = 64;
+    struct Entry {
+        byte *pdata; // copy of the stub, the key
+        int plen;
+        ElfLinker *linker;
+    };
+    Entry entries[MAX_TEMPLATES];
+    unsigned count;
+#if WITH_THREADS
+    std::mutex lock;
+#endif
+    ~StubTemplates() noexcept {
+        for (unsigned i = 0; i < count; i++) {
+            delete[] entries[i].pdata;
+            delete entries[i].linker;
+        }
+    }
+};
+} // namespace
+
+static StubTemplates stub_templates;
+
+// returns nullptr if the table is full
+/*static*/ const ElfLinker *ElfLinker::getStubTemplate(const void *pdata, int plen) {
+    StubTemplates &st = stub_templates;
+#if WITH_THREADS
+    std::lock_guard<std::mutex> guard(st.lock);
+#endif
+    // compare the contents, not just the address
+    for (unsigned i = 0; i < st.count; i++)
+        if (st.entries[i].plen == plen && memcmp(st.entries[i].pdata, pdata, plen) == 0)
+            return st.entries[i].linker;
+    if (st.count >= StubTemplates::MAX_TEMPLATES || plen <= 0)
+        return nullptr;
+    ElfLinker *const t = new ElfLinker();
+    try {
+        t->loadInput(pdata, plen);
+        t->output_capacity = t->inputlen ? t->inputlen : 0x4000;
+        t->output = New(byte, t->output_capacity);
+        t->parseInput();
+    } catch (...) {
+        delete t;
+        throw;
+    }
+    StubTemplates::Entry &e = st.entries[st.count];
+    e.pdata = New(byte, plen);
+    memcpy(e.pdata, pdata, plen);
+    e.plen = plen;
+    e.linker = t;
+    st.count += 1;
+    return t;
+}
+
+void ElfLinker::copyTables(const ElfLinker *tmpl) {
+    for (unsigned i = 0; i < tmpl->nsections; i++) {
+        const Section *sec = tmpl->sections[i];
+        addSection(sec->name, sec->input, sec->size, sec->p2align);
+    }
+    for (unsigned i = 0; i < tmpl->nsymbols; i++) {
+        const Symbol *sym = tmpl->symbols[i];
+        addSymbol(sym->name, sym->section->name, sym->offset);
+    }
+    for (unsigned i = 0; i < tmpl->nrelocations; i++) {
+        const Relocation *rel = tmpl->relocations[i];
+        // rel->type points into tmpl->input
+        const char *type = (const char *) input + (rel->type - (const char *) tmpl->input);
+        addRelocation(rel->section->name, rel->offset, type, rel->value->name, rel->add);
+    }
+    if (tmpl->nsections != 0)
+        addLoader("*UND*"); // as done by parseInput()
+}
+
+/*************************************************************************
+// ElfLinker init
+**************************************************************************/
+
+void ElfLinker::init(const void *pdata, int plen, unsigned pxtra) {
+    const ElfLinker *const tmpl = use_stub_templates ? getStubTemplate(pdata, plen) : nullptr;
+    if (tmpl != nullptr) {
+        // the parsed input, as left behind by parseInput()
+        inputlen = tmpl->inputlen;
+        input = New(byte, inputlen + 1);
+        memcpy(input, tmpl->input, inputlen + 1);
+    } else
+        loadInput(pdata, plen);
+
+    output_capacity = (inputlen ? (inputlen + pxtra) : 0x4000);
+    assert(output_capacity < (1 << 16)); // LE16 l_info.l_size
+    output = New(byte, output_capacity);
+    outputlen = 0;
+    NO_printf("\nElfLinker::init %d @%p\n", output_capacity, output);
+
+    if (tmpl != nullptr)
+        copyTables(tmpl);
+    else
+        parseInput();
+}
+
+void ElfLinker::loadInput(const void *pdata_v, int plen) {
     const byte *pdata = (const byte *) pdata_v;
     if (plen >= 16 && memcmp(pdata, "UPX#", 4) == 0) {
         // decompress pre-compressed stub-loader
@@ -152,13 +311,9 @@ void ElfLinker::init(const void *pdata_v, int plen, unsigned pxtra) {
             memcpy(input, pdata, inputlen);
     }
     input[inputlen] = 0; // NUL terminate
+}
 
-    output_capacity = (inputlen ? (inputlen + pxtra) : 0x4000);
-    assert(output_capacity < (1 << 16)); // LE16 l_info.l_size
-    output = New(byte, output_capacity);
-    outputlen = 0;
-    NO_printf("\nElfLinker::init %d @%p\n", output_capacity, output);
-
+void ElfLinker::parseInput() {
     // FIXME: bad compare when either symbols or relocs are absent
     if ((int) strlen("Sections:\n"
                      "SYMBOL TABLE:\n"
@@ -299,18 +454,18 @@ void ElfLinker::preprocessRelocations(char *start, char const *end) {
 }
 
 ElfLinker::Section *ElfLinker::findSection(const char *name, bool fatal) const {
-    for (unsigned ic = 0; ic < nsections; ic++)
-        if (strcmp(sections[ic]->name, name) == 0)
-            return sections[ic];
+    Section *sec = section_index.find(name);
+    if (sec != nullptr)
+        return sec;
     if (fatal)
         throwInternalError("unknown section %s\n", name);
     return nullptr;
 }
 
 ElfLinker::Symbol *ElfLinker::findSymbol(const char *name, bool fatal) const {
-    for (unsigned ic = 0; ic < nsymbols; ic++)
-        if (strcmp(symbols[ic]->name, name) == 0)
-            return symbols[ic];
+    Symbol *sym = symbol_index.find(name);
+    if (sym != nullptr)
+        return sym;
     if (fatal)
         throwInternalError("unknown symbol %s\n", name);
     return nullptr;
@@ -329,6 +484,7 @@ ElfLinker::Section *ElfLinker::addSection(const char *sname, const void *sdata,
     Section *sec = new Section(sname, sdata, slen, p2align);
     sec->sort_id = nsections;
     sections[nsections++] = sec;
+    section_index.insert(sec);
     return sec;
 }
 
@@ -342,6 +498,7 @@ ElfLinker::Symbol *ElfLinker::addSymbol(const char *name, const char *section,
         symbols = realloc_array(symbols, nsymbols_capacity);
     Symbol *sym = new Symbol(name, findSection(section), offset);
     symbols[nsymbols++] = sym;
+    symbol_index.insert(sym);
     return sym;
 }
 
@@ -63,7 +63,26 @@ protected:
 
     bool reloc_done = false;
 
+    // open addressing hash tables over the names in sections[] and symbols[],
+    // so that findSection() and findSymbol() don't need a linear search
+    template <class T>
+    struct NameIndex final : private upx::noncopyable {
+        T **slots = nullptr; // nullptr means empty
+        unsigned mask = 0;   // number of slots - 1
+        unsigned count = 0;
+        // NOLINTNEXTLINE(bugprone-multi-level-implicit-pointer-conversion)
+        ~NameIndex() noexcept { ::free(slots); }
+        T *find(const char *name) const noexcept;
+        void insert(T *item) may_throw;
+    };
+    NameIndex<Section> section_index;
+    NameIndex<Symbol> symbol_index;
+
 protected:
+    void loadInput(const void *pdata, int plen);
+    void parseInput();
+    void copyTables(const ElfLinker *tmpl);
+    static const ElfLinker *getStubTemplate(const void *pdata, int plen);
     void preprocessSections(char *start, char const *end);
     void preprocessSymbols(char *start, char const *end);
     void preprocessRelocations(char *start, char const *end);
@@ -78,6 +97,8 @@ public:
     virtual ~ElfLinker() noexcept;
 
     void init(const void *pdata, int plen, unsigned pxtra = 0);
+    // parse each stub only once per process, see getStubTemplate()
+    static bool use_stub_templates;
     // virtual void setLoaderAlignOffset(int phase);
     int addLoader(const char *sname);
     void addLoader(const char *s, va_list ap);
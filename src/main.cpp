@@ -31,6 +31,7 @@
 #include "packer.h"            // Packer::isValidCompressionMethod()
 #include "p_elf.h"             // ELFOSABI_xxx
 #include "compress/compress.h" // upx_ucl_init()
+#include "util/parallel.h"       // upx::PARALLEL_MAX_THREADS
 
 /*************************************************************************
 // options
@@ -381,6 +382,9 @@ static int do_option(int optc, const char *arg) {
     case 910:
         set_cmd(CMD_SYSINFO);
         break;
+    case 911:
+        set_cmd(CMD_BENCHMARK);
+        break;
     case 'h':
     case 'H':
     case '?':
@@ -408,6 +412,9 @@ static int do_option(int optc, const char *arg) {
     case 'L':
         set_cmd(CMD_LICENSE);
         break;
+    case 'j':
+        getoptvar(&opt->jobs, 0, (int) upx::PARALLEL_MAX_THREADS, arg);
+        break;
     case 'o':
         set_output_name(mfx_optarg, 1);
         break;
@@ -557,6 +564,17 @@ static int do_option(int optc, const char *arg) {
     case 528:
         opt->preserve_timestamp = false;
         break;
+    case 534:
+        opt->use_mmap = true;
+        break;
+    case 535:
+        if (!mfx_optarg || !mfx_optarg[0] || strcmp(mfx_optarg, "text") == 0)
+            opt->stats = opt->STATS_TEXT;
+        else if (strcmp(mfx_optarg, "json") == 0)
+            opt->stats = opt->STATS_JSON;
+        else
+            e_optarg(arg);
+        break;
     // compression settings
     case 520: // --small
         if (opt->small < 0)
@@ -585,6 +603,28 @@ static int do_option(int optc, const char *arg) {
     case 525: // --exact
         opt->exact = true;
         break;
+    case 532: // --threads=
+        getoptvar(&opt->threads, 0, (int) upx::PARALLEL_MAX_THREADS, arg);
+        break;
+    case 533: // --prune-filters=
+        getoptvar(&opt->prune_filters, 0, 1000, arg);
+        break;
+    case 536: // --cache-dir=
+        if (!mfx_optarg || !mfx_optarg[0] || strlen(mfx_optarg) >= ACC_FN_PATH_MAX - 64)
+            e_optarg(arg);
+        opt->cache_dir = mfx_optarg;
+        break;
+    case 537: // --winner-stats=
+        if (!mfx_optarg || !mfx_optarg[0] || strlen(mfx_optarg) >= ACC_FN_PATH_MAX - 8)
+            e_optarg(arg);
+        opt->winner_stats = mfx_optarg;
+        break;
+    case 538: // --early-stop=
+        getoptvar(&opt->early_stop, 0, 100, arg);
+        break;
+    case 539: // --abort-margin=
+        getoptvar(&opt->abort_margin, 0, 1000, arg);
+        break;
     // CRP - Compression Runtime Parameters (undocumented and subject to change)
     case 801:
         getoptvar(&opt->crp.crp_ucl.c_flags, 0, 3, arg);
@@ -703,6 +743,9 @@ static int do_option(int optc, const char *arg) {
     case 660:
         getoptvar(&opt->o_unix.blocksize, 8192u, ~0u, arg);
         break;
+    case 678:
+        getoptvar(&opt->o_unix.split_blocksize, 65536u, ~0u, arg);
+        break;
     case 661:
         opt->o_unix.force_execve = true;
         break;
@@ -829,6 +872,7 @@ int main_get_options(int argc, char **argv) {
         {"list", 0, N, 'l'},           // list compressed exe
         {"sysinfo", 0x90, N, 910},     // display system info // undocumented and subject to change
         {"sys-info", 0x90, N, 910},    // display system info // undocumented and subject to change
+        {"benchmark", 0x90, N, 911},   // benchmark compression methods and filters
         {"test", 0, N, 't'},           // test compressed file integrity
         {"uncompress", 0, N, 'd'},     // decompress
         {"version", 0, N, 'V' + 256},  // display version number
@@ -839,6 +883,9 @@ int main_get_options(int argc, char **argv) {
         {"force-overwrite", 0x90, N, 529}, // force overwrite of output files
         {"link", 0x90, N, 530},            // preserve hard link
         {"info", 0, N, 'i'},               // info mode
+        {"jobs", 0x21, N, 'j'},            // process files in parallel
+        {"mmap", 0x10, N, 534},            // map input files into memory
+        {"stats", 0x12, N, 535},           // --stats[=json]
         {"no-env", 0x10, N, 519},          // no environment var
         {"no-link", 0x90, N, 531},         // do not preserve hard link [default]
         {"no-mode", 0x10, N, 526},         // do not preserve mode (permissions)
@@ -902,6 +949,12 @@ int main_get_options(int argc, char **argv) {
         {"filter", 0x31, N, 521}, // --filter=
         {"no-filter", 0x10, N, 522},
         {"small", 0x10, N, 520},
+        {"threads", 0x31, N, 532},       // --threads=
+        {"prune-filters", 0x31, N, 533}, // --prune-filters=
+        {"cache-dir", 0x31, N, 536},     // --cache-dir=
+        {"winner-stats", 0x31, N, 537},  // --winner-stats=
+        {"early-stop", 0x31, N, 538},    // --early-stop=
+        {"abort-margin", 0x31, N, 539},  // --abort-margin=
         // CRP - Compression Runtime Parameters (undocumented and subject to change)
         {"crp-nrv-cf", 0x31, N, 801},
         {"crp-nrv-sl", 0x31, N, 802},
@@ -953,6 +1006,7 @@ int main_get_options(int argc, char **argv) {
         {"preserve-build-id", 0, N, 675},
         {"android-shlib", 0, N, 676},
         {"force-pie", 0x90, N, 677},
+        {"split-blocks", 0x31, N, 678},  // --split-blocks=
         // ps1/exe
         {"boot-only", 0x90, N, 670},
         {"no-align", 0x90, N, 671},
@@ -996,6 +1050,13 @@ int main_get_options(int argc, char **argv) {
         {"dt-no-run", 0x12, N, 999},
         {"dt-s", 0x12, N, 999},
         {"dt-success", 0x12, N, 999},
+        {"dt-ns", 0x12, N, 999},
+        {"dt-no-skip", 0x12, N, 999},
+        // [doctest] Filters - used for running the micro benchmarks, see check/dt_bench.h
+        {"dt-tc", 0x31, N, 999},
+        {"dt-test-case", 0x31, N, 999},
+        {"dt-tce", 0x31, N, 999},
+        {"dt-test-case-exclude", 0x31, N, 999},
 #endif
 
         {nullptr, 0, nullptr, 0}
@@ -1031,6 +1092,8 @@ void main_get_envoptions() {
 
         // options
         {"info", 0, N, 'i'},        // info mode
+        {"mmap", 0x10, N, 534},     // map input files into memory
+        {"stats", 0x12, N, 535},    // --stats[=json]
         {"no-progress", 0, N, 516}, // no progress bar
         {"quiet", 0, N, 'q'},       // quiet mode
         {"silent", 0, N, 'q'},      // quiet mode
@@ -1063,7 +1126,13 @@ void main_get_envoptions() {
         {"color", 0x10, N, 514},
 
         // compression settings
-        {"exact", 0x10, N, 525}, // user requires byte-identical decompression
+        {"exact", 0x10, N, 525},         // user requires byte-identical decompression
+        {"threads", 0x31, N, 532},       // --threads=
+        {"prune-filters", 0x31, N, 533}, // --prune-filters=
+        {"cache-dir", 0x31, N, 536},     // --cache-dir=
+        {"winner-stats", 0x31, N, 537},  // --winner-stats=
+        {"early-stop", 0x31, N, 538},    // --early-stop=
+        {"abort-margin", 0x31, N, 539},  // --abort-margin=
 
         // compression method
         {"nrv2b", 0x10, N, 702},   // --nrv2b
@@ -1281,6 +1350,11 @@ int upx_main(int argc, char *argv[]) may_throw {
         show_sysinfo(OPTIONS_VAR);
         e_exit(EXIT_OK);
         break;
+    case CMD_BENCHMARK:
+        set_term(stdout);
+        do_benchmark(i, argc, argv);
+        e_exit(exit_code);
+        break;
     case CMD_HELP:
         show_help(2);
         e_exit(EXIT_OK);
@@ -33,7 +33,7 @@
 //
 **************************************************************************/
 
-static int pr_need_nl = 0;
+static upx_thread_local int pr_need_nl = 0;
 
 void printSetNl(int need_nl) noexcept { pr_need_nl = need_nl; }
 
@@ -59,7 +59,7 @@ void printClearLine(FILE *f) noexcept {
 static void pr_print(bool c, const char *msg) noexcept {
     if (c && !opt->to_stdout)
         con_fprintf(stderr, "%s", msg);
-    else
+    else if (!con_capture_fputs(stderr, msg, true))
         fprintf(stderr, "%s", msg);
 }
 
@@ -156,7 +156,7 @@ void printUnhandledException(const char *iname, const std::exception *e) noexcep
 // info
 **************************************************************************/
 
-static int info_header = 0;
+static upx_thread_local int info_header = 0;
 
 static void info_print(const char *msg) {
     if (opt->info_mode <= 0)
@@ -28,7 +28,7 @@
 #include "conf.h"
 
 static Options global_options;
-Options *opt = &global_options; // also see class PackMaster for per-file local options
+upx_thread_local Options *opt = &global_options; // also see class PackMaster
 
 #if WITH_THREADS
 std::mutex opt_lock_mutex; // for locking "opt"
@@ -48,6 +48,11 @@ void Options::reset() noexcept {
     o->method = M_NONE;
     o->level = -1;
     o->filter = FT_NONE;
+    o->threads = 1;
+    o->prune_filters = -1;
+    o->early_stop = -1;
+    o->abort_margin = -1;
+    o->jobs = 1;
 
     o->backup = -1;
     o->overlay = -1;
@@ -179,6 +184,83 @@ TEST_CASE("getopt") {
         CHECK(opt->all_methods_use_lzma == -1);
         CHECK(opt->method == -1);
     }
+    SUBCASE("--threads") {
+        CHECK(opt->threads == 1);
+        const char *a[] = {a0, "--threads=4", nullptr};
+        test_options(a);
+        CHECK(opt->threads == 4);
+    }
+    SUBCASE("--threads=0") {
+        const char *a[] = {a0, "--threads=0", nullptr};
+        test_options(a);
+        CHECK(opt->threads == 0);
+    }
+    SUBCASE("--prune-filters") {
+        CHECK(opt->prune_filters == -1);
+        const char *a[] = {a0, "--prune-filters=5", nullptr};
+        test_options(a);
+        CHECK(opt->prune_filters == 5);
+    }
+    SUBCASE("--cache-dir") {
+        CHECK(opt->cache_dir == nullptr);
+        const char *a[] = {a0, "--cache-dir=/tmp/upx-cache", nullptr};
+        test_options(a);
+        CHECK(strcmp(opt->cache_dir, "/tmp/upx-cache") == 0);
+    }
+    SUBCASE("--winner-stats") {
+        CHECK(opt->winner_stats == nullptr);
+        CHECK(opt->early_stop == -1);
+        const char *a[] = {a0, "--winner-stats=upx-winners.txt", "--early-stop=5", nullptr};
+        test_options(a);
+        CHECK(strcmp(opt->winner_stats, "upx-winners.txt") == 0);
+        CHECK(opt->early_stop == 5);
+    }
+    SUBCASE("--abort-margin") {
+        CHECK(opt->abort_margin == -1);
+        const char *a[] = {a0, "--abort-margin=10", nullptr};
+        test_options(a);
+        CHECK(opt->abort_margin == 10);
+    }
+    SUBCASE("--mmap") {
+        CHECK(!opt->use_mmap);
+        const char *a[] = {a0, "--mmap", nullptr};
+        test_options(a);
+        CHECK(opt->use_mmap);
+    }
+    SUBCASE("-j") {
+        CHECK(opt->jobs == 1);
+        const char *a[] = {a0, "-j", "8", nullptr};
+        test_options(a);
+        CHECK(opt->jobs == 8);
+    }
+    SUBCASE("--jobs") {
+        const char *a[] = {a0, "--jobs=0", nullptr};
+        test_options(a);
+        CHECK(opt->jobs == 0);
+    }
+    SUBCASE("--split-blocks") {
+        CHECK(opt->o_unix.split_blocksize == 0);
+        const char *a[] = {a0, "--split-blocks=1048576", nullptr};
+        test_options(a);
+        CHECK(opt->o_unix.split_blocksize == 1048576);
+    }
+    SUBCASE("--stats") {
+        CHECK(opt->stats == opt->STATS_OFF);
+        const char *a[] = {a0, "--stats", nullptr};
+        test_options(a);
+        CHECK(opt->stats == opt->STATS_TEXT);
+    }
+    SUBCASE("--stats=json") {
+        const char *a[] = {a0, "--stats=json", nullptr};
+        test_options(a);
+        CHECK(opt->stats == opt->STATS_JSON);
+    }
+    SUBCASE("--benchmark") {
+        const char *a[] = {a0, "--benchmark", "-9", nullptr};
+        test_options(a);
+        CHECK(opt->cmd == CMD_BENCHMARK);
+        CHECK(opt->level == 9);
+    }
 
     opt = saved_opt;
 }
@@ -30,7 +30,9 @@
 struct Options;
 #define options_t Options // old name
 
-extern Options *opt; // global options, see class PackMaster for per-file local options
+// global options, see class PackMaster for per-file local options;
+// this is a per-thread pointer, see upx::parallel_for() and do_files()
+extern upx_thread_local Options *opt;
 
 #if WITH_THREADS
 extern std::mutex opt_lock_mutex; // for locking "opt"
@@ -49,6 +51,7 @@ enum {
     CMD_LIST,
     CMD_FILEINFO,
     CMD_SYSINFO,
+    CMD_BENCHMARK,
     CMD_HELP,
     CMD_LICENSE,
     CMD_VERSION,
@@ -70,10 +73,17 @@ struct Options final {
     bool ultra_brute;
     bool all_methods; // try all available compression methods
     int all_methods_use_lzma;
-    bool all_filters; // try all available filters
-    bool no_filter;   // force no filter
-    bool prefer_ucl;  // prefer UCL
-    bool exact;       // user requires byte-identical decompression
+    bool all_filters;  // try all available filters
+    bool no_filter;    // force no filter
+    bool prefer_ucl;   // prefer UCL
+    bool exact;        // user requires byte-identical decompression
+    int threads;       // number of worker threads; 0 means one per CPU
+    int jobs;          // number of files to process in parallel; 0 means one per CPU
+    int prune_filters; // skip filters estimated > N percent worse than the best; -1 means off
+    const char *cache_dir; // "--cache-dir=DIR" reuse compression results of earlier runs
+    const char *winner_stats; // "--winner-stats=FILE" try likely methods and filters first
+    int early_stop; // stop at N percent better than the best ratio in winner_stats; -1 means off
+    int abort_margin; // abort candidates projected > N percent worse than the best; -1 means off
 
     // other options
     int backup;
@@ -89,6 +99,9 @@ struct Options final {
     bool preserve_mode;
     bool preserve_ownership;
     bool preserve_timestamp;
+    bool use_mmap; // map input files into memory instead of reading them
+    enum { STATS_OFF = 0, STATS_TEXT = 1, STATS_JSON = 2 };
+    int stats; // "--stats" per-file phase timings
     int small;
     int verbose;
     bool to_stdout;
@@ -151,6 +164,7 @@ struct Options final {
     } dos_exe;
     struct {
         unsigned blocksize;
+        unsigned split_blocksize; // compress large extents in blocks of this size
         bool force_execve;      // force the linux/386 execve format
         bool is_ptinterp;       // is PT_INTERP, so don't adjust auxv_t
         bool use_ptinterp;      // use PT_INTERP /opt/upx/run
@@ -42,6 +42,7 @@
 #include "p_lx_exc.h"
 #include "p_lx_elf.h"
 #include "ui.h"
+#include "util/cache.h"
 
 using upx::umin;
 
@@ -131,14 +132,15 @@ funpad4(InputFile *fi)
     return d;
 }
 
-static void alloc_file_image(MemBuffer &mb, off_t size)
+// read the first "size" bytes of the file; with --mmap the image
+// references the (copy-on-write) mapped file instead of a copy
+static void read_file_image(InputFile *f, MemBuffer &mb, off_t size)
 {
     assert(mem_size_valid_bytes(size));
-    if (mb.getVoidPtr() == nullptr) {
-        mb.alloc(size);
-    } else {
+    if (mb.getVoidPtr() != nullptr) {
         assert((u32_t)size <= mb.getSize());
     }
+    f->readIntoMemBuffer(mb, size);
 }
 
 int
@@ -311,16 +313,14 @@ PackLinuxElf32::PackLinuxElf32help1(InputFile *f)
 
     if (f && Elf32_Ehdr::ET_DYN!=e_type) {
         unsigned const len = file_size;  // (sz_phdrs + e_phoff) except --preserve-build-id
-        alloc_file_image(file_image, len);
         f->seek(0, SEEK_SET);
-        f->readx(file_image, len);
+        read_file_image(f, file_image, len);
         phdri= (Elf32_Phdr       *)(e_phoff + file_image);  // do not free() !!
     }
     if (f && Elf32_Ehdr::ET_DYN==e_type) {
         // The DT_SYMTAB has no designated length.  Read the whole file.
-        alloc_file_image(file_image, file_size);
         f->seek(0, SEEK_SET);
-        f->readx(file_image, file_size);
+        read_file_image(f, file_image, file_size);
         phdri= (Elf32_Phdr *)(e_phoff + file_image);  // do not free() !!
         if (opt->cmd != CMD_COMPRESS || !e_shoff ||  file_size < e_shoff) {
             shdri = nullptr;
@@ -921,6 +921,15 @@ PackLinuxElf::addStubEntrySections(Filter const *, unsigned m_decompr)
 }
 
 
+// The loader depends on the methods and the filter, but not on the
+// compressed data, so all blocks of packExtent() can share its size.
+bool PackLinuxElf::addLoaderMemoKey(upx::CacheKeyHasher &h, Filter const *) const
+{
+    h.add_u32(methods_used);
+    h.add_u32(xct_off != 0);  // shared library
+    return true;
+}
+
 void PackLinuxElf::defineSymbols(Filter const *)
 {
     linker->defineSymbol("O_BINFO", (!!opt->o_unix.is_ptinterp) | o_binfo);
@@ -1022,16 +1031,14 @@ PackLinuxElf64::PackLinuxElf64help1(InputFile *f)
 
     if (f && Elf64_Ehdr::ET_DYN!=e_type) {
         unsigned const len = file_size;  // (sz_phdrs + e_phoff) except --preserve-build-id
-        alloc_file_image(file_image, len);
         f->seek(0, SEEK_SET);
-        f->readx(file_image, len);
+        read_file_image(f, file_image, len);
         phdri= (Elf64_Phdr       *)(e_phoff + file_image);  // do not free() !!
     }
     if (f && Elf64_Ehdr::ET_DYN==e_type) {
         // The DT_SYMTAB has no designated length.  Read the whole file.
-        alloc_file_image(file_image, file_size);
         f->seek(0, SEEK_SET);
-        f->readx(file_image, file_size);
+        read_file_image(f, file_image, file_size);
         phdri= (file_size <= (unsigned)e_phoff) ? nullptr : (Elf64_Phdr *)(e_phoff + file_image);  // do not free() !!
         if (!(opt->cmd == CMD_COMPRESS && e_shoff < (upx_uint64_t)file_size && mb_shdr.getSize() == 0)) {
             shdri = nullptr;
@@ -2631,9 +2638,8 @@ tribool PackLinuxElf32::canPack()
 
     if (Elf32_Ehdr::ET_DYN==get_te16(&ehdr->e_type)) {
         // The DT_SYMTAB has no designated length.  Read the whole file.
-        alloc_file_image(file_image, file_size);
         fi->seek(0, SEEK_SET);
-        fi->readx(file_image, file_size);
+        read_file_image(fi, file_image, file_size);
         memcpy(&ehdri, ehdr, sizeof(Elf32_Ehdr));
         phdri= (Elf32_Phdr *)((size_t)e_phoff + file_image);  // do not free() !!
         shdri= (Elf32_Shdr *)((size_t)e_shoff + file_image);  // do not free() !!
@@ -3073,9 +3079,8 @@ tribool PackLinuxElf64::canPack()
 
     if (Elf64_Ehdr::ET_DYN==get_te16(&ehdr->e_type)) {
         // The DT_SYMTAB has no designated length.  Read the whole file.
-        alloc_file_image(file_image, file_size);
         fi->seek(0, SEEK_SET);
-        fi->readx(file_image, file_size);
+        read_file_image(fi, file_image, file_size);
         memcpy(&ehdri, ehdr, sizeof(Elf64_Ehdr));
         phdri= (Elf64_Phdr *)((size_t)e_phoff + file_image);  // do not free() !!
         shdri= (Elf64_Shdr *)((size_t)e_shoff + file_image);  // do not free() !!
@@ -8679,4 +8684,54 @@ void PackLinuxElf::unpack(OutputFile * /*fo*/)
     throwCantUnpack("internal error");
 }
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#include "check/dt_bench.h"
+
+namespace {
+struct StubTestLinker : public ElfLinkerAMD64 {
+    void build(bool use_templates) {
+        const bool saved = ElfLinker::use_stub_templates;
+        ElfLinker::use_stub_templates = use_templates;
+        init(stub_amd64_linux_elf_entry, sizeof(stub_amd64_linux_elf_entry));
+        ElfLinker::use_stub_templates = saved;
+        addLoader("ELFMAINX,NRV_HEAD,NRV2E,NRV_TAIL");
+    }
+};
+} // namespace
+
+TEST_CASE("ElfLinker stub templates") {
+    StubTestLinker l1, l2, l3;
+    l1.build(false);
+    l2.build(true); // parses the stub into a template
+    l3.build(true); // copies the template
+    int len1 = 0, len2 = 0, len3 = 0;
+    const byte *const p1 = l1.getLoader(&len1);
+    const byte *const p2 = l2.getLoader(&len2);
+    const byte *const p3 = l3.getLoader(&len3);
+    CHECK(len1 > 0);
+    CHECK(len1 == len2);
+    CHECK(len1 == len3);
+    CHECK(memcmp(p1, p2, len1) == 0);
+    CHECK(memcmp(p1, p3, len1) == 0);
+    CHECK(l1.getSection("NRV2E") == l3.getSection("NRV2E"));
+    CHECK(l1.getSectionSize("LZMA_DEC10") == l3.getSectionSize("LZMA_DEC10"));
+}
+
+TEST_CASE("bench ElfLinker::init" * doctest::skip()) {
+    constexpr unsigned N = 100;
+    for (int use_templates = 0; use_templates <= 1; use_templates++) {
+        const double t = upx::bench::best_time([use_templates]() {
+            for (unsigned i = 0; i < N; i++) {
+                StubTestLinker l;
+                l.build(use_templates != 0);
+            }
+        });
+        upx::bench::report_items("ElfLinker::init amd64-linux.elf-entry",
+                                 use_templates ? "template" : "parse", N, t);
+    }
+}
+
 /* vim:set ts=4 sw=4 et: */
@@ -50,6 +50,7 @@ public:
 
 protected:
     virtual const int *getCompressionMethods(int method, int level) const override;
+    virtual bool addLoaderMemoKey(upx::CacheKeyHasher &h, const Filter *ft) const override;
 
     // All other virtual functions in this class must be pure virtual
     // because they depend on Elf32 or Elf64 data structures, which differ.
@@ -521,6 +521,15 @@ PackMachBase<T>::buildMachLoader(
     relocateLoader();
 }
 
+// buildMachLoader() depends only on the method and the filter. It also sets
+// segTEXT.vmsize, but compressWithFilters() ends with a real buildLoader().
+template <class T>
+bool
+PackMachBase<T>::addLoaderMemoKey(upx::CacheKeyHasher &, Filter const *) const
+{
+    return true;
+}
+
 template <class T>
 void
 PackMachBase<T>::buildLoader(const Filter *ft)
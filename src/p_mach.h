@@ -767,6 +767,7 @@ protected:
     virtual void patchLoaderChecksum() override;
     virtual void updateLoader(OutputFile *) override;
     virtual void buildLoader(const Filter *ft) override;
+    virtual bool addLoaderMemoKey(upx::CacheKeyHasher &h, const Filter *ft) const override;
     virtual void buildMachLoader(
         upx_byte const *const proto,
         unsigned        const szproto,
@@ -37,6 +37,7 @@
 #include "packer.h"
 #include "p_unix.h"
 #include "p_elf.h"
+#include "util/parallel.h"
 
 // do not change
 #define BLOCKSIZE       (512*1024)
@@ -346,10 +347,19 @@ void PackUnix::packExtent(
         int l = fi->readx(hdr_ibuf, hdr_u_len);
         (void)l;
     }
+    // "--split-blocks": the first block selects method and filter as usual,
+    // then the rest of a large extent gets compressed by packExtentBlocks()
+    unsigned const split_blocksize = opt->o_unix.split_blocksize
+        ? UPX_MIN(opt->o_unix.split_blocksize, blocksize) : 0;
     fi->seek(x.offset, SEEK_SET);
     for (off_t rest = x.size; 0 != rest; ) {
+        if (split_blocksize && rest < x.size) {
+            packExtentBlocks(rest, ft, fo, b_extra, split_blocksize);
+            break;
+        }
         int const filter_strategy = ft ? getStrategy(*ft) : 0;
-        int l = fi->readx(ibuf, UPX_MIN(rest, (off_t)blocksize));
+        int l = fi->readx(ibuf, UPX_MIN(rest,
+            (off_t)(split_blocksize ? split_blocksize : blocksize)));
         if (l == 0) {
             break;
         }
@@ -463,6 +473,129 @@ void PackUnix::packExtent(
     }
 }
 
+// Compress the remaining 'rest' bytes of an extent as a sequence of
+// independent blocks, using the method and filter that packExtent()
+// has chosen for the first block. A "wave" of blocks is read, compressed
+// in parallel (see "--threads"), and then written in order; the output
+// does not depend on the number of threads.
+void PackUnix::packExtentBlocks(
+    upx_off_t rest,
+    const Filter *ft,
+    OutputFile *fo,
+    unsigned b_extra,
+    unsigned split_blocksize
+)
+{
+    struct Block final {
+        explicit Block() noexcept : ft(0) {}
+        unsigned u_len;
+        bool compressed;
+        unsigned u_adler1;  // upx_adler32() of ubuf, see upx_adler32_combine()
+        unsigned c_adler1;  // upx_adler32() of the data that gets written
+        PackHeader cph;
+        Filter ft;
+        MemBuffer ubuf;  // uncompressed data
+        MemBuffer cbuf;  // compressed data
+        MemBuffer vbuf;  // verifyOverlappingDecompression()
+    };
+    unsigned const nslots = upx::parallel_get_num_threads(opt->threads);
+    // on the heap: this may run on a "-j" worker thread with a small stack
+    std::unique_ptr<Block[]> blocks(new Block[nslots]);
+    bool const use_filter = ft != nullptr && ft->id != 0;
+
+    auto work = [&](unsigned slot) {
+        Block &b = blocks[slot];
+        PackHeader &cph = b.cph;
+        cph = ph;
+        cph.overlap_overhead = 0;
+        b.compressed = false;
+        // The stub does not unfilter short blocks; see unpackExtent()
+        // in stub/src/amd64-linux.elf-main.c
+        bool filtered = false;
+        if (use_filter && b.u_len > 512) {
+            b.ft = *ft;
+            b.ft.init(ft->id, ft->addvalue);
+            filtered = b.ft.filter(b.ubuf, b.u_len);
+        }
+        if (compress(cph, b.ubuf, b.u_len, b.cbuf, NULL_cconf, nullptr)) {
+            cph.overlap_overhead = OVERHEAD;
+            b.compressed = ph_testOverlappingDecompression(cph, b.cbuf,
+                filtered ? nullptr : raw_bytes(b.ubuf, b.u_len), cph.overlap_overhead);
+        }
+        if (filtered) {
+            b.ft.unfilter(b.ubuf, b.u_len, true);
+            if (b.compressed)  // the stub checks the unfiltered data
+                cph.u_adler = upx_adler32(b.ubuf, b.u_len, cph.saved_u_adler);
+        }
+        if (!filtered)
+            b.ft.init(0, 0);
+        if (b.compressed && !ph_skipVerify(cph)) {
+            // same as verifyOverlappingDecompression(), but on a copy
+            unsigned const offset = (cph.u_len + cph.overlap_overhead) - cph.c_len;
+            memcpy(b.vbuf + offset, b.cbuf, cph.c_len);
+            ph_decompress(cph, b.vbuf + offset, b.vbuf, true, filtered ? &b.ft : nullptr);
+            b.vbuf.checkState();
+        }
+        // checksums of this block alone; get combined in order below
+        b.u_adler1 = upx_adler32(b.ubuf, b.u_len);
+        b.c_adler1 = b.compressed ? upx_adler32(b.cbuf, cph.c_len) : b.u_adler1;
+    };
+
+    while (0 != rest) {
+        // read a wave of blocks
+        unsigned n = 0;
+        for (; n < nslots && 0 != rest; n++) {
+            Block &b = blocks[n];
+            if (b.ubuf.getSize() == 0) {
+                b.ubuf.alloc(split_blocksize);
+                b.cbuf.allocForCompression(split_blocksize);
+                b.vbuf.alloc(split_blocksize + OVERHEAD);
+            }
+            b.u_len = fi->readx(b.ubuf, UPX_MIN(rest, (upx_off_t)split_blocksize));
+            if (b.u_len == 0)
+                break;
+            rest -= b.u_len;
+        }
+        if (n == 0)
+            break;
+
+        upx::parallel_for(n, nslots, work);
+
+        // write the blocks in order
+        for (unsigned slot = 0; slot < n; slot++) {
+            Block const &b = blocks[slot];
+            PackHeader const &cph = b.cph;
+            b_info tmp;
+            memset(&tmp, 0, sizeof(tmp));
+            set_te32(&tmp.sz_unc, b.u_len);
+            set_te32(&tmp.sz_cpr, b.compressed ? cph.c_len : b.u_len);
+            if (b.compressed) {
+                tmp.b_method = (unsigned char) cph.method;
+                tmp.b_ftid = (unsigned char) b.ft.id;
+                tmp.b_cto8 = b.ft.cto;
+            }
+            tmp.b_extra = b_extra;
+            fo->write(&tmp, sizeof(tmp));
+            total_out += sizeof(tmp);
+            b_len += sizeof(b_info);
+
+            // keep the running checksums, see unpackExtent()
+            const byte *const data = b.compressed ? raw_bytes(b.cbuf, cph.c_len)
+                                                  : raw_bytes(b.ubuf, b.u_len);
+            unsigned const data_len = b.compressed ? cph.c_len : b.u_len;
+            ph.u_adler = upx_adler32_combine(ph.u_adler, b.u_adler1, b.u_len);
+            ph.c_adler = upx_adler32_combine(ph.c_adler, b.c_adler1, data_len);
+            fo->write(data, data_len);
+            total_out += data_len;
+            total_in += b.u_len;
+
+            ph.u_len = b.u_len;
+            ph.c_len = data_len;
+            ph.overlap_overhead = b.compressed ? cph.overlap_overhead : 0;
+        }
+    }
+}
+
 // Consumes b_info header block and sz_cpr data block from input file 'fi'.
 // De-compresses; appends to output file 'fo' unless rewrite or peeking.
 // For "peeking" without writing: set (fo = nullptr), (is_rewrite = -1)
@@ -473,6 +606,22 @@ unsigned PackUnix::unpackExtent(unsigned wanted, OutputFile *fo,
     int is_rewrite // 0(false): write; 1(true): rewrite; -1: no write
 )
 {
+    if (is_rewrite >= 0) { // not peeking: blocks are independent
+        unsigned const nslots = upx::parallel_get_num_threads(opt->threads);
+        if (nslots > 1) {
+            // An extent that is a single block (every PT_LOAD that was packed
+            // without "--split-blocks") has nothing to run in parallel, and
+            // would only need a second buffer; peek at its b_info.
+            b_info first; memset(&first, 0, sizeof(first));
+            fi->readx(&first, szb_info);
+            fi->seek(-(upx_off_t)szb_info, SEEK_CUR);
+            if (get_te32(&first.sz_unc) < wanted) {
+                unpackExtentBlocks(wanted, fo, c_adler, u_adler, first_PF_X,
+                    is_rewrite != 0, nslots);
+                return 0;
+            }
+        }
+    }
     b_info hdr; memset(&hdr, 0, sizeof(hdr));
     unsigned inlen = 0; // output index (if-and-only-if peeking)
     while (wanted) {
@@ -552,6 +701,149 @@ unsigned PackUnix::unpackExtent(unsigned wanted, OutputFile *fo,
     return inlen;
 }
 
+// Multi-threaded unpackExtent() for "--threads=N": read a wave of up to
+// nslots b_info blocks, decompress, unfilter and checksum them in parallel,
+// then combine the checksums and write the blocks in order.
+// A failure is remembered by its block and reported when that block is
+// reached in order, so the error (and any output written before it) is
+// the same as with the serial loop in unpackExtent().
+void PackUnix::unpackExtentBlocks(unsigned wanted, OutputFile *fo,
+    unsigned &c_adler, unsigned &u_adler,
+    bool first_PF_X, bool is_rewrite, unsigned nslots
+)
+{
+    struct Block final {
+        explicit Block() noexcept {}
+        b_info hdr;
+        unsigned sz_unc;
+        unsigned sz_cpr;
+        unsigned j;           // offset of the compressed data in buf
+        bool ancient_filter;  // per-file filter of old versions, see unpackExtent()
+        bool bad_end;         // mismatched end-of-block for "upx -t"
+        unsigned u_adler1;    // upx_adler32() of this block alone
+        unsigned c_adler1;
+        MemBuffer buf;
+        std::exception_ptr error;
+    };
+    // on the heap: this may run on a "-j" worker thread with a small stack
+    std::unique_ptr<Block[]> blocks(new Block[nslots]);
+
+    auto work = [&](unsigned slot) {
+        Block &b = blocks[slot];
+        if (b.error)
+            return;
+        try {
+            b.c_adler1 = upx_adler32(b.buf + b.j, b.sz_cpr);
+            if (b.sz_cpr < b.sz_unc) { // block was compressed
+                PackHeader bph = ph;
+                bph.u_len = b.sz_unc;
+                bph.c_len = b.sz_cpr;
+                bph.filter_cto = b.hdr.b_cto8;
+                ph_decompress(bph, b.buf + b.j, b.buf, false, nullptr);
+                if (12==szb_info) { // modern per-block filter
+                    if (b.hdr.b_ftid) {
+                        Filter ft(ph.level);
+                        ft.init(b.hdr.b_ftid, 0);
+                        ft.cto = b.hdr.b_cto8;
+                        ft.unfilter(b.buf, b.sz_unc);
+                    }
+                }
+                else if (b.ancient_filter) {
+                    Filter ft(ph.level);
+                    ft.init(ph.filter, 0);
+                    ft.cto = (unsigned char) ph.filter_cto;
+                    ft.unfilter(b.buf, b.sz_unc);
+                }
+            }
+            else { // slide literal (non-compressible) block
+                memmove(&b.buf[0], &b.buf[b.j], b.sz_unc);
+            }
+            b.u_adler1 = upx_adler32(b.buf, b.sz_unc);
+        }
+        catch (...) {
+            b.error = std::current_exception();
+        }
+    };
+
+    bool failed = false;
+    while (wanted && !failed) {
+        // read a wave of blocks; same checks as unpackExtent()
+        unsigned n = 0;
+        for (; n < nslots && wanted && !failed; n++) {
+            Block &b = blocks[n];
+            b.error = nullptr;
+            b.ancient_filter = false;
+            b.bad_end = false;
+            try {
+                memset(&b.hdr, 0, sizeof(b.hdr));
+                fi->readx(&b.hdr, szb_info);
+                int const sz_unc = ph.u_len = get_te32(&b.hdr.sz_unc);
+                int const sz_cpr = ph.c_len = get_te32(&b.hdr.sz_cpr);
+                ph.filter_cto = b.hdr.b_cto8;
+
+                if (sz_unc <= 0 || sz_cpr <= 0 || M_LZMA < b.hdr.b_method)
+                    throwCantUnpack("corrupt b_info");
+                if (sz_cpr > sz_unc || sz_unc > (int)blocksize)
+                    throwCantUnpack("corrupt b_info");
+
+                // place the input for overlapping de-compression
+                int const j = sz_unc + OVERHEAD - sz_cpr;
+                if (ibuf.getSize() < (unsigned)(j + sz_cpr)) {
+                    throwCantUnpack("corrupt b_info");
+                }
+                // sized by the block, not by blocksize (the largest PT_LOAD)
+                if (b.buf.getSize() < (unsigned)(j + sz_cpr)) {
+                    b.buf.dealloc();
+                    b.buf.alloc(j + sz_cpr);
+                }
+                fi->readx(b.buf + j, sz_cpr);
+                total_in += sz_cpr;
+                b.sz_unc = sz_unc;
+                b.sz_cpr = sz_cpr;
+                b.j = j;
+
+                if (sz_cpr < sz_unc && 12 != szb_info) {
+                    if (first_PF_X) // Elf32_Ehdr is never filtered
+                        first_PF_X = false;
+                    else
+                        b.ancient_filter = ph.filter != 0;
+                }
+                if (!fo && wanted < (unsigned)sz_unc) {
+                    b.bad_end = true;
+                    failed = true;
+                }
+                wanted -= sz_unc;
+            }
+            catch (...) {
+                b.error = std::current_exception();
+                failed = true;
+            }
+        }
+
+        upx::parallel_for(n, nslots, work);
+
+        // check and write the blocks in order
+        for (unsigned slot = 0; slot < n; slot++) {
+            Block &b = blocks[slot];
+            if (b.error)
+                std::rethrow_exception(b.error);
+            c_adler = upx_adler32_combine(c_adler, b.c_adler1, b.sz_cpr);
+            u_adler = upx_adler32_combine(u_adler, b.u_adler1, b.sz_unc);
+            if (fo) {
+                if (is_rewrite) {
+                    fo->rewrite(b.buf, b.sz_unc);
+                }
+                else {
+                    fo->write(b.buf, b.sz_unc);
+                    total_out += b.sz_unc;
+                }
+            }
+            else if (b.bad_end)
+                throwCantUnpack("corrupt b_info");
+        }
+    }
+}
+
 /*************************************************************************
 // Generic Unix canUnpack().
 **************************************************************************/
@@ -709,4 +1001,279 @@ void PackUnix::unpack(OutputFile *fo)
         throwChecksumError();
 }
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && (ACC_OS_POSIX) && !defined(__wasi__)
+
+#include "check/dt_data.h"
+
+namespace {
+// a temporary file that gets removed at the end of the test
+struct TestTempFile final {
+    char name[ACC_FN_PATH_MAX + 1];
+    explicit TestTempFile(const byte *data, unsigned len) {
+        const char *tmpdir = getenv("TMPDIR");
+        upx_safe_snprintf(name, sizeof(name), "%s/upx-test-unix-XXXXXX",
+                          (tmpdir && tmpdir[0]) ? tmpdir : "/tmp");
+        const int fd = ::mkstemp(name);
+        assert(fd >= 0);
+        const bool written = len == 0 || ::write(fd, data, len) == (ssize_t) len;
+        (void) ::close(fd);
+        assert(written);
+    }
+    ~TestTempFile() noexcept { (void) ::unlink(name); }
+    void read(MemBuffer &mb) const {
+        InputFile f;
+        f.open(name, O_RDONLY | O_BINARY);
+        mb.dealloc();
+        if (f.st_size() > 0) {
+            mb.alloc(f.st_size());
+            f.readx(mb, mb.getSize());
+        }
+        f.closex();
+    }
+};
+
+// just enough of a PackUnix to drive packExtent() and unpackExtent()
+class PackUnixTest final : public PackUnix {
+public:
+    explicit PackUnixTest(InputFile *f, unsigned bsize) : PackUnix(f) {
+        bele = &N_BELE_RTP::le_policy;
+        blocksize = bsize;
+        total_in = total_out = 0;
+        b_len = 0;
+    }
+    virtual int getFormat() const override { return UPX_F_LINUX_ELF_i386; }
+    virtual const char *getName() const override { return "test/unix"; }
+    virtual const char *getFullName(const Options *) const override { return "test-unix"; }
+    virtual const int *getCompressionMethods(int, int) const override {
+        static const int methods[] = {M_NRV2E_LE32, M_END};
+        return methods;
+    }
+
+    // pack the first "len" bytes of the input file as one extent, with
+    // "--split-blocks" if set; returns the checksums that unpacking must get
+    void packTest(OutputFile *fo, unsigned len, unsigned &c_adler, unsigned &u_adler) {
+        initPackHeader();
+        ph.method = M_NRV2E_LE32;
+        ph.level = 8;
+        ibuf.dealloc();
+        ibuf.alloc(blocksize);
+        obuf.dealloc();
+        obuf.allocForCompression(blocksize);
+        Extent x;
+        x.offset = 0;
+        x.size = len;
+        packExtent(x, nullptr, fo, 0, 0, true);
+        c_adler = ph.c_adler;
+        u_adler = ph.u_adler;
+    }
+
+    // unpack "wanted" bytes from the start of the input file; without "fo"
+    // this only checks the data, as "upx -t" does
+    void unpackTest(OutputFile *fo, unsigned wanted, unsigned &c_adler, unsigned &u_adler) {
+        ph.method = M_NRV2E_LE32;
+        ph.level = 8;
+        ibuf.dealloc();
+        ibuf.alloc(blocksize + OVERHEAD);
+        fi->seek(0, SEEK_SET);
+        c_adler = u_adler = upx_adler32(nullptr, 0);
+        unpackExtent(wanted, fo, c_adler, u_adler, false);
+    }
+
+protected:
+    virtual void buildLoader(const Filter *) override {}
+    virtual Linker *newLinker() const override { return nullptr; }
+    virtual void patchLoader() override {}
+    virtual void updateLoader(OutputFile *) override {}
+};
+
+// unpack "packed" with "threads" threads; returns the output and the checksums
+void unpack_test(const TestTempFile &packed, unsigned wanted, unsigned bsize, int threads,
+                 MemBuffer &out, unsigned &c_adler, unsigned &u_adler, bool &failed) {
+    opt->threads = threads;
+    TestTempFile unpacked(nullptr, 0);
+    InputFile fi;
+    fi.open(packed.name, O_RDONLY | O_BINARY);
+    OutputFile fo;
+    fo.open(unpacked.name, O_WRONLY | O_TRUNC | O_BINARY, 0600);
+    failed = false;
+    c_adler = u_adler = 0;
+    try {
+        PackUnixTest p(&fi, bsize);
+        p.unpackTest(&fo, wanted, c_adler, u_adler);
+    } catch (const CantUnpackException &) {
+        failed = true;
+    }
+    fo.closex();
+    fi.closex();
+    unpacked.read(out);
+}
+// pack "data" with "threads" threads; returns the output and the checksums
+void pack_test(const byte *data, unsigned len, unsigned bsize, int threads, MemBuffer &out,
+               unsigned &c_adler, unsigned &u_adler) {
+    opt->threads = threads;
+    const TestTempFile unpacked(data, len);
+    TestTempFile packed(nullptr, 0);
+    InputFile fi;
+    fi.open(unpacked.name, O_RDONLY | O_BINARY);
+    OutputFile fo;
+    fo.open(packed.name, O_WRONLY | O_TRUNC | O_BINARY, 0600);
+    {
+        PackUnixTest p(&fi, bsize);
+        p.packTest(&fo, len, c_adler, u_adler);
+    }
+    fo.closex();
+    fi.closex();
+    packed.read(out);
+}
+} // namespace
+
+TEST_CASE("PackUnix::packExtentBlocks") {
+#if WITH_THREADS
+    std::lock_guard<std::mutex> lock(opt_lock_mutex);
+#endif
+    Options *const saved_opt = opt;
+    Options local_options;
+    opt = &local_options;
+    opt->reset();
+    opt->cmd = CMD_COMPRESS;
+    opt->verbose = -1;
+    constexpr unsigned SPLIT = 4096, BSIZE = 4 * SPLIT, SZB_INFO = 12;
+    opt->o_unix.split_blocksize = SPLIT;
+
+    constexpr unsigned max_len = 5 * SPLIT;
+    MemBuffer data(max_len);
+    upx::testdata::Rng rng(3);
+    for (unsigned i = 0; i < max_len; i++)
+        data[i] = (byte) (rng.next() >> 29); // compressible
+    // exact multiple, remainder, one short block, one full block
+    for (const unsigned len : {4 * SPLIT, 4 * SPLIT + 100, 1000u, SPLIT}) {
+        const unsigned nblocks = (len + SPLIT - 1) / SPLIT;
+        MemBuffer packed1, packed3;
+        unsigned c1, u1, c3, u3;
+        pack_test(data, len, BSIZE, 1, packed1, c1, u1);
+        pack_test(data, len, BSIZE, 3, packed3, c3, u3);
+        // the output does not depend on the number of threads
+        CHECK(packed1.getSize() == packed3.getSize());
+        CHECK(memcmp(packed1, packed3, packed1.getSize()) == 0);
+        CHECK((c1 == c3 && u1 == u3));
+        CHECK(u1 == upx_adler32(data, len));
+
+        // b_info layout: full blocks, then the remainder
+        const byte *p = packed1;
+        const byte *const end = p + packed1.getSize();
+        unsigned n = 0, total = 0;
+        while (p + SZB_INFO <= end) {
+            const unsigned sz_unc = get_le32(p);
+            const unsigned sz_cpr = get_le32(p + 4);
+            CHECK(sz_unc == UPX_MIN(SPLIT, len - total));
+            CHECK((sz_cpr > 0 && sz_cpr < sz_unc)); // compressed
+            CHECK(p[8] == M_NRV2E_LE32);            // b_method
+            CHECK(p[9] == 0);                       // b_ftid
+            p += SZB_INFO + sz_cpr;
+            total += sz_unc;
+            n += 1;
+        }
+        CHECK(p == end);
+        CHECK(n == nblocks);
+        CHECK(total == len);
+
+        // unpackExtent() round trip, serial and in parallel
+        const TestTempFile f(packed1, packed1.getSize());
+        opt->cmd = CMD_DECOMPRESS;
+        for (int threads : {1, 3}) {
+            MemBuffer out;
+            unsigned c, u;
+            bool failed;
+            unpack_test(f, len, BSIZE, threads, out, c, u, failed);
+            CHECK(!failed);
+            CHECK((c == c1 && u == u1));
+            CHECK(out.getSize() == len);
+            CHECK(memcmp(out, data, len) == 0);
+        }
+        opt->cmd = CMD_COMPRESS;
+    }
+
+    opt = saved_opt;
+}
+
+TEST_CASE("PackUnix::unpackExtent threads") {
+#if WITH_THREADS
+    std::lock_guard<std::mutex> lock(opt_lock_mutex);
+#endif
+    Options *const saved_opt = opt;
+    Options local_options;
+    opt = &local_options;
+    opt->reset();
+    opt->cmd = CMD_DECOMPRESS;
+
+    // five stored blocks; "--threads=3" unpacks them in two waves
+    constexpr unsigned NBLOCKS = 5, BLOCK = 1000, SZB_INFO = 12;
+    constexpr unsigned size = NBLOCKS * (SZB_INFO + BLOCK);
+    byte packed[size];
+    byte data[NBLOCKS * BLOCK];
+    for (unsigned i = 0; i < NBLOCKS * BLOCK; i++)
+        data[i] = (byte) (i * 7 + (i >> 8));
+    for (unsigned k = 0; k < NBLOCKS; k++) {
+        byte *const b = packed + k * (SZB_INFO + BLOCK);
+        memset(b, 0, SZB_INFO);
+        set_le32(b, BLOCK);     // sz_unc
+        set_le32(b + 4, BLOCK); // sz_cpr
+        memcpy(b + SZB_INFO, data + k * BLOCK, BLOCK);
+    }
+    const unsigned want_adler = upx_adler32(data, sizeof(data));
+
+    MemBuffer out1, out3;
+    unsigned c1, u1, c3, u3;
+    bool failed1, failed3;
+    {
+        const TestTempFile f(packed, size);
+        unpack_test(f, sizeof(data), BLOCK, 1, out1, c1, u1, failed1);
+        unpack_test(f, sizeof(data), BLOCK, 3, out3, c3, u3, failed3);
+        CHECK((!failed1 && !failed3));
+        CHECK(u1 == want_adler);
+        CHECK(c1 == want_adler);
+        CHECK((u3 == u1 && c3 == c1));
+        CHECK(out1.getSize() == sizeof(data));
+        CHECK(out3.getSize() == sizeof(data));
+        CHECK(memcmp(out1, data, sizeof(data)) == 0);
+        CHECK(memcmp(out3, data, sizeof(data)) == 0);
+    }
+
+    // a changed byte in a middle block gives the same wrong checksums
+    packed[2 * (SZB_INFO + BLOCK) + SZB_INFO + 10] ^= 1;
+    {
+        const TestTempFile f(packed, size);
+        unpack_test(f, sizeof(data), BLOCK, 1, out1, c1, u1, failed1);
+        unpack_test(f, sizeof(data), BLOCK, 3, out3, c3, u3, failed3);
+        CHECK((!failed1 && !failed3));
+        CHECK(u1 != want_adler);
+        CHECK(c1 != want_adler);
+        CHECK((u3 == u1 && c3 == c1));
+        CHECK(out1.getSize() == out3.getSize());
+        CHECK(memcmp(out1, out3, out1.getSize()) == 0);
+    }
+    packed[2 * (SZB_INFO + BLOCK) + SZB_INFO + 10] ^= 1;
+
+    // a corrupt b_info in a middle block: same error, same output before it
+    set_le32(packed + 3 * (SZB_INFO + BLOCK), BLOCK + 1); // sz_unc > blocksize
+    {
+        const TestTempFile f(packed, size);
+        unpack_test(f, sizeof(data), BLOCK, 1, out1, c1, u1, failed1);
+        unpack_test(f, sizeof(data), BLOCK, 3, out3, c3, u3, failed3);
+        CHECK((failed1 && failed3));
+        CHECK(out1.getSize() == 3 * BLOCK);
+        CHECK(out3.getSize() == 3 * BLOCK);
+        CHECK(memcmp(out1, data, 3 * BLOCK) == 0);
+        CHECK(memcmp(out3, data, 3 * BLOCK) == 0);
+    }
+
+    opt = saved_opt;
+}
+
+#endif // DEBUG
+
 /* vim:set ts=4 sw=4 et: */
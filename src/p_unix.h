@@ -83,11 +83,16 @@ protected:
         Filter *, OutputFile *,
         unsigned hdr_len = 0, unsigned b_extra = 0 ,
         bool inhibit_compression_check = false);
+    virtual void packExtentBlocks(upx_off_t rest, const Filter *, OutputFile *,
+        unsigned b_extra, unsigned split_blocksize);
     virtual unsigned unpackExtent(unsigned wanted, OutputFile *fo,
         unsigned &c_adler, unsigned &u_adler,
         bool first_PF_X,
         int is_rewrite = false  // 0(false): write; 1(true): rewrite; -1: no write
         );
+    virtual void unpackExtentBlocks(unsigned wanted, OutputFile *fo,
+        unsigned &c_adler, unsigned &u_adler,
+        bool first_PF_X, bool is_rewrite, unsigned nslots);
     unsigned total_in, total_out;  // unpack
 
     int exetype;  // 0: unknown; 1: ELF; 2: pre-ELF; -1: /bin/sh; -2: Java
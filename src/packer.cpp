@@ -31,6 +31,10 @@
 #include "filter.h"
 #include "linker.h"
 #include "ui.h"
+#include "util/cache.h"
+#include "util/parallel.h"
+#include "util/stats.h"
+#include "util/winners.h"
 
 /*************************************************************************
 //
@@ -152,20 +156,30 @@ bool Packer::testUnpackFormat(int format) const {
 **************************************************************************/
 
 bool Packer::compress(SPAN_P(byte) i_ptr, unsigned i_len, SPAN_P(byte) o_ptr,
-                      const upx_compress_config_t *cconf_parm) {
-    ph.u_len = i_len;
-    ph.c_len = 0;
-    assert(ph.level >= 1);
-    assert(ph.level <= 10);
+                      const upx_compress_config_t *cconf_parm, const upx_callback_t *budget) {
+    return compress(ph, i_ptr, i_len, o_ptr, cconf_parm, uip, budget);
+}
+
+// same as above, but only updates "cph"; this can safely be called from
+// worker threads if "cuip" is nullptr [see compressWithFilters()]
+// If "budget" is given and the compressor gives up early (UPX_E_ABORTED)
+// then this returns false, just like for data that is not compressible.
+bool Packer::compress(PackHeader &cph, SPAN_P(byte) i_ptr, unsigned i_len, SPAN_P(byte) o_ptr,
+                      const upx_compress_config_t *cconf_parm, UiPacker *cuip,
+                      const upx_callback_t *budget) const {
+    cph.u_len = i_len;
+    cph.c_len = 0;
+    assert(cph.level >= 1);
+    assert(cph.level <= 10);
 
     // Avoid too many progress bar updates. 64 is s->bar_len in ui.cpp.
-    unsigned step = (ph.u_len < 64 * 1024) ? 0 : ph.u_len / 64;
+    unsigned step = (cph.u_len < 64 * 1024) ? 0 : cph.u_len / 64;
 
     // save current checksums
-    ph.saved_u_adler = ph.u_adler;
-    ph.saved_c_adler = ph.c_adler;
+    cph.saved_u_adler = cph.u_adler;
+    cph.saved_c_adler = cph.c_adler;
     // update checksum of uncompressed data
-    ph.u_adler = upx_adler32(raw_bytes(i_ptr, ph.u_len), ph.u_len, ph.u_adler);
+    cph.u_adler = upx_adler32(raw_bytes(i_ptr, cph.u_len), cph.u_len, cph.u_adler);
 
     // set compression parameters
     upx_compress_config_t cconf;
@@ -173,7 +187,7 @@ bool Packer::compress(SPAN_P(byte) i_ptr, unsigned i_len, SPAN_P(byte) o_ptr,
     if (cconf_parm)
         cconf = *cconf_parm;
     // cconf options
-    int method = ph_forced_method(ph.method);
+    int method = ph_forced_method(cph.method);
     if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method)) {
         if (opt->crp.crp_ucl.c_flags != -1)
             cconf.conf_ucl.c_flags = opt->crp.crp_ucl.c_flags;
@@ -188,7 +202,7 @@ bool Packer::compress(SPAN_P(byte) i_ptr, unsigned i_len, SPAN_P(byte) o_ptr,
             opt->crp.crp_ucl.max_match < cconf.conf_ucl.max_match)
             cconf.conf_ucl.max_match = opt->crp.crp_ucl.max_match;
 #if (WITH_NRV)
-        if ((ph.level >= 7 || (ph.level >= 4 && ph.u_len >= 512 * 1024)) && !opt->prefer_ucl)
+        if ((cph.level >= 7 || (cph.level >= 4 && cph.u_len >= 512 * 1024)) && !opt->prefer_ucl)
             step = 0;
 #endif
     }
@@ -204,67 +218,89 @@ bool Packer::compress(SPAN_P(byte) i_ptr, unsigned i_len, SPAN_P(byte) o_ptr,
         upx::oassign(cconf.conf_zlib.window_bits, opt->crp.crp_zlib.window_bits);
         upx::oassign(cconf.conf_zlib.strategy, opt->crp.crp_zlib.strategy);
     }
-    if (uip->ui_pass >= 0)
-        uip->ui_pass++;
-    uip->startCallback(ph.u_len, step, uip->ui_pass, uip->ui_total_passes);
-    uip->firstCallback();
+    if (cuip != nullptr) {
+        if (cuip->ui_pass >= 0)
+            cuip->ui_pass++;
+        cuip->startCallback(cph.u_len, step, cuip->ui_pass, cuip->ui_total_passes);
+        cuip->firstCallback();
+    }
 
-    // OutputFile::dump("data.raw", in, ph.u_len);
+    // progress callback plus optional budget
+    upx_callback_t cb;
+    upx_callback_t *cbp = cuip ? cuip->getCallback() : nullptr;
+    if (budget != nullptr && (budget->max_out != 0 || budget->max_projected != 0)) {
+        cb.reset();
+        if (cbp != nullptr)
+            cb = *cbp;
+        cb.max_out = budget->max_out;
+        cb.max_projected = budget->max_projected;
+        cb.min_in = budget->min_in;
+        cbp = &cb;
+    }
+
+    // OutputFile::dump("data.raw", in, cph.u_len);
 
     // compress
-    int r = upx_compress(raw_bytes(i_ptr, ph.u_len), ph.u_len, raw_bytes(o_ptr, 0), &ph.c_len,
-                         uip->getCallback(), method, ph.level, &cconf, &ph.compress_result);
+    int r = upx_compress(raw_bytes(i_ptr, cph.u_len), cph.u_len, raw_bytes(o_ptr, 0), &cph.c_len,
+                         cbp, method, cph.level, &cconf, &cph.compress_result);
 
-    // uip->finalCallback(ph.u_len, ph.c_len);
-    uip->endCallback();
+    // cuip->finalCallback(cph.u_len, cph.c_len);
+    if (cuip != nullptr)
+        cuip->endCallback();
 
     if (r == UPX_E_OUT_OF_MEMORY)
         throwOutOfMemoryException();
+    if (r == UPX_E_ABORTED) {
+        assert(cbp == &cb);
+        NO_printf("\nPacker::compress: %d/%d: %7d -> aborted\n", method, cph.level, cph.u_len);
+        return false;
+    }
     if (r != UPX_E_OK)
         throwInternalError("compression failed");
 
     if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method)) {
-        const ucl_uint *res = ph.compress_result.result_ucl.result;
-        // ph.min_offset_found = res[0];
-        ph.max_offset_found = res[1];
-        // ph.min_match_found = res[2];
-        ph.max_match_found = res[3];
-        // ph.min_run_found = res[4];
-        ph.max_run_found = res[5];
-        ph.first_offset_found = res[6];
-        // ph.same_match_offsets_found = res[7];
+        const ucl_uint *res = cph.compress_result.result_ucl.result;
+        // cph.min_offset_found = res[0];
+        cph.max_offset_found = res[1];
+        // cph.min_match_found = res[2];
+        cph.max_match_found = res[3];
+        // cph.min_run_found = res[4];
+        cph.max_run_found = res[5];
+        cph.first_offset_found = res[6];
+        // cph.same_match_offsets_found = res[7];
         if (cconf_parm) {
             assert(cconf.conf_ucl.max_offset == 0 ||
-                   cconf.conf_ucl.max_offset >= ph.max_offset_found);
-            assert(cconf.conf_ucl.max_match == 0 || cconf.conf_ucl.max_match >= ph.max_match_found);
+                   cconf.conf_ucl.max_offset >= cph.max_offset_found);
+            assert(cconf.conf_ucl.max_match == 0 ||
+                   cconf.conf_ucl.max_match >= cph.max_match_found);
         }
     }
 
-    NO_printf("\nPacker::compress: %d/%d: %7d -> %7d\n", method, ph.level, ph.u_len, ph.c_len);
-    if (!checkCompressionRatio(ph.u_len, ph.c_len))
+    NO_printf("\nPacker::compress: %d/%d: %7d -> %7d\n", method, cph.level, cph.u_len, cph.c_len);
+    if (!checkCompressionRatio(cph.u_len, cph.c_len))
         return false;
     // return in any case if not compressible
-    if (ph.c_len >= ph.u_len)
+    if (cph.c_len >= cph.u_len)
         return false;
 
     // update checksum of compressed data
-    ph.c_adler = upx_adler32(raw_bytes(o_ptr, ph.c_len), ph.c_len, ph.c_adler);
+    cph.c_adler = upx_adler32(raw_bytes(o_ptr, cph.c_len), cph.c_len, cph.c_adler);
     // Decompress and verify. Skip this when using the fastest level.
-    if (!ph_skipVerify(ph)) {
+    if (!ph_skipVerify(cph)) {
         // decompress
-        unsigned new_len = ph.u_len;
-        r = upx_decompress(raw_bytes(o_ptr, ph.c_len), ph.c_len, raw_bytes(i_ptr, ph.u_len),
-                           &new_len, method, &ph.compress_result);
+        unsigned new_len = cph.u_len;
+        r = upx_decompress(raw_bytes(o_ptr, cph.c_len), cph.c_len, raw_bytes(i_ptr, cph.u_len),
+                           &new_len, method, &cph.compress_result);
         if (r == UPX_E_OUT_OF_MEMORY)
             throwOutOfMemoryException();
-        // printf("%d %d: %d %d %d\n", method, r, ph.c_len, ph.u_len, new_len);
+        // printf("%d %d: %d %d %d\n", method, r, cph.c_len, cph.u_len, new_len);
         if (r != UPX_E_OK)
             throwInternalError("decompression failed");
-        if (new_len != ph.u_len)
+        if (new_len != cph.u_len)
             throwInternalError("decompression failed (size error)");
 
         // verify decompression
-        if (ph.u_adler != upx_adler32(raw_bytes(i_ptr, ph.u_len), ph.u_len, ph.saved_u_adler))
+        if (cph.u_adler != upx_adler32(raw_bytes(i_ptr, cph.u_len), cph.u_len, cph.saved_u_adler))
             throwInternalError("decompression failed (checksum error)");
     }
     return true;
@@ -318,6 +354,7 @@ bool Packer::testOverlappingDecompression(const byte *buf, const byte *tbuf,
 void Packer::verifyOverlappingDecompression(Filter *ft) {
     assert(ph.c_len < ph.u_len);
     assert((int) ph.overlap_overhead > 0);
+    upx::PhaseTimer timer(upx::STATS_VERIFY);
     // Idea:
     //   obuf[] was allocated with MemBuffer::allocForCompression(), and
     //   its contents are no longer needed, i.e. the compressed data
@@ -346,6 +383,7 @@ void Packer::verifyOverlappingDecompression(Filter *ft) {
 void Packer::verifyOverlappingDecompression(byte *o_ptr, unsigned o_size, Filter *ft) {
     assert(ph.c_len < ph.u_len);
     assert((int) ph.overlap_overhead > 0);
+    upx::PhaseTimer timer(upx::STATS_VERIFY);
     if (ph_skipVerify(ph))
         return;
     unsigned offset = (ph.u_len + ph.overlap_overhead) - ph.c_len;
@@ -356,8 +394,9 @@ void Packer::verifyOverlappingDecompression(byte *o_ptr, unsigned o_size, Filter
 }
 
 /*************************************************************************
-// Find overhead for in-place decompression in a heuristic way
-// (using a binary search). Return 0 on error.
+// Find overhead for in-place decompression. If the compression method
+// supports it the exact minimum is computed in a single decompression
+// pass, otherwise we fall back to a heuristic way (using a binary search).
 //
 // To speed up things:
 //   - you can pass the range of an acceptable interval (so that
@@ -368,6 +407,7 @@ void Packer::verifyOverlappingDecompression(byte *o_ptr, unsigned o_size, Filter
 unsigned Packer::findOverlapOverhead(const byte *buf, const byte *tbuf, unsigned range,
                                      unsigned upper_limit) const {
     assert((int) range >= 0);
+    upx::PhaseTimer timer(upx::STATS_OVERLAP);
 
     // prepare to deal with very pessimistic values
     unsigned low = 1;
@@ -378,6 +418,15 @@ unsigned Packer::findOverlapOverhead(const byte *buf, const byte *tbuf, unsigned
     unsigned overhead = 0;
     unsigned nr = 0; // statistics
 
+    // try the single-pass query first; the result still gets verified
+    // once by testOverlappingDecompression() which may be overridden
+    const unsigned exact = ph_minOverlapOverhead(ph, buf);
+    if (exact >= low && exact <= high) {
+        nr++;
+        if (testOverlappingDecompression(buf, tbuf, exact))
+            return exact;
+    }
+
     while (high >= low) {
         assert(m >= low);
         assert(m <= high);
@@ -812,6 +861,47 @@ int Packer::getLoaderSize() const {
     return size;
 }
 
+/*virtual*/ bool Packer::addLoaderMemoKey(upx::CacheKeyHasher &, const Filter *) const {
+    return false;
+}
+
+// buildLoader() + getLoaderSize(), but reuse the size of an earlier loader
+// with the same key. Note that on a hit the linker still holds the previous
+// loader, so callers that need the loader itself must call buildLoader().
+unsigned Packer::getLoaderSizeMemo(const Filter *ft) {
+    upx::CacheKeyHasher h;
+    h.add_u32(ph.format);
+    h.add_u32(ph.method);
+    h.add_u32(ph.filter);
+    h.add_u32(ph.filter_cto);
+    h.add_u32(ft->id);
+    h.add_u32(ft->cto);
+    h.add_u32(ft->n_mru);
+    h.add_u32(ft->addvalue);
+    h.add_u32(ft->calls != 0);
+    const bool use_memo = addLoaderMemoKey(h, ft);
+    const upx::CacheKey key = h.finish();
+    if (use_memo) {
+        for (unsigned i = 0; i < loader_memo_count; i++) {
+            const LoaderMemo &m = loader_memo[i];
+            if (m.key[0] == key.h[0] && m.key[1] == key.h[1]) {
+                loader_memo_hits += 1;
+                return m.lsize;
+            }
+        }
+    }
+    upx::PhaseTimer timer(upx::STATS_LOADER);
+    buildLoader(ft);
+    const unsigned lsize = getLoaderSize();
+    if (use_memo && loader_memo_count < MAX_LOADER_MEMO) {
+        LoaderMemo &m = loader_memo[loader_memo_count++];
+        m.key[0] = key.h[0];
+        m.key[1] = key.h[1];
+        m.lsize = lsize;
+    }
+    return lsize;
+}
+
 bool Packer::hasLoaderSection(const char *name) const {
     void *section = linker->findSection(name, false);
     return section != nullptr;
@@ -839,6 +929,7 @@ int Packer::getLoaderSectionStart(const char *name, int *slen) const {
 }
 
 void Packer::relocateLoader() {
+    upx::PhaseTimer timer(upx::STATS_LOADER);
     linker->relocate();
 
 #if 0
@@ -1028,6 +1119,7 @@ void Packer::compressWithFilters(byte *i_ptr,
     best_ph.overlap_overhead = 0;
     unsigned best_ph_lsize = 0;
     unsigned best_hdr_c_len = 0;
+    unsigned best_pos = ~0u; // position of the best candidate in the default order
 
     // preconditions
     assert(orig_ph.filter == 0);
@@ -1062,118 +1154,560 @@ void Packer::compressWithFilters(byte *i_ptr,
             uip->ui_total_passes += nfilters * nmethods;
     }
 
-    // Working buffer for compressed data. Don't waste memory and allocate as needed.
-    byte *o_tmp = o_ptr;
-    MemBuffer o_tmp_buf;
+    // filters get restored from an undo log instead of a full unfilter pass,
+    // see verify_best_filter below
+    FilterUndoLog undo_log;
+
+    // "--cache-dir": the key covers the input and everything that influences
+    // the choice of the best method and filter, so a cache hit gives exactly
+    // the result of a full search; the buildLoader() results are assumed
+    // to depend only on the packer and on ph.
+    // Entries get verified by decompressing them, see cache_lookup() below.
+    const bool use_early_stop = opt->winner_stats != nullptr && opt->early_stop >= 0;
+    const bool use_cache = opt->cache_dir != nullptr && cconf == nullptr &&
+                           !opt->debug.use_random_filter && !use_early_stop &&
+                           (f_len == 0 || (f_ptr >= i_ptr && f_ptr + f_len <= i_ptr + i_len));
+    upx::CacheKey cache_key = {};
+    if (use_cache) {
+        upx::CacheKeyHasher h;
+        h.add_str("compressWithFilters");
+        h.add_u32(UPX_VERSION_HEX);
+        h.add_str(getName());
+        h.add_u32(orig_ph.version);
+        h.add_u32(orig_ph.format);
+        h.add_u32(orig_ph.method);
+        h.add_u32(orig_ph.level);
+        h.add_u32(orig_ft.addvalue);
+        for (const int *p = orig_ft.preferred_ctos; p != nullptr && *p >= 0; p++)
+            h.add_u32(*p);
+        h.add_u32(f_len ? ptr_udiff(f_ptr, i_ptr) : 0);
+        h.add_u32(f_len);
+        h.add_u32(overlap_range);
+        h.add_u32(filter_strategy);
+        h.add_u32(inhibit_compression_check);
+        h.add_u32(opt->prune_filters);
+        h.add_u32(opt->abort_margin);
+        // options that select the methods, filters and level; see prepareMethods(),
+        // prepareFilters() and compress() above
+        for (int v : {opt->method, opt->level, opt->small, opt->filter, opt->all_methods_use_lzma,
+                      int(opt->all_methods), int(opt->all_filters), int(opt->no_filter),
+                      int(opt->ultra_brute), int(opt->prefer_ucl)})
+            h.add_u32(v);
+#if (WITH_NRV)
+        h.add_str("nrv"); // NRV builds compress differently, see compress() above
+#endif
+        for (int mm = 0; mm < nmethods; mm++)
+            h.add_u32(methods[mm]);
+        h.add_u32(M_END);
+        for (int ff = 0; ff < nfilters; ff++)
+            h.add_u32(filters[ff]);
+        h.add_u32(FT_END);
+        // compression runtime parameters, see compress() above
+        h.add(&opt->crp.crp_ucl, sizeof(opt->crp.crp_ucl));
+        const auto &lz = opt->crp.crp_lzma;
+        for (unsigned v : {unsigned(lz.pos_bits), unsigned(lz.lit_pos_bits),
+                           unsigned(lz.lit_context_bits), unsigned(lz.dict_size), lz.fast_mode,
+                           unsigned(lz.num_fast_bytes), lz.match_finder_cycles, lz.max_num_probs})
+            h.add_u32(v);
+        const auto &zl = opt->crp.crp_zlib;
+        for (unsigned v :
+             {unsigned(zl.mem_level), unsigned(zl.window_bits), unsigned(zl.strategy)})
+            h.add_u32(v);
+        h.add_u32(hdr_ptr != nullptr ? hdr_len : 0);
+        if (hdr_ptr != nullptr && hdr_len)
+            h.add(hdr_ptr, hdr_len);
+        h.add_u32(i_len);
+        h.add(i_ptr, i_len);
+        cache_key = h.finish();
+    }
+    // cache entry: 12 x LE32, ph.compress_result, compressed data
+    constexpr unsigned CACHE_ENTRY_HEADER = 12 * 4;
+    constexpr unsigned CACHE_ENTRY_CR_SIZE = usizeof(ph.compress_result);
+
+    // on a cache hit: redo the filter of the cached winner, check that the
+    // cached data decompresses to the filtered input, and make it the best result
+    auto cache_lookup = [&]() -> bool {
+        MemBuffer entry;
+        if (!upx::cache_load(opt->cache_dir, cache_key, entry))
+            return false;
+        const byte *const e = entry;
+        const unsigned c_len = get_le32(e + 16);
+        if (entry.getSize() < CACHE_ENTRY_HEADER || get_le32(e + 40) != CACHE_ENTRY_CR_SIZE ||
+            c_len == 0 || c_len >= i_len || get_le32(e + 20) == 0 ||
+            entry.getSize() != CACHE_ENTRY_HEADER + CACHE_ENTRY_CR_SIZE + c_len)
+            return false;
+        const int method = get_le32(e);
+        const int filter = get_le32(e + 4);
+        bool found_method = false, found_filter = false;
+        for (int mm = 0; mm < nmethods; mm++)
+            found_method |= methods[mm] == method;
+        for (int ff = 0; ff < nfilters; ff++)
+            found_filter |= filters[ff] == filter;
+        if (!found_method || !found_filter)
+            return false;
+        ph = orig_ph;
+        ph.method = method;
+        ph.filter = filter;
+        ph.overlap_overhead = 0;
+        Filter ft = orig_ft;
+        ft.init(ph.filter, orig_ft.addvalue);
+        optimizeFilter(&ft, f_ptr, f_len);
+        if (!ft.filter(f_ptr, f_len))
+            return false;
+        if (ft.id != 0 && ft.calls == 0)
+            return false; // filter did not do anything - no need to call ft.undo()
+        bool ok = ft.cto == get_le32(e + 8) && ft.n_mru == get_le32(e + 12);
+        if (ok) {
+            // same as compress(), but with the cached data
+            ph.filter_cto = ft.cto;
+            ph.n_mru = ft.n_mru;
+            ph.u_len = i_len;
+            ph.c_len = c_len;
+            ph.saved_u_adler = ph.u_adler;
+            ph.saved_c_adler = ph.c_adler;
+            ph.u_adler = upx_adler32(i_ptr, i_len, ph.u_adler);
+            memcpy(&ph.compress_result, e + CACHE_ENTRY_HEADER, CACHE_ENTRY_CR_SIZE);
+            ph.max_offset_found = get_le32(e + 24);
+            ph.max_match_found = get_le32(e + 28);
+            ph.max_run_found = get_le32(e + 32);
+            ph.first_offset_found = get_le32(e + 36);
+            const byte *const c_ptr = e + CACHE_ENTRY_HEADER + CACHE_ENTRY_CR_SIZE;
+            MemBuffer vbuf(i_len);
+            unsigned new_len = i_len;
+            int r = upx_decompress(c_ptr, c_len, raw_bytes(vbuf, i_len), &new_len,
+                                   ph_forced_method(ph.method), &ph.compress_result);
+            ok = r == UPX_E_OK && new_len == i_len && memcmp(vbuf, i_ptr, i_len) == 0;
+            if (ok) {
+                memcpy(o_ptr, c_ptr, c_len);
+                ph.c_adler = upx_adler32(o_ptr, c_len, ph.c_adler);
+                ph.overlap_overhead = get_le32(e + 20);
+                upx::PhaseTimer timer(upx::STATS_LOADER);
+                buildLoader(&ft);
+                best_ph = ph;
+                best_ph_lsize = getLoaderSize();
+                best_ft = ft;
+                best_ft.buf = f_ptr;
+                best_ft.undo_log = nullptr;
+            }
+        }
+        ft.undo();
+        return ok;
+    };
+    auto cache_store = [&]() {
+        MemBuffer entry(CACHE_ENTRY_HEADER + CACHE_ENTRY_CR_SIZE + best_ph.c_len);
+        entry.clear();
+        byte *const e = entry;
+        set_le32(e, best_ph.method);
+        set_le32(e + 4, best_ph.filter);
+        set_le32(e + 8, best_ft.cto);
+        set_le32(e + 12, best_ft.n_mru);
+        set_le32(e + 16, best_ph.c_len);
+        set_le32(e + 20, best_ph.overlap_overhead);
+        set_le32(e + 24, best_ph.max_offset_found);
+        set_le32(e + 28, best_ph.max_match_found);
+        set_le32(e + 32, best_ph.max_run_found);
+        set_le32(e + 36, best_ph.first_offset_found);
+        set_le32(e + 40, CACHE_ENTRY_CR_SIZE);
+        memcpy(e + CACHE_ENTRY_HEADER, &best_ph.compress_result, CACHE_ENTRY_CR_SIZE);
+        memcpy(e + CACHE_ENTRY_HEADER + CACHE_ENTRY_CR_SIZE, o_ptr, best_ph.c_len);
+        upx::cache_store(opt->cache_dir, cache_key, e, entry.getSize());
+    };
+    const bool cache_hit = use_cache && cache_lookup();
+    if (!cache_hit)
+        ph = orig_ph; // cache_lookup() may have changed ph
+
+    // "--winner-stats": try the methods and filters that did win most often
+    // first. Equally good results are still decided by the position of the
+    // candidate in the default order, so the order alone does not change
+    // the result; only "--early-stop" does.
+    const char *const ws_kind = nfilters >= 2 ? "code" : "data";
+    int method_pos[MAX_METHODS];
+    int filter_pos[MAX_FILTERS];
+    for (int mm = 0; mm < nmethods; mm++)
+        method_pos[mm] = mm;
+    for (int ff = 0; ff < nfilters; ff++)
+        filter_pos[ff] = ff;
+    unsigned early_stop_c_len = 0; // stop the search once best_ph.c_len <= early_stop_c_len
+    if (opt->winner_stats != nullptr && !cache_hit) {
+        // stable insertion sort, most wins first
+        auto rank = [](int *ids, int *pos, unsigned *wins, int n) {
+            for (int i = 1; i < n; i++)
+                for (int j = i; j > 0 && wins[j] > wins[j - 1]; j--) {
+                    std::swap(ids[j], ids[j - 1]);
+                    std::swap(pos[j], pos[j - 1]);
+                    std::swap(wins[j], wins[j - 1]);
+                }
+        };
+        unsigned wins[MAX_METHODS + MAX_FILTERS];
+        for (int mm = 0; mm < nmethods; mm++)
+            wins[mm] = upx::winner_stats_method_wins(getName(), ws_kind, methods[mm]);
+        rank(methods, method_pos, wins, nmethods);
+        if (filter_strategy >= 0) { // else the first working filter is used
+            for (int ff = 0; ff < nfilters; ff++)
+                wins[ff] = upx::winner_stats_filter_wins(getName(), ws_kind, filters[ff]);
+            rank(filters, filter_pos, wins, nfilters);
+        }
+        if (use_early_stop) {
+            const upx_uint64_t ppm = upx::winner_stats_best_ppm(getName(), ws_kind);
+            early_stop_c_len = unsigned(i_len * ppm * (100 - opt->early_stop) / 100000000);
+        }
+    }
+    auto early_stop = [&]() -> bool {
+        return early_stop_c_len != 0 && best_ph.overlap_overhead > 0 &&
+               best_ph.c_len <= early_stop_c_len;
+    };
+    if (cache_hit && uip->ui_pass >= 0)
+        uip->ui_pass += filter_strategy < 0 ? nmethods : nmethods * nfilters;
+
+    // optional pre-pass: estimate the compressed size of each filter variant
+    // and prune those that are far worse than the best estimate
+    unsigned filter_est[MAX_FILTERS] = {}; // 0 means "not estimated"
+    bool filter_pruned[MAX_FILTERS] = {};
+    if (!cache_hit && opt->prune_filters >= 0 && filter_strategy >= 0 && nfilters >= 3 &&
+        !ph_is_forced_method(ph.method)) {
+        unsigned best_est = 0;
+        for (int ff = 0; ff < nfilters; ff++) {
+            Filter ft = orig_ft;
+            ft.init(filters[ff], orig_ft.addvalue);
+            ft.undo_log = &undo_log;
+            optimizeFilter(&ft, f_ptr, f_len);
+            if (!ft.filter(f_ptr, f_len))
+                continue;
+            if (ft.id != 0 && ft.calls == 0)
+                continue; // filter did not do anything - no need to call ft.undo()
+            filter_est[ff] = UPX_MAX(upx_estimate_compressed_size(i_ptr, i_len), 1u);
+            ft.undo();
+            if (best_est == 0 || filter_est[ff] < best_est)
+                best_est = filter_est[ff];
+        }
+        const upx_uint64_t limit = best_est + upx_uint64_t(best_est) * opt->prune_filters / 100;
+        for (int ff = 0; ff < nfilters; ff++)
+            filter_pruned[ff] = filter_est[ff] > limit;
+    }
+    auto report_estimate = [&](int method, int ff, unsigned c_len) {
+        if (opt->debug.debug_level && filter_est[ff] != 0) {
+            if (filter_pruned[ff])
+                con_fprintf(stderr, "  estimate  method=%d  filter=%#x  est=%u  pruned\n",
+                            method, filters[ff], filter_est[ff]);
+            else
+                con_fprintf(stderr, "  estimate  method=%d  filter=%#x  est=%u  c_len=%u\n",
+                            method, filters[ff], filter_est[ff], c_len);
+        }
+    };
 
-    // compress using all methods/filters
-    int nfilters_success_total = 0;
-    for (int mm = 0; mm < nmethods; mm++) // for all methods
-    {
-        NO_printf("\nmethod %d (%d of %d)\n", methods[mm], 1 + mm, nmethods);
-        assert(isValidCompressionMethod(methods[mm]));
+    // compress the "header" with a given method; see 2006-02-15 note above
+    auto compress_hdr = [hdr_ptr, hdr_len](int method, byte *hdr_obuf) -> unsigned {
         unsigned hdr_c_len = 0;
-        if (hdr_ptr != nullptr && hdr_len) {
-            if (nfilters_success_total != 0 && o_tmp == o_ptr) {
-                // do not overwrite o_ptr
-                o_tmp_buf.allocForCompression(UPX_MAX(hdr_len, i_len));
-                o_tmp = o_tmp_buf;
+        int r =
+            upx_compress(hdr_ptr, hdr_len, hdr_obuf, &hdr_c_len, nullptr, method, 10, nullptr, nullptr);
+        if (r != UPX_E_OK)
+            throwInternalError("header compression failed");
+        if (hdr_c_len >= hdr_len)
+            throwInternalError("header compression size increase");
+        return hdr_c_len;
+    };
+
+    // check the results of a successful compress(); "this->ph" and "ft" describe
+    // the current candidate; i_buf[] must hold the filtered input
+    auto update_best = [&](const Filter &ft, const byte *c_ptr, const byte *i_buf,
+                           unsigned hdr_c_len, unsigned pos) {
+        unsigned lsize = 0;
+        // findOverlapOperhead() might be slow; omit if already too big.
+        if (ph.c_len + lsize + hdr_c_len <= best_ph.c_len + best_ph_lsize + best_hdr_c_len) {
+            // get results
+            ph.overlap_overhead = findOverlapOverhead(c_ptr, i_buf, overlap_range);
+            lsize = getLoaderSizeMemo(&ft);
+            assert(lsize > 0);
+        }
+        NO_printf("\n%2d %02x: %d +%4d +%3d = %d  (best: %d +%4d +%3d = %d)\n", ph.method,
+                  ph.filter, ph.c_len, lsize, hdr_c_len, ph.c_len + lsize + hdr_c_len,
+                  best_ph.c_len, best_ph_lsize, best_hdr_c_len,
+                  best_ph.c_len + best_ph_lsize + best_hdr_c_len);
+        bool update = false;
+        if (ph.c_len + lsize + hdr_c_len < best_ph.c_len + best_ph_lsize + best_hdr_c_len)
+            update = true;
+        else if (ph.c_len + lsize + hdr_c_len == best_ph.c_len + best_ph_lsize + best_hdr_c_len) {
+            // prefer smaller loaders
+            if (lsize + hdr_c_len < best_ph_lsize + best_hdr_c_len)
+                update = true;
+            else if (lsize + hdr_c_len == best_ph_lsize + best_hdr_c_len) {
+                // prefer less overlap_overhead
+                if (ph.overlap_overhead < best_ph.overlap_overhead)
+                    update = true;
+                // prefer the earlier candidate in the default order
+                else if (ph.overlap_overhead == best_ph.overlap_overhead && pos < best_pos)
+                    update = true;
             }
-            int r = upx_compress(hdr_ptr, hdr_len, o_tmp, &hdr_c_len, nullptr, methods[mm], 10,
-                                 nullptr, nullptr);
-            if (r != UPX_E_OK)
-                throwInternalError("header compression failed");
-            if (hdr_c_len >= hdr_len)
-                throwInternalError("header compression size increase");
         }
-        int nfilters_success_mm = 0;
-        for (int ff = 0; ff < nfilters; ff++) // for all filters
-        {
-            assert(isValidFilter(filters[ff]));
+        if (update) {
+            assert((int) ph.overlap_overhead > 0);
+            // update o_ptr[] with best version
+            if (c_ptr != o_ptr)
+                memcpy(o_ptr, c_ptr, ph.c_len);
+            // save compression results
+            best_ph = ph;
+            best_ph_lsize = lsize;
+            best_hdr_c_len = hdr_c_len;
+            best_pos = pos;
+            best_ft = ft;
+            best_ft.buf = f_ptr; // ft.buf may point to a private copy, see below
+            best_ft.undo_log = nullptr;
+        }
+    };
+
+    // Compression budget for the next candidate: as the loader size is at least 1,
+    // a candidate whose compressed data exceeds "max_out" can never win in
+    // update_best() above, so the compressor may give up early [exact, the
+    // result does not change]. "--abort-margin" additionally gives up on
+    // candidates whose projected size is too big [may miss the best candidate].
+    auto make_budget = [&](upx_callback_t &budget, unsigned hdr_c_len) {
+        budget.reset();
+        if (best_ph.overlap_overhead == 0) // no best candidate yet
+            return;
+        const unsigned best_size = best_ph.c_len + best_ph_lsize + best_hdr_c_len;
+        if (best_size <= hdr_c_len + 1)
+            return;
+        budget.max_out = best_size - hdr_c_len - 1;
+        if (opt->abort_margin >= 0) {
+            budget.max_projected =
+                unsigned((budget.max_out + upx_uint64_t(1)) * (100 + opt->abort_margin) / 100);
+            budget.min_in = i_len / 4;
+        }
+    };
+
+    int nfilters_success_total = 0;
+    const unsigned ncandidates = nmethods * nfilters;
+    const unsigned nthreads = upx::parallel_get_num_threads(opt->threads);
+    // the filter must work on a subset of i_ptr[] so that we can make private copies
+    const bool can_copy_f = f_len == 0 || (f_ptr >= i_ptr && f_ptr + f_len <= i_ptr + i_len);
+    if (cache_hit) {
+        // best_ph and best_ft are set, and o_ptr[] holds the compressed data
+        nfilters_success_total = 1;
+    } else if (nthreads >= 2 && ncandidates >= 2 && can_copy_f) {
+        // Parallel mode: each candidate gets its own filtered copy of the input
+        // and its own output buffer, so a whole "wave" of candidates can be
+        // compressed concurrently. The results then get checked in exactly the
+        // same order as in serial mode below, so the output is byte-identical.
+        // NOTE: i_ptr[] never gets modified here.
+        struct Candidate final {
+            explicit Candidate() noexcept : ft(0) {}
+            unsigned index; // mm * nfilters + ff
+            bool filtered;
+            bool compressed;
+            PackHeader cph;
+            Filter ft;
+            MemBuffer c_ibuf; // filtered copy of i_ptr[]
+            MemBuffer c_obuf; // compressed data
+            FilterUndoLog undo_log;
+        };
+        const unsigned nslots = UPX_MIN(nthreads, ncandidates);
+        std::unique_ptr<Candidate[]> candidates(new Candidate[nslots]); // one per slot of a wave
+        const unsigned f_off = f_len ? ptr_udiff(f_ptr, i_ptr) : 0;
+
+        unsigned hdr_c_lens[MAX_METHODS] = {};
+        if (hdr_ptr != nullptr && hdr_len) {
+            MemBuffer hdr_obuf;
+            hdr_obuf.allocForCompression(hdr_len);
+            for (int mm = 0; mm < nmethods; mm++)
+                hdr_c_lens[mm] = compress_hdr(methods[mm], hdr_obuf);
+        }
+        int nfilters_success_mm[MAX_METHODS] = {};
+        bool method_done[MAX_METHODS] = {}; // filter_strategy < 0: stop after first filter
+        upx_callback_t budgets[MAX_METHODS]; // based on the best result before each wave
+
+        auto work = [&](unsigned slot) {
+            Candidate &c = candidates[slot];
+            const int mm = c.index / nfilters;
+            const int ff = c.index % nfilters;
+            c.filtered = c.compressed = false;
+            if (filter_pruned[ff])
+                return;
             // get fresh packheader
-            ph = orig_ph;
-            ph.method = methods[mm];
-            ph.filter = filters[ff];
-            ph.overlap_overhead = 0;
-            // get fresh filter
-            Filter ft = orig_ft;
-            ft.init(ph.filter, orig_ft.addvalue);
+            c.cph = orig_ph;
+            c.cph.method = methods[mm];
+            c.cph.filter = filters[ff];
+            c.cph.overlap_overhead = 0;
+            // get fresh filter and a fresh copy of the input
+            c.ft = orig_ft;
+            c.ft.init(c.cph.filter, orig_ft.addvalue);
+            c.ft.undo_log = &c.undo_log;
+            if (c.c_ibuf.getSize() == 0) {
+                // c_ibuf[] gets restored after each wave, so copy only once
+                c.c_ibuf.alloc(i_len);
+                memcpy(c.c_ibuf, i_ptr, i_len);
+            }
+            byte *const cf_ptr = c.c_ibuf + f_off;
             // filter
-            optimizeFilter(&ft, f_ptr, f_len);
-            bool success = ft.filter(f_ptr, f_len);
-            if (ft.id != 0 && ft.calls == 0) {
-                // filter did not do anything - no need to call ft.unfilter()
-                success = false;
+            optimizeFilter(&c.ft, cf_ptr, f_len);
+            bool success = c.ft.filter(cf_ptr, f_len);
+            if (c.ft.id != 0 && c.ft.calls == 0)
+                success = false; // filter did not do anything
+            if (!success)
+                return;
+            c.filtered = true;
+            c.cph.filter_cto = c.ft.cto;
+            c.cph.n_mru = c.ft.n_mru;
+            // compress
+            if (c.c_obuf.getSize() == 0)
+                c.c_obuf.allocForCompression(i_len);
+            c.compressed =
+                compress(c.cph, c.c_ibuf, i_len, c.c_obuf, cconf, nullptr, &budgets[mm]);
+        };
+
+        unsigned next_index = 0;
+        bool stopped = false;
+        while (!stopped) {
+            // prepare the next wave
+            unsigned nwave = 0;
+            for (; next_index < ncandidates && nwave < nslots; next_index++) {
+                if (method_done[next_index / nfilters])
+                    continue;
+                candidates[nwave++].index = next_index;
             }
-            if (!success) {
-                // filter failed or was useless
-                if (filter_strategy >= 0) {
-                    // adjust ui passes
-                    if (uip->ui_pass >= 0)
-                        uip->ui_pass++;
+            if (nwave == 0)
+                break;
+            for (int mm = 0; mm < nmethods; mm++)
+                make_budget(budgets[mm], hdr_c_lens[mm]);
+            upx::parallel_for(nwave, nthreads, work);
+            // check the results in serial order
+            for (unsigned slot = 0; slot < nwave; slot++) {
+                Candidate &c = candidates[slot];
+                const int mm = c.index / nfilters;
+                if (method_done[mm])
+                    continue;
+                if (!c.filtered) {
+                    // filter failed or was useless, or pruned by the estimate
+                    report_estimate(methods[mm], c.index % nfilters, 0);
+                    if (filter_strategy >= 0) {
+                        // adjust ui passes
+                        if (uip->ui_pass >= 0)
+                            uip->ui_pass++;
+                    }
+                    continue;
+                }
+                NO_printf("\nfilter: id 0x%02x size %6d, calls %5d/%5d/%3d/%5d/%5d, cto 0x%02x\n",
+                          c.ft.id, c.ft.buf_len, c.ft.calls, c.ft.noncalls, c.ft.wrongcalls,
+                          c.ft.firstcall, c.ft.lastcall, c.ft.cto);
+                nfilters_success_total++;
+                nfilters_success_mm[mm]++;
+                if (uip->ui_pass >= 0)
+                    uip->ui_pass++; // as done by compress() in serial mode
+                if (c.compressed) {
+                    ph = c.cph;
+                    report_estimate(ph.method, c.index % nfilters, ph.c_len);
+                    update_best(c.ft, c.c_obuf, c.c_ibuf, hdr_c_lens[mm],
+                                method_pos[mm] * nfilters + filter_pos[c.index % nfilters]);
+                }
+                if (filter_strategy < 0)
+                    method_done[mm] = true;
+                if (early_stop()) {
+                    stopped = true; // ignore the rest of this wave, as in serial mode
+                    break;
                 }
-                continue;
             }
-            // filter success
-            NO_printf("\nfilter: id 0x%02x size %6d, calls %5d/%5d/%3d/%5d/%5d, cto 0x%02x\n",
-                      ft.id, ft.buf_len, ft.calls, ft.noncalls, ft.wrongcalls, ft.firstcall,
-                      ft.lastcall, ft.cto);
-            if (nfilters_success_total != 0 && o_tmp == o_ptr) {
-                o_tmp_buf.allocForCompression(i_len);
-                o_tmp = o_tmp_buf;
+            // restore
+            upx::parallel_for(nwave, nthreads, [&](unsigned slot) {
+                Candidate &c = candidates[slot];
+                if (c.filtered)
+                    c.ft.undo();
+            });
+        }
+        for (int mm = 0; mm < nmethods && !stopped; mm++)
+            assert(nfilters_success_mm[mm] > 0);
+    } else {
+        // Working buffer for compressed data. Don't waste memory and allocate as needed.
+        byte *o_tmp = o_ptr;
+        MemBuffer o_tmp_buf;
+
+        // compress using all methods/filters
+        for (int mm = 0; mm < nmethods && !early_stop(); mm++) // for all methods
+        {
+            NO_printf("\nmethod %d (%d of %d)\n", methods[mm], 1 + mm, nmethods);
+            assert(isValidCompressionMethod(methods[mm]));
+            unsigned hdr_c_len = 0;
+            if (hdr_ptr != nullptr && hdr_len) {
+                if (nfilters_success_total != 0 && o_tmp == o_ptr) {
+                    // do not overwrite o_ptr
+                    o_tmp_buf.allocForCompression(UPX_MAX(hdr_len, i_len));
+                    o_tmp = o_tmp_buf;
+                }
+                hdr_c_len = compress_hdr(methods[mm], o_tmp);
             }
-            nfilters_success_total++;
-            nfilters_success_mm++;
-            ph.filter_cto = ft.cto;
-            ph.n_mru = ft.n_mru;
-            // compress
-            if (compress(i_ptr, i_len, o_tmp, cconf)) {
-                unsigned lsize = 0;
-                // findOverlapOperhead() might be slow; omit if already too big.
-                if (ph.c_len + lsize + hdr_c_len <=
-                    best_ph.c_len + best_ph_lsize + best_hdr_c_len) {
-                    // get results
-                    ph.overlap_overhead = findOverlapOverhead(o_tmp, i_ptr, overlap_range);
-                    buildLoader(&ft);
-                    lsize = getLoaderSize();
-                    assert(lsize > 0);
+            int nfilters_success_mm = 0;
+            for (int ff = 0; ff < nfilters && !early_stop(); ff++) // for all filters
+            {
+                assert(isValidFilter(filters[ff]));
+                if (filter_pruned[ff]) {
+                    report_estimate(methods[mm], ff, 0);
+                    if (uip->ui_pass >= 0)
+                        uip->ui_pass++;
+                    continue;
                 }
-                NO_printf("\n%2d %02x: %d +%4d +%3d = %d  (best: %d +%4d +%3d = %d)\n", ph.method,
-                          ph.filter, ph.c_len, lsize, hdr_c_len, ph.c_len + lsize + hdr_c_len,
-                          best_ph.c_len, best_ph_lsize, best_hdr_c_len,
-                          best_ph.c_len + best_ph_lsize + best_hdr_c_len);
-                bool update = false;
-                if (ph.c_len + lsize + hdr_c_len < best_ph.c_len + best_ph_lsize + best_hdr_c_len)
-                    update = true;
-                else if (ph.c_len + lsize + hdr_c_len ==
-                         best_ph.c_len + best_ph_lsize + best_hdr_c_len) {
-                    // prefer smaller loaders
-                    if (lsize + hdr_c_len < best_ph_lsize + best_hdr_c_len)
-                        update = true;
-                    else if (lsize + hdr_c_len == best_ph_lsize + best_hdr_c_len) {
-                        // prefer less overlap_overhead
-                        if (ph.overlap_overhead < best_ph.overlap_overhead)
-                            update = true;
+                // get fresh packheader
+                ph = orig_ph;
+                ph.method = methods[mm];
+                ph.filter = filters[ff];
+                ph.overlap_overhead = 0;
+                // get fresh filter
+                Filter ft = orig_ft;
+                ft.init(ph.filter, orig_ft.addvalue);
+                ft.undo_log = &undo_log;
+                // filter
+                optimizeFilter(&ft, f_ptr, f_len);
+                bool success = ft.filter(f_ptr, f_len);
+                if (ft.id != 0 && ft.calls == 0) {
+                    // filter did not do anything - no need to call ft.undo()
+                    success = false;
+                }
+                if (!success) {
+                    // filter failed or was useless
+                    if (filter_strategy >= 0) {
+                        // adjust ui passes
+                        if (uip->ui_pass >= 0)
+                            uip->ui_pass++;
                     }
+                    continue;
+                }
+                // filter success
+                NO_printf("\nfilter: id 0x%02x size %6d, calls %5d/%5d/%3d/%5d/%5d, cto 0x%02x\n",
+                          ft.id, ft.buf_len, ft.calls, ft.noncalls, ft.wrongcalls, ft.firstcall,
+                          ft.lastcall, ft.cto);
+                if (nfilters_success_total != 0 && o_tmp == o_ptr) {
+                    o_tmp_buf.allocForCompression(i_len);
+                    o_tmp = o_tmp_buf;
                 }
-                if (update) {
-                    assert((int) ph.overlap_overhead > 0);
-                    // update o_ptr[] with best version
-                    if (o_tmp != o_ptr)
-                        memcpy(o_ptr, o_tmp, ph.c_len);
-                    // save compression results
-                    best_ph = ph;
-                    best_ph_lsize = lsize;
-                    best_hdr_c_len = hdr_c_len;
-                    best_ft = ft;
+                nfilters_success_total++;
+                nfilters_success_mm++;
+                ph.filter_cto = ft.cto;
+                ph.n_mru = ft.n_mru;
+                // compress
+                upx_callback_t budget;
+                make_budget(budget, hdr_c_len);
+                if (compress(i_ptr, i_len, o_tmp, cconf, &budget)) {
+                    report_estimate(ph.method, ff, ph.c_len);
+                    update_best(ft, o_tmp, i_ptr, hdr_c_len,
+                                method_pos[mm] * nfilters + filter_pos[ff]);
                 }
+                // restore
+                ft.undo();
+                if (filter_strategy < 0)
+                    break;
             }
-            // restore - unfilter with verify
-            ft.unfilter(f_ptr, f_len, true);
-            if (filter_strategy < 0)
-                break;
+            assert(nfilters_success_mm > 0);
         }
-        assert(nfilters_success_mm > 0);
+    }
+
+    if (use_cache && !cache_hit && best_ph.overlap_overhead > 0)
+        cache_store();
+
+    // ft.undo() did skip the unfilter, so verify the unfilter of the best filter once
+    if (best_ft.id != 0) {
+        Filter ft = orig_ft;
+        ft.init(best_ft.id, orig_ft.addvalue);
+        optimizeFilter(&ft, f_ptr, f_len);
+        if (!ft.filter(f_ptr, f_len) || ft.cto != best_ft.cto || ft.calls != best_ft.calls)
+            throwInternalError("compressWithFilters: filter is not deterministic");
+        ft.unfilter(f_ptr, f_len, true);
     }
 
     // postconditions 1)
@@ -1186,6 +1720,9 @@ void Packer::compressWithFilters(byte *i_ptr,
     // copy back results
     this->ph = best_ph;
     *parm_ft = best_ft;
+    if (opt->winner_stats != nullptr && ncandidates >= 2)
+        upx::winner_stats_add(getName(), ws_kind, best_ph.method, best_ph.filter, best_ph.u_len,
+                              best_ph.c_len);
 
     // Finally, check compression ratio.
     // Might be inhibited when blocksize < file_size, for instance.
@@ -1200,7 +1737,11 @@ void Packer::compressWithFilters(byte *i_ptr,
     }
 
     // convenience
+    upx::PhaseTimer timer(upx::STATS_LOADER);
     buildLoader(&best_ft);
+    if (opt->debug.debug_level)
+        con_fprintf(stderr, "  loader memo  entries=%u  hits=%u\n", loader_memo_count,
+                    loader_memo_hits);
 }
 
 /*************************************************************************
@@ -1243,4 +1784,117 @@ void Packer::compressWithFilters(Filter *ft, const unsigned overlap_range,
     obuf.checkState();
 }
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#if DEBUG && !defined(DOCTEST_CONFIG_DISABLE) && 1
+
+#include "check/dt_data.h"
+
+namespace {
+// just enough of a packer to drive compressWithFilters(); the size of the
+// "loader" depends on the filter, as for the real packers
+class PackTestCompress final : public Packer {
+public:
+    explicit PackTestCompress() : Packer(nullptr) { bele = &N_BELE_RTP::le_policy; }
+    virtual int getVersion() const override { return 13; }
+    virtual int getFormat() const override { return UPX_F_LINUX_ELF_i386; }
+    virtual const char *getName() const override { return "test/compress"; }
+    virtual const char *getFullName(const Options *) const override { return "test-compress"; }
+    virtual const int *getCompressionMethods(int, int) const override {
+        static const int methods[] = {M_NRV2B_LE32, M_NRV2D_LE32, M_NRV2E_LE32, M_LZMA, M_END};
+        return methods;
+    }
+    virtual const int *getFilters() const override {
+        static const int filters[] = {0x49, 0x46, 0x26, 0x24, 0x16, 0x13, 0x11, FT_END};
+        return filters;
+    }
+    virtual tribool canPack() override { return false; }
+    virtual tribool canUnpack() override { return false; }
+
+    // compress "data" with all methods and filters; returns the compressed data
+    void run(const byte *data, unsigned len, MemBuffer &out) {
+        initPackHeader();
+        updatePackHeader();
+        ibuf.alloc(len);
+        memcpy(ibuf, data, len);
+        obuf.allocForCompression(len);
+        ph.u_len = len;
+        Filter ft(ph.level);
+        ft.addvalue = 0;
+        compressWithFilters(&ft, 512, nullptr);
+        CHECK(memcmp(ibuf, data, len) == 0); // the filters have been undone
+        out.alloc(ph.c_len);
+        memcpy(out, obuf, ph.c_len);
+    }
+    const PackHeader &getPackHeader() const noexcept { return ph; }
+
+protected:
+    virtual void pack(OutputFile *) override { throwInternalError("pack"); }
+    virtual void unpack(OutputFile *) override { throwInternalError("unpack"); }
+    virtual void buildLoader(const Filter *ft) override { loader_size = ft->id ? 300 : 256; }
+    virtual int getLoaderSize() const override { return loader_size; }
+    virtual Linker *newLinker() const override { return nullptr; }
+
+private:
+    int loader_size = 0;
+};
+} // namespace
+
+TEST_CASE("Packer::compressWithFilters threads") {
+#if WITH_THREADS
+    std::lock_guard<std::mutex> lock(opt_lock_mutex);
+#endif
+    Options *const saved_opt = opt;
+    Options local_options;
+    opt = &local_options;
+    opt->reset();
+    opt->cmd = CMD_COMPRESS;
+    opt->verbose = -1;
+    opt->level = 7;
+    opt->all_methods = true;
+    opt->all_methods_use_lzma = 1;
+    opt->all_filters = true;
+
+    // compressible x86-like code, where the call filters help
+    const unsigned len = 65536;
+    MemBuffer data(len);
+    upx::testdata::Rng rng(7);
+    for (unsigned i = 0; i < len; i++)
+        data[i] = (byte) (rng.next() >> 29);
+    for (unsigned i = 0; i + 5 <= len; i += 8 + (rng.next() >> 28)) {
+        data[i] = 0xe8;
+        set_le32(data + i + 1, 0x1000 * (rng.next() >> 29) - (i + 5));
+    }
+
+    MemBuffer out1, out2;
+    PackHeader ph1, ph2;
+    {
+        opt->threads = 1; // serial
+        PackTestCompress p;
+        p.run(data, len, out1);
+        ph1 = p.getPackHeader();
+    }
+    {
+        opt->threads = 4; // parallel, in waves of 4 candidates
+        PackTestCompress p;
+        p.run(data, len, out2);
+        ph2 = p.getPackHeader();
+    }
+    opt = saved_opt;
+
+    CHECK(ph1.filter != 0);
+    CHECK(ph1.method == ph2.method);
+    CHECK(ph1.filter == ph2.filter);
+    CHECK(ph1.filter_cto == ph2.filter_cto);
+    CHECK(ph1.c_len == ph2.c_len);
+    CHECK(ph1.c_adler == ph2.c_adler);
+    CHECK(ph1.overlap_overhead == ph2.overlap_overhead);
+    CHECK(out1.getSize() == out2.getSize());
+    CHECK(memcmp(out1, out2, out1.getSize()) == 0);
+}
+
+#endif // DEBUG
+
 /* vim:set ts=4 sw=4 et: */
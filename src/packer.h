@@ -34,6 +34,9 @@ class InputFile;
 class OutputFile;
 class UiPacker;
 class Filter;
+namespace upx {
+class CacheKeyHasher;
+}
 
 /*************************************************************************
 // PackerBase: abstract minimal base class for all packers
@@ -140,7 +143,11 @@ protected:
 protected:
     // main compression drivers
     bool compress(SPAN_P(byte) i_ptr, unsigned i_len, SPAN_P(byte) o_ptr,
-                  const upx_compress_config_t *cconf = nullptr);
+                  const upx_compress_config_t *cconf = nullptr,
+                  const upx_callback_t *budget = nullptr);
+    bool compress(PackHeader &cph, SPAN_P(byte) i_ptr, unsigned i_len, SPAN_P(byte) o_ptr,
+                  const upx_compress_config_t *cconf, UiPacker *cuip,
+                  const upx_callback_t *budget = nullptr) const;
     void decompress(SPAN_P(const byte) in, SPAN_P(byte) out, bool verify_checksum = true,
                     Filter *ft = nullptr);
     virtual bool checkDefaultCompressionRatio(unsigned u_len, unsigned c_len) const;
@@ -184,6 +191,12 @@ protected:
 
     // loader core
     virtual void buildLoader(const Filter *ft) = 0;
+    // Key of the loader size memo, see getLoaderSizeMemo(): add everything
+    // besides ph.method, ph.filter, ph.filter_cto and *ft that the size of
+    // the loader depends on. Returns false if the size must not be reused,
+    // which is the default as many loaders depend on the compressed data.
+    virtual bool addLoaderMemoKey(upx::CacheKeyHasher &h, const Filter *ft) const;
+    unsigned getLoaderSizeMemo(const Filter *ft);
     virtual Linker *newLinker() const = 0;
     virtual void relocateLoader();
     // loader util for linker
@@ -327,6 +340,16 @@ protected:
     // linker
     OwningPointer(Linker) linker = nullptr; // owner
 
+    // loader sizes of earlier buildLoader() calls, see getLoaderSizeMemo()
+    struct LoaderMemo {
+        upx_uint64_t key[2];
+        unsigned lsize;
+    };
+    static constexpr unsigned MAX_LOADER_MEMO = 64;
+    LoaderMemo loader_memo[MAX_LOADER_MEMO];
+    unsigned loader_memo_count = 0;
+    unsigned loader_memo_hits = 0; // debug counter
+
 private:
     // private to checkPatch()
     void *last_patch = nullptr;
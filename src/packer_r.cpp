@@ -50,7 +50,7 @@ unsigned Packer::optimizeReloc(unsigned relocnum, SPAN_P(byte) relocs, SPAN_S(by
         throwCantPackExact();
     if (relocnum == 0)
         return 0;
-    upx_qsort(raw_bytes(relocs, 4 * relocnum), relocnum, 4, le32_compare);
+    upx_radix_sort_le32(raw_bytes(relocs, 4 * relocnum), relocnum);
     if (0) {
         printf("optimizeReloc: u_reloc %9u checksum=0x%08x\n", 4 * relocnum,
                upx_adler32(relocs, 4 * relocnum));
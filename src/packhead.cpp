@@ -381,4 +381,31 @@ bool ph_testOverlappingDecompression(const PackHeader &ph, const byte *buf, cons
     return (r == UPX_E_OK && new_len == ph.u_len);
 }
 
+// Compute the minimal overlap_overhead for which ph_testOverlappingDecompression()
+// succeeds in a single pass. Returns 0 if the method does not support this.
+unsigned ph_minOverlapOverhead(const PackHeader &ph, const byte *buf) {
+    if (ph.c_len >= ph.u_len)
+        return 0;
+
+    const int method = ph_forced_method(ph.method);
+    unsigned extra = 0; // see ph_testOverlappingDecompression() above
+    if (M_IS_NRV2B(method) || M_IS_NRV2D(method) || M_IS_NRV2E(method))
+        extra = 3;
+
+    unsigned src_off = 0;
+    unsigned new_len = ph.u_len;
+    int r = upx_min_overlap(buf, ph.c_len, &new_len, &src_off, method, &ph.compress_result);
+    if (r == UPX_E_OUT_OF_MEMORY)
+        throwOutOfMemoryException();
+    if (r != UPX_E_OK || new_len != ph.u_len)
+        return 0;
+
+    // src_off == ph.u_len + overlap_overhead - extra - ph.c_len
+    upx_uint64_t overhead = (upx_uint64_t) src_off + ph.c_len + extra;
+    overhead = overhead > ph.u_len ? overhead - ph.u_len : 0;
+    if (overhead > UPX_RSIZE_MAX)
+        return 0;
+    return UPX_MAX(unsigned(overhead), 4 + extra + 1);
+}
+
 /* vim:set ts=4 sw=4 et: */
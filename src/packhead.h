@@ -105,3 +105,4 @@ void ph_decompress(PackHeader &ph, SPAN_P(const byte) in, SPAN_P(byte) out, bool
 
 bool ph_testOverlappingDecompression(const PackHeader &ph, const byte *buf, const byte *tbuf,
                                      unsigned overlap_overhead);
+unsigned ph_minOverlapOverhead(const PackHeader &ph, const byte *buf);
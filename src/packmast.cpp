@@ -54,13 +54,14 @@
 #include "p_w64pe_arm64.h"
 #include "p_wcle.h"
 #include "p_wince_arm.h"
+#include "util/stats.h"
 
 /*************************************************************************
 //
 **************************************************************************/
 
 PackMaster::PackMaster(InputFile *f, Options *o) noexcept : fi(f) {
-    // replace global options with local options
+    // replace (per-thread) global options with local options
     if (o != nullptr) {
 #if WITH_THREADS
         // TODO later: check for possible "noexcept" violation here
@@ -127,6 +128,73 @@ static noinline tribool try_can_unpack(PackerBase *pb, void *user) may_throw {
     return false;
 }
 
+/*************************************************************************
+// Quickly classify a file by looking at its first few KiB, so that
+// visitAllPackers() can skip the packers that cannot possibly match.
+//
+// Each SNIFF_xxx class stands for a magic that is *required* by the
+// canPack() and canUnpack() of some packers. Packers that also accept
+// files without a known magic use SNIFF_ANY and are always visited.
+**************************************************************************/
+
+namespace {
+enum : unsigned {
+    SNIFF_MZ = 1u << 0,         // "MZ" or "ZM": dos/exe, maybe with some extended header
+    SNIFF_DOS_EXT = 1u << 1,    // "BW", "LE", "PMW1", "Adam", "PE\0\0": extended header w/o stub
+    SNIFF_COFF = 1u << 2,       // i386 COFF: djgpp2 without stub
+    SNIFF_ELF32 = 1u << 3,      // "\177ELF" ELFCLASS32
+    SNIFF_ELF64 = 1u << 4,      // "\177ELF" ELFCLASS64
+    SNIFF_MACHO = 1u << 5,      // thin Mach-O
+    SNIFF_MACHO_FAT = 1u << 6,  // "\xca\xfe\xba\xbe": Mach-O fat (or Java class file)
+    SNIFF_BZIMAGE = 1u << 7,    // i386 Linux kernel boot sector
+    SNIFF_ZIMAGE_ARM = 1u << 8, // ARM Linux zImage
+    SNIFF_TOS = 1u << 9,        // atari/tos
+    SNIFF_PS1 = 1u << 10,       // ps1/exe
+    SNIFF_OTHER = 1u << 30,     // no known magic
+    SNIFF_ANY = ~0u,
+};
+} // namespace
+
+static unsigned sniff_format(const byte *b, unsigned len) noexcept {
+    unsigned r = 0;
+    if (len >= 2 && (memcmp(b, "MZ", 2) == 0 || memcmp(b, "ZM", 2) == 0))
+        r |= SNIFF_MZ;
+    if (len >= 4 && (memcmp(b, "BW", 2) == 0 || memcmp(b, "LE", 2) == 0 ||
+                     memcmp(b, "PMW1", 4) == 0 || memcmp(b, "Adam", 4) == 0 ||
+                     memcmp(b, "PE\0\0", 4) == 0))
+        r |= SNIFF_DOS_EXT;
+    if (len >= 2 && get_le16(b) == 0x014c)
+        r |= SNIFF_COFF;
+    if (len >= 5 && memcmp(b, "\x7f\x45\x4c\x46", 4) == 0) {
+        if (b[4] == 1)
+            r |= SNIFF_ELF32;
+        else if (b[4] == 2)
+            r |= SNIFF_ELF64;
+    }
+    if (len >= 4) {
+        const unsigned m = get_be32(b);
+        if (m == 0xfeedface || m == 0xfeedfacf || m == 0xcefaedfe || m == 0xcffaedfe)
+            r |= SNIFF_MACHO;
+        else if (m == 0xcafebabe)
+            r |= SNIFF_MACHO_FAT;
+        else if (m >> 16 == 0x601a)
+            r |= SNIFF_TOS;
+    }
+    // NOTE: an EFI-stub bzImage also starts with "MZ"
+    if (len >= 0x200 && get_le16(b + 0x1fe) == 0xaa55)
+        r |= SNIFF_BZIMAGE;
+    if (len >= 32) {
+        bool nops = true;
+        for (unsigned i = 0; i < 32; i += 4)
+            nops = nops && get_le32(b + i) == 0xe1a00000;
+        if (nops)
+            r |= SNIFF_ZIMAGE_ARM;
+    }
+    if (len >= 8 && (memcmp(b, "PS-X EXE", 8) == 0 || memcmp(b, "EXE X-SP", 8) == 0))
+        r |= SNIFF_PS1;
+    return r ? r : SNIFF_OTHER;
+}
+
 /*************************************************************************
 //
 **************************************************************************/
@@ -134,10 +202,34 @@ static noinline tribool try_can_unpack(PackerBase *pb, void *user) may_throw {
 /*static*/
 PackerBase *PackMaster::visitAllPackers(visit_func_t func, InputFile *f, const Options *o,
                                         void *user) may_throw {
-#define VISIT(Klass)                                                                               \
+    upx::PhaseTimer timer(upx::STATS_PROBE);
+    // read the header only once and share it with all packers
+    unsigned sniffed = SNIFF_ANY;
+    if (f != nullptr && f->cacheHeader(4096)) {
+        unsigned len;
+        const byte *hdr = f->getCachedHeader(&len);
+        sniffed = sniff_format(hdr, UPX_MIN(len, 4096u));
+    }
+    struct Stats {
+        const Options *o;
+        unsigned sniffed, visited = 0, skipped = 0;
+        ~Stats() noexcept {
+            if (o->debug.debug_level && sniffed != SNIFF_ANY)
+                fprintf(stderr, "visitAllPackers: sniffed %#x, %u probes, %u probes avoided\n",
+                        sniffed, visited, skipped);
+        }
+    };
+    Stats stats{o, sniffed};
+
+#define VISIT(Klass, sniff_mask)                                                                   \
     do {                                                                                           \
         static_assert(std::is_class_v<Klass>);                                                     \
         static_assert(std::is_nothrow_destructible_v<Klass>);                                      \
+        if (((sniff_mask) & sniffed) == 0) {                                                       \
+            stats.skipped += 1;                                                                    \
+            break;                                                                                 \
+        }                                                                                          \
+        stats.visited += 1;                                                                        \
         auto pb = std::unique_ptr<PackerBase>(new Klass(f));                                       \
         if (o->debug.debug_level)                                                                  \
             fprintf(stderr, "visitAllPackers: (ver=%d, fmt=%3d) %s\n", pb->getVersion(),           \
@@ -157,31 +249,31 @@ PackerBase *PackMaster::visitAllPackers(visit_func_t func, InputFile *f, const O
     //
     if (!o->dos_exe.force_stub) {
         // dos32
-        VISIT(PackDjgpp2);
-        VISIT(PackTmt);
-        VISIT(PackWcle);
+        VISIT(PackDjgpp2, SNIFF_MZ | SNIFF_COFF);
+        VISIT(PackTmt, SNIFF_MZ | SNIFF_DOS_EXT);
+        VISIT(PackWcle, SNIFF_MZ | SNIFF_DOS_EXT);
         // Windows
         // VISIT(PackW64PeArm64EC); // NOT YET IMPLEMENTED
         // VISIT(PackW64PeArm64); // NOT YET IMPLEMENTED
-        VISIT(PackW64PeAmd64);
-        VISIT(PackW32PeI386);
-        VISIT(PackWinCeArm);
+        VISIT(PackW64PeAmd64, SNIFF_MZ | SNIFF_DOS_EXT);
+        VISIT(PackW32PeI386, SNIFF_MZ | SNIFF_DOS_EXT);
+        VISIT(PackWinCeArm, SNIFF_MZ | SNIFF_DOS_EXT);
     }
-    VISIT(PackExe); // dos/exe
+    VISIT(PackExe, SNIFF_MZ); // dos/exe
 
     //
     // linux kernel
     //
-    VISIT(PackVmlinuxARMEL);
-    VISIT(PackVmlinuxARMEB);
-    VISIT(PackVmlinuxPPC32);
-    VISIT(PackVmlinuxPPC64LE);
-    VISIT(PackVmlinuxAMD64);
-    VISIT(PackVmlinuxI386);
+    VISIT(PackVmlinuxARMEL, SNIFF_ELF32);
+    VISIT(PackVmlinuxARMEB, SNIFF_ELF32);
+    VISIT(PackVmlinuxPPC32, SNIFF_ELF32);
+    VISIT(PackVmlinuxPPC64LE, SNIFF_ELF64);
+    VISIT(PackVmlinuxAMD64, SNIFF_ELF64);
+    VISIT(PackVmlinuxI386, SNIFF_ELF32);
 #if (WITH_ZLIB)
-    VISIT(PackVmlinuzI386);
-    VISIT(PackBvmlinuzI386);
-    VISIT(PackVmlinuzARMEL);
+    VISIT(PackVmlinuzI386, SNIFF_BZIMAGE);
+    VISIT(PackBvmlinuzI386, SNIFF_BZIMAGE);
+    VISIT(PackVmlinuzARMEL, SNIFF_ZIMAGE_ARM);
 #endif
 
     //
@@ -189,34 +281,35 @@ PackerBase *PackMaster::visitAllPackers(visit_func_t func, InputFile *f, const O
     //
     if (!o->o_unix.force_execve) {
         if (o->o_unix.use_ptinterp) {
-            VISIT(PackLinuxElf32x86interp);
+            VISIT(PackLinuxElf32x86interp, SNIFF_ELF32);
         }
-        VISIT(PackFreeBSDElf32x86);
-        VISIT(PackNetBSDElf32x86);
-        VISIT(PackOpenBSDElf32x86);
-        VISIT(PackLinuxElf32x86);
-        VISIT(PackLinuxElf64amd);
-        VISIT(PackLinuxElf32armLe);
-        VISIT(PackLinuxElf32armBe);
-        VISIT(PackLinuxElf64arm);
-        VISIT(PackLinuxElf32ppc);
-        VISIT(PackLinuxElf64ppc);
-        VISIT(PackLinuxElf64ppcle);
-        VISIT(PackLinuxElf32mipsel);
-        VISIT(PackLinuxElf32mipseb);
-        VISIT(PackLinuxI386sh);
+        VISIT(PackFreeBSDElf32x86, SNIFF_ELF32);
+        VISIT(PackNetBSDElf32x86, SNIFF_ELF32);
+        VISIT(PackOpenBSDElf32x86, SNIFF_ELF32);
+        VISIT(PackLinuxElf32x86, SNIFF_ELF32);
+        VISIT(PackLinuxElf64amd, SNIFF_ELF64);
+        VISIT(PackLinuxElf32armLe, SNIFF_ELF32);
+        VISIT(PackLinuxElf32armBe, SNIFF_ELF32);
+        VISIT(PackLinuxElf64arm, SNIFF_ELF64);
+        VISIT(PackLinuxElf32ppc, SNIFF_ELF32);
+        VISIT(PackLinuxElf64ppc, SNIFF_ELF64);
+        VISIT(PackLinuxElf64ppcle, SNIFF_ELF64);
+        VISIT(PackLinuxElf32mipsel, SNIFF_ELF32);
+        VISIT(PackLinuxElf32mipseb, SNIFF_ELF32);
+        VISIT(PackLinuxI386sh, SNIFF_ANY); // canUnpack() only looks at the end of the file
     }
-    VISIT(PackBSDI386);
-    VISIT(PackMachFat);   // cafebabe conflict
-    VISIT(PackLinuxI386); // cafebabe conflict
+    VISIT(PackBSDI386, SNIFF_ANY);
+    VISIT(PackMachFat, SNIFF_MACHO_FAT); // cafebabe conflict
+    VISIT(PackLinuxI386, SNIFF_ANY);     // cafebabe conflict
 
     // Mach (Darwin / macOS)
-    VISIT(PackDylibAMD64);
-    VISIT(PackMachPPC32); // TODO: this works with upx 3.91..3.94 but got broken in 3.95; FIXME
-    VISIT(PackMachI386);
-    VISIT(PackMachAMD64);
-    VISIT(PackMachARMEL);
-    VISIT(PackMachARM64EL);
+    VISIT(PackDylibAMD64, SNIFF_MACHO);
+    // TODO: PackMachPPC32 works with upx 3.91..3.94 but got broken in 3.95; FIXME
+    VISIT(PackMachPPC32, SNIFF_MACHO);
+    VISIT(PackMachI386, SNIFF_MACHO);
+    VISIT(PackMachAMD64, SNIFF_MACHO);
+    VISIT(PackMachARMEL, SNIFF_MACHO);
+    VISIT(PackMachARM64EL, SNIFF_MACHO);
 
     // 2010-03-12  omit these because PackMachBase<T>::pack4dylib (p_mach.cpp)
     // does not understand what the Darwin (Apple Mac OS X) dynamic loader
@@ -227,10 +320,10 @@ PackerBase *PackMaster::visitAllPackers(visit_func_t func, InputFile *f, const O
     //
     // misc
     //
-    VISIT(PackTos); // atari/tos
-    VISIT(PackPs1); // ps1/exe
-    VISIT(PackSys); // dos/sys
-    VISIT(PackCom); // dos/com
+    VISIT(PackTos, SNIFF_TOS); // atari/tos
+    VISIT(PackPs1, SNIFF_PS1); // ps1/exe
+    VISIT(PackSys, SNIFF_ANY); // dos/sys; canUnpack() is from dos/com
+    VISIT(PackCom, SNIFF_ANY); // dos/com; canUnpack() looks for any PackHeader
 
     return nullptr;
 #undef VISIT
@@ -288,4 +381,41 @@ void PackMaster::fileInfo() may_throw {
     packer->doFileInfo();
 }
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("sniff_format") {
+    byte b[0x200];
+    memset(b, 0, sizeof(b));
+    CHECK(sniff_format(b, 0) == SNIFF_OTHER);
+    CHECK(sniff_format(b, sizeof(b)) == SNIFF_OTHER);
+    memcpy(b, "MZ", 2);
+    CHECK(sniff_format(b, sizeof(b)) == SNIFF_MZ);
+    set_le16(b + 0x1fe, 0xaa55); // EFI-stub bzImage
+    CHECK(sniff_format(b, sizeof(b)) == (SNIFF_MZ | SNIFF_BZIMAGE));
+    CHECK(sniff_format(b, 0x1ff) == SNIFF_MZ);
+    memcpy(b, "PE\0\0", 4);
+    CHECK(sniff_format(b, 4) == SNIFF_DOS_EXT);
+    memcpy(b, "\x7f\x45\x4c\x46\x01", 5);
+    CHECK(sniff_format(b, 64) == SNIFF_ELF32);
+    b[4] = 2;
+    CHECK(sniff_format(b, 64) == SNIFF_ELF64);
+    b[4] = 3;
+    CHECK(sniff_format(b, 64) == SNIFF_OTHER);
+    set_be32(b, 0xcffaedfe);
+    CHECK(sniff_format(b, 4) == SNIFF_MACHO);
+    set_be32(b, 0xcafebabe);
+    CHECK(sniff_format(b, 4) == SNIFF_MACHO_FAT);
+    set_be32(b, 0x601a0000);
+    CHECK(sniff_format(b, 4) == SNIFF_TOS);
+    memcpy(b, "PS-X EXE", 8);
+    CHECK(sniff_format(b, 8) == SNIFF_PS1);
+    for (unsigned i = 0; i < 32; i += 4)
+        set_le32(b + i, 0xe1a00000);
+    CHECK(sniff_format(b, 32) == SNIFF_ZIMAGE_ARM);
+    set_le16(b, 0x014c);
+    CHECK(sniff_format(b, 2) == SNIFF_COFF);
+}
+
 /* vim:set ts=4 sw=4 et: */
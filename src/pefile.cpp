@@ -31,6 +31,7 @@
 #include "packer.h"
 #include "pefile.h"
 #include "linker.h"
+#include "util/stats.h"
 
 #define FILLVAL 0
 #define import  my_import // "import" is a keyword since C++20
@@ -307,17 +308,12 @@ static void reloc_entry_decode(SPAN_P(const byte) buf, unsigned *pos, unsigned *
     *reloc_type = buf[4];
     assert(*reloc_type > 0 && *reloc_type < 16);
 }
-static int __acc_cdecl_qsort reloc_entry_compare(const void *a, const void *b) {
-    const unsigned pos1 = get_ne32(a);
-    const unsigned pos2 = get_ne32(b);
-    if (pos1 != pos2)
-        return pos1 < pos2 ? -1 : 1;
-    const unsigned reloc_type1 = ((const byte *) a)[4];
-    const unsigned reloc_type2 = ((const byte *) b)[4];
-    if (reloc_type1 != reloc_type2)
-        return reloc_type1 < reloc_type2 ? -1 : 1;
-    return 0;
-}
+// sort key for upx_radix_sort(): order by pos, then by reloc_type
+#if (ACC_ABI_BIG_ENDIAN)
+static const byte reloc_entry_key_offsets[RELOC_ENTRY_SIZE] = {4, 3, 2, 1, 0};
+#else
+static const byte reloc_entry_key_offsets[RELOC_ENTRY_SIZE] = {4, 0, 1, 2, 3};
+#endif
 
 PeFile::Reloc::~Reloc() noexcept {
     COMPILE_TIME_ASSERT(sizeof(BaseReloc) == 8)
@@ -418,8 +414,9 @@ void PeFile::Reloc::add_reloc(unsigned pos, unsigned reloc_type) {
 void PeFile::Reloc::finish(byte *(&result_ptr), unsigned &result_size) {
     assert(start_did_alloc);
     // sort in-place relocs
-    upx_qsort(raw_index_bytes(start_buf, RELOC_INPLACE_OFFSET, RELOC_ENTRY_SIZE * counts[0]),
-              counts[0], RELOC_ENTRY_SIZE, reloc_entry_compare);
+    upx_radix_sort<RELOC_ENTRY_SIZE>(
+        raw_index_bytes(start_buf, RELOC_INPLACE_OFFSET, RELOC_ENTRY_SIZE * counts[0]), counts[0],
+        reloc_entry_key_offsets, RELOC_ENTRY_SIZE);
 
     auto finish_block = [](SPAN_S(BaseReloc) rel) -> byte * {
         unsigned sob = rel->size_of_block;
@@ -534,7 +531,7 @@ void PeFile32::processRelocs() // pass1
 
     // remove duplicated records
     for (unsigned ic = 1; ic <= IMAGE_REL_BASED_HIGHLOW; ic++) {
-        upx_qsort(fix[ic], xcounts[ic], 4, le32_compare);
+        upx_radix_sort_le32(fix[ic], xcounts[ic]);
         unsigned prev = ~0u;
         unsigned jc = 0;
         for (unsigned kc = 0; kc < xcounts[ic]; kc++)
@@ -636,7 +633,7 @@ void PeFile64::processRelocs() // pass1
 
     // remove duplicated records
     for (unsigned ic = 1; ic < 16; ic++) {
-        upx_qsort(fix[ic], xcounts[ic], 4, le32_compare);
+        upx_radix_sort_le32(fix[ic], xcounts[ic]);
         unsigned prev = ~0u;
         unsigned jc = 0;
         for (unsigned kc = 0; kc < xcounts[ic]; kc++)
@@ -2321,12 +2318,16 @@ void PeFile::pack0(OutputFile *fo, ht &ih, ht &oh, unsigned subsystem_mask,
     Interval loadconfiv(ibuf);
     Export xport((char *) (byte *) ibuf);
 
-    const unsigned dllstrings = processImports();
-    processTls(&tlsiv); // call before processRelocs!!
-    processLoadConf(&loadconfiv);
-    processResources(&res);
-    processExports(&xport);
-    processRelocs();
+    unsigned dllstrings;
+    {
+        upx::PhaseTimer timer(upx::STATS_HEADERS);
+        dllstrings = processImports();
+        processTls(&tlsiv); // call before processRelocs!!
+        processLoadConf(&loadconfiv);
+        processResources(&res);
+        processExports(&xport);
+        processRelocs();
+    }
 
     // OutputFile::dump("x1", ibuf, usize);
 
@@ -2979,6 +2980,7 @@ void PeFile::unpack0(OutputFile *fo, const ht &ih, ht &oh, ord_mask_t ord_mask,
         ODSIZE(PEDIR_BASERELOC) = 0;
     }
 
+    upx::PhaseTimer timer(upx::STATS_HEADERS);
     rebuildImports<LEXX>(extra_info, ord_mask, set_oft);
     rebuildRelocs(extra_info, sizeof(ih.imagebase) * 8, oh.flags, oh.imagebase);
     rebuildTls();
@@ -3219,4 +3221,68 @@ void PeFile64::processTls(Reloc *r, const Interval *iv, unsigned a) {
  <offset of extra info 4>
 */
 
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+#include "check/dt_bench.h"
+
+namespace {
+struct PeFileTest : public PeFile {
+    using PeFile::ImportLinker; // expose for testing
+};
+typedef PeFileTest::ImportLinker TestImportLinker;
+
+void add_test_imports(TestImportLinker &il, unsigned ndlls, unsigned nprocs) {
+    char dll[32], proc[32];
+    for (unsigned d = 0; d < ndlls; d++) {
+        upx_safe_snprintf(dll, sizeof(dll), "lib%u.dll", d);
+        for (unsigned p = 0; p < nprocs; p++) {
+            upx_safe_snprintf(proc, sizeof(proc), "Function_%u_%u", d, p);
+            il.add_import(dll, proc);
+        }
+        il.add_import(dll, 1 + d); // by ordinal
+    }
+}
+} // namespace
+
+TEST_CASE("PeFile::ImportLinker") {
+    constexpr unsigned NDLLS = 4, NPROCS = 50;
+    TestImportLinker il(4);
+    add_test_imports(il, NDLLS, NPROCS);
+    add_test_imports(il, NDLLS, NPROCS); // duplicates are ignored
+    CHECK(il.hasDll("lib0.dll"));
+    CHECK(il.hasDll("LIB3.DLL"));
+    CHECK(!il.hasDll("lib4.dll"));
+    const unsigned len = il.build();
+    il.relocate_import(0x1000);
+    CHECK(len > NDLLS * NPROCS * 4);
+    // all thunks must be distinct and inside the output
+    upx_uint64_t last = 0;
+    char dll[32], proc[32];
+    for (unsigned d = 0; d < NDLLS; d++) {
+        upx_safe_snprintf(dll, sizeof(dll), "lib%u.dll", d);
+        CHECK(il.getAddress(dll) < len);
+        CHECK(il.getAddress(dll, 1 + d) < len);
+        for (unsigned p = 0; p < NPROCS; p++) {
+            upx_safe_snprintf(proc, sizeof(proc), "Function_%u_%u", d, p);
+            const upx_uint64_t a = il.getAddress(dll, proc);
+            CHECK((a < len && a != last));
+            last = a;
+        }
+    }
+    CHECK_THROWS(il.getAddress("lib0.dll", "NoSuchFunction"));
+}
+
+TEST_CASE("bench PeFile::ImportLinker" * doctest::skip()) {
+    constexpr unsigned NDLLS = 16, NPROCS = 640; // 10k imports
+    const double t = upx::bench::best_time([]() {
+        TestImportLinker il(8);
+        add_test_imports(il, NDLLS, NPROCS);
+        (void) il.build();
+        il.relocate_import(0x1000);
+    });
+    upx::bench::report_items("PeFile::ImportLinker 10k imports", "", NDLLS * (NPROCS + 1), t);
+}
+
 /* vim:set ts=4 sw=4 et: */
@@ -26,7 +26,7 @@
  */
 
 // INFO: not thread-safe; instantiated and used by class Packer, and the
-// static (global) variables are also updated in work.cpp
+// static (per-thread) variables are also updated in work.cpp
 
 #include "conf.h"
 #include "file.h"
@@ -80,16 +80,16 @@ struct UiPacker::State final {
 };
 
 // static
-unsigned UiPacker::total_files = 0;
-unsigned UiPacker::total_files_done = 0;
-upx_uint64_t UiPacker::total_c_len = 0;
-upx_uint64_t UiPacker::total_u_len = 0;
-upx_uint64_t UiPacker::total_fc_len = 0;
-upx_uint64_t UiPacker::total_fu_len = 0;
-unsigned UiPacker::update_c_len = 0;
-unsigned UiPacker::update_u_len = 0;
-unsigned UiPacker::update_fc_len = 0;
-unsigned UiPacker::update_fu_len = 0;
+upx_thread_local unsigned UiPacker::total_files = 0;
+upx_thread_local unsigned UiPacker::total_files_done = 0;
+upx_thread_local upx_uint64_t UiPacker::total_c_len = 0;
+upx_thread_local upx_uint64_t UiPacker::total_u_len = 0;
+upx_thread_local upx_uint64_t UiPacker::total_fc_len = 0;
+upx_thread_local upx_uint64_t UiPacker::total_fu_len = 0;
+upx_thread_local unsigned UiPacker::update_c_len = 0;
+upx_thread_local unsigned UiPacker::update_u_len = 0;
+upx_thread_local unsigned UiPacker::update_fc_len = 0;
+upx_thread_local unsigned UiPacker::update_fu_len = 0;
 
 /*************************************************************************
 // constants
@@ -128,7 +128,7 @@ static void init_global_constants(void) noexcept {
 static const char *mkline(upx_uint64_t fu_len, upx_uint64_t fc_len, upx_uint64_t u_len,
                           upx_uint64_t c_len, const char *format_name, const char *filename,
                           bool decompress = false) {
-    static char buf[2048]; // static! // TODO later: check if affected by WITH_THREADS
+    static upx_thread_local char buf[2048]; // static!
     char r[7 + 1];
     char fn[15 + 1];
     const char *f;
@@ -173,8 +173,8 @@ UiPacker::UiPacker(const PackerBase *pb_) : pb(pb_) {
 
     if (opt->verbose < 0)
         s->mode = M_QUIET;
-    else if (opt->verbose == 0 || !acc_isatty(STDOUT_FILENO))
-        s->mode = M_INFO;
+    else if (opt->verbose == 0 || !acc_isatty(STDOUT_FILENO) || con_capture_active())
+        s->mode = M_INFO; // no progress bar in "-j" batch mode
     else if (opt->verbose == 1 || opt->no_progress)
         s->mode = M_MSG;
     else if (s->screen == nullptr)
@@ -638,4 +638,27 @@ void UiPacker::uiUpdate(upx_off_t fc_len, upx_off_t fu_len) {
     total_u_len += update_u_len;
 }
 
+/*static*/ UiPacker::Totals UiPacker::uiExchangeTotals(const Totals &t) noexcept {
+    Totals old;
+    old.files = total_files;
+    old.files_done = total_files_done;
+    old.c_len = total_c_len;
+    old.u_len = total_u_len;
+    old.fc_len = total_fc_len;
+    old.fu_len = total_fu_len;
+    total_files = t.files;
+    total_files_done = t.files_done;
+    total_c_len = t.c_len;
+    total_u_len = t.u_len;
+    total_fc_len = t.fc_len;
+    total_fu_len = t.fu_len;
+    return old;
+}
+
+/*static*/ void UiPacker::uiAddTotals(const Totals &t) noexcept {
+    Totals totals = uiExchangeTotals(t);
+    totals.add(t);
+    (void) uiExchangeTotals(totals);
+}
+
 /* vim:set ts=4 sw=4 et: */
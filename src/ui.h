@@ -79,6 +79,27 @@ public:
     static void uiHeader();
     static void uiFooter(const char *n);
 
+    // "-j" batch mode: the totals are per-thread; a job collects the totals
+    // of a single file which then get added to the main totals in order
+    struct Totals final {
+        unsigned files;
+        unsigned files_done;
+        upx_uint64_t c_len;
+        upx_uint64_t u_len;
+        upx_uint64_t fc_len;
+        upx_uint64_t fu_len;
+        void add(const Totals &t) noexcept {
+            files += t.files;
+            files_done += t.files_done;
+            c_len += t.c_len;
+            u_len += t.u_len;
+            fc_len += t.fc_len;
+            fu_len += t.fu_len;
+        }
+    };
+    static Totals uiExchangeTotals(const Totals &t) noexcept; // returns the old totals
+    static void uiAddTotals(const Totals &t) noexcept;
+
     int ui_pass = 0;
     int ui_total_passes = 0;
 
@@ -93,17 +114,17 @@ protected:
     struct State;
     OwningPointer(State) s = nullptr; // owner
 
-    // static totals
-    static unsigned total_files;
-    static unsigned total_files_done;
-    static upx_uint64_t total_c_len;
-    static upx_uint64_t total_u_len;
-    static upx_uint64_t total_fc_len;
-    static upx_uint64_t total_fu_len;
-    static unsigned update_c_len;
-    static unsigned update_u_len;
-    static unsigned update_fc_len;
-    static unsigned update_fu_len;
+    // static totals (per-thread)
+    static upx_thread_local unsigned total_files;
+    static upx_thread_local unsigned total_files_done;
+    static upx_thread_local upx_uint64_t total_c_len;
+    static upx_thread_local upx_uint64_t total_u_len;
+    static upx_thread_local upx_uint64_t total_fc_len;
+    static upx_thread_local upx_uint64_t total_fu_len;
+    static upx_thread_local unsigned update_c_len;
+    static upx_thread_local unsigned update_u_len;
+    static upx_thread_local unsigned update_fc_len;
+    static upx_thread_local unsigned update_fu_len;
 
 private: // UPX conventions
     UPX_CXX_DISABLE_ADDRESS(UiPacker)
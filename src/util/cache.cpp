@@ -0,0 +1,252 @@
+/* cache.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+#include "../conf.h"
+#include "../file.h"
+#include "cache.h"
+#include "membuffer.h"
+
+#if !defined(SH_DENYWR)
+#define SH_DENYWR (-1)
+#endif
+
+namespace upx {
+
+/*************************************************************************
+// CacheKeyHasher
+**************************************************************************/
+
+namespace {
+constexpr upx_uint64_t K1 = 0x9e3779b97f4a7c15ull;
+constexpr upx_uint64_t K2 = 0xbf58476d1ce4e5b9ull;
+constexpr upx_uint64_t K3 = 0x94d049bb133111ebull;
+
+forceinline upx_uint64_t rotl64(upx_uint64_t x, unsigned r) noexcept {
+    return (x << r) | (x >> (64 - r));
+}
+forceinline upx_uint64_t fmix64(upx_uint64_t x) noexcept {
+    x = (x ^ (x >> 30)) * K2;
+    x = (x ^ (x >> 27)) * K3;
+    return x ^ (x >> 31);
+}
+} // namespace
+
+CacheKeyHasher::CacheKeyHasher() noexcept : a(K1), b(K3), total(0) {}
+
+void CacheKeyHasher::add(const void *p, size_t len) noexcept {
+    const byte *s = (const byte *) p;
+    upx_uint64_t x = a, y = b;
+    total += len;
+    for (; len >= 8; s += 8, len -= 8) {
+        const upx_uint64_t w = get_le64(s);
+        x = rotl64((x ^ w) * K1, 29);
+        y = rotl64((y + w) * K2, 31) ^ x;
+    }
+    for (; len > 0; s += 1, len -= 1) {
+        const upx_uint64_t w = *s | 0x100;
+        x = rotl64((x ^ w) * K1, 29);
+        y = rotl64((y + w) * K2, 31) ^ x;
+    }
+    a = x;
+    b = y;
+}
+
+void CacheKeyHasher::add_u32(unsigned v) noexcept {
+    byte buf[4];
+    set_le32(buf, v);
+    add(buf, 4);
+}
+
+void CacheKeyHasher::add_str(const char *s) noexcept {
+    const size_t len = strlen(s);
+    add_u32(unsigned(len));
+    add(s, len);
+}
+
+CacheKey CacheKeyHasher::finish() const noexcept {
+    CacheKey key;
+    key.h[0] = fmix64(a ^ total);
+    key.h[1] = fmix64(b + key.h[0]);
+    return key;
+}
+
+/*************************************************************************
+// on-disk entries: 32 bytes header + data
+**************************************************************************/
+
+namespace {
+constexpr unsigned CACHE_VERSION = 1;
+constexpr unsigned CACHE_HEADER_SIZE = 32;
+
+// "dir/<32 hex digits><suffix>"; returns false if the name would be too long
+bool cache_name(char *name, size_t size, const char *dir, const CacheKey &key,
+                const char *suffix) noexcept {
+    if (dir == nullptr || !dir[0] || strlen(dir) + 34 + strlen(suffix) >= size)
+        return false;
+    snprintf(name, size, "%s/%016llx%016llx%s", dir, (unsigned long long) key.h[0],
+             (unsigned long long) key.h[1], suffix);
+    return true;
+}
+
+void cache_put_header(byte *h, const CacheKey &key, const byte *data, unsigned len) noexcept {
+    memcpy(h, "UPXc", 4);
+    set_le32(h + 4, CACHE_VERSION);
+    set_le32(h + 8, len);
+    set_le32(h + 12, upx_adler32(data, len));
+    set_le64(h + 16, key.h[0]);
+    set_le64(h + 24, key.h[1]);
+}
+} // namespace
+
+bool cache_load(const char *dir, const CacheKey &key, MemBuffer &mb) noexcept {
+    char name[ACC_FN_PATH_MAX + 1];
+    if (!cache_name(name, sizeof(name), dir, key, ".upxc"))
+        return false;
+    try {
+        InputFile fi;
+        fi.sopen(name, O_RDONLY | O_BINARY, SH_DENYWR);
+        const upx_off_t size = fi.st_size();
+        if (size <= CACHE_HEADER_SIZE || size > CACHE_HEADER_SIZE + UPX_RSIZE_MAX_MEM)
+            return false;
+        const unsigned len = unsigned(size - CACHE_HEADER_SIZE);
+        byte h[CACHE_HEADER_SIZE];
+        fi.readx(h, CACHE_HEADER_SIZE);
+        if (memcmp(h, "UPXc", 4) != 0 || get_le32(h + 4) != CACHE_VERSION ||
+            get_le32(h + 8) != len || get_le64(h + 16) != key.h[0] ||
+            get_le64(h + 24) != key.h[1])
+            return false;
+        mb.dealloc();
+        mb.alloc(len);
+        fi.readx(mb, len);
+        if (upx_adler32(mb, len) != get_le32(h + 12))
+            return false;
+        fi.closex();
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+void cache_store(const char *dir, const CacheKey &key, const byte *data, unsigned len) noexcept {
+    static upx_std_atomic(unsigned) counter;
+    char name[ACC_FN_PATH_MAX + 1];
+    char tname[ACC_FN_PATH_MAX + 1];
+    char suffix[32];
+    const unsigned token = unsigned(upx_rand()) ^ (counter++ << 16);
+    snprintf(suffix, sizeof(suffix), ".%08x.tmp", token);
+    if (len == 0 || !cache_name(name, sizeof(name), dir, key, ".upxc") ||
+        !cache_name(tname, sizeof(tname), dir, key, suffix))
+        return;
+    bool created = false;
+    try {
+        byte h[CACHE_HEADER_SIZE];
+        cache_put_header(h, key, data, len);
+        OutputFile fo;
+        fo.open(tname, O_CREAT | O_EXCL | O_WRONLY | O_BINARY, 0644);
+        created = true;
+        fo.write(h, CACHE_HEADER_SIZE);
+        fo.write(data, len);
+        fo.closex();
+        FileBase::rename(tname, name);
+        created = false;
+    } catch (...) {
+        // ignore errors
+    }
+    if (created)
+        (void) FileBase::unlink_noexcept(tname);
+}
+
+} // namespace upx
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("upx::CacheKeyHasher") {
+    using upx::CacheKey;
+    using upx::CacheKeyHasher;
+    static const char data[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    CacheKeyHasher h1, h2, h3;
+    h1.add(data, 36);
+    h2.add(data, 36);
+    h3.add(data, 35);
+    const CacheKey k1 = h1.finish(), k2 = h2.finish(), k3 = h3.finish();
+    CHECK((k1.h[0] == k2.h[0] && k1.h[1] == k2.h[1]));
+    CHECK((k1.h[0] != k3.h[0] && k1.h[1] != k3.h[1]));
+    CacheKeyHasher h4;
+    h4.add_u32(0);
+    const CacheKey k4 = h4.finish();
+    CHECK((k4.h[0] != CacheKeyHasher().finish().h[0]));
+}
+
+TEST_CASE("upx::cache_load") {
+    upx::CacheKeyHasher h;
+    MemBuffer mb;
+    CHECK(!upx::cache_load(nullptr, h.finish(), mb));
+    CHECK(!upx::cache_load("", h.finish(), mb));
+    CHECK(!upx::cache_load("/nonexistent/upx/cache/dir", h.finish(), mb));
+}
+
+#if (ACC_OS_POSIX) && !defined(__wasi__)
+TEST_CASE("upx::cache_store") {
+    const char *tmpdir = getenv("TMPDIR");
+    char dir[ACC_FN_PATH_MAX + 1];
+    upx_safe_snprintf(dir, sizeof(dir), "%s/upx-test-cache-XXXXXX",
+                      (tmpdir && tmpdir[0]) ? tmpdir : "/tmp");
+    REQUIRE(::mkdtemp(dir) != nullptr);
+    upx::CacheKeyHasher h1, h2;
+    h1.add_u32(1);
+    h2.add_u32(2);
+    const upx::CacheKey k1 = h1.finish(), k2 = h2.finish();
+    constexpr unsigned len = 1000;
+    byte data[len];
+    for (unsigned i = 0; i < len; i++)
+        data[i] = (byte) (i * 7 + (i >> 8));
+    MemBuffer mb;
+    CHECK(!upx::cache_load(dir, k1, mb));
+    upx::cache_store(dir, k1, data, len);
+    REQUIRE(upx::cache_load(dir, k1, mb));
+    CHECK(mb.getSize() == len);
+    CHECK(memcmp(mb, data, len) == 0);
+    CHECK(!upx::cache_load(dir, k2, mb)); // other key
+    // a newer entry replaces the old one
+    data[len - 1] ^= 1;
+    upx::cache_store(dir, k1, data, len - 1);
+    REQUIRE(upx::cache_load(dir, k1, mb));
+    CHECK(mb.getSize() == len - 1);
+    CHECK(memcmp(mb, data, len - 1) == 0);
+    upx::cache_store(dir, k2, data, 0); // empty entries are never stored
+    CHECK(!upx::cache_load(dir, k2, mb));
+    // clean up
+    char name[ACC_FN_PATH_MAX + 1];
+    upx_safe_snprintf(name, sizeof(name), "%s/%016llx%016llx.upxc", dir,
+                      (unsigned long long) k1.h[0], (unsigned long long) k1.h[1]);
+    CHECK(::unlink(name) == 0);
+    CHECK(::rmdir(dir) == 0);
+}
+#endif
+
+/* vim:set ts=4 sw=4 et: */
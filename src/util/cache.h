@@ -0,0 +1,66 @@
+/* cache.h --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+
+// A simple on-disk key/value store for "--cache-dir". Each entry is one file
+// named after its 128-bit key; entries are written to a temporary file and
+// then renamed, so concurrent upx processes never see a partial entry.
+// All errors are ignored: a broken or missing entry is just a cache miss.
+
+#pragma once
+
+class MemBuffer;
+
+namespace upx {
+
+struct CacheKey final {
+    upx_uint64_t h[2];
+};
+
+// Not a cryptographic hash; the users of the cache must verify that an
+// entry actually fits (e.g. by decompressing it), see compressWithFilters().
+// NOTE: the result depends on how the data is split into add() calls.
+class CacheKeyHasher final {
+public:
+    explicit CacheKeyHasher() noexcept;
+    void add(const void *p, size_t len) noexcept;
+    void add_u32(unsigned v) noexcept;
+    void add_str(const char *s) noexcept;
+    CacheKey finish() const noexcept;
+
+private:
+    upx_uint64_t a, b, total;
+
+    UPX_CXX_DISABLE_NEW_DELETE_NO_VIRTUAL(CacheKeyHasher)
+};
+
+// load an entry into "mb"; returns false on a cache miss; entries are never empty
+bool cache_load(const char *dir, const CacheKey &key, MemBuffer &mb) noexcept;
+void cache_store(const char *dir, const CacheKey &key, const byte *data, unsigned len) noexcept;
+
+} // namespace upx
+
+/* vim:set ts=4 sw=4 et: */
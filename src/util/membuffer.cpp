@@ -30,6 +30,9 @@
 
 #include "../conf.h"
 #include "membuffer.h"
+#if WITH_MMAP
+#include <sys/mman.h>
+#endif
 
 // extra functions to reduce dependency on membuffer.h
 void *membuffer_get_void_ptr(MemBuffer &mb) noexcept { return mb.getVoidPtr(); }
@@ -37,6 +40,32 @@ unsigned membuffer_get_size(MemBuffer &mb) noexcept { return mb.getSize(); }
 
 /*static*/ MemBuffer::Stats MemBuffer::stats;
 
+/*static*/ void MemBuffer::statsAddAlloc(unsigned bytes) noexcept {
+    stats.global_alloc_counter += 1;
+    stats.global_total_bytes += bytes;
+    const auto active = (stats.global_total_active_bytes += bytes);
+#if WITH_THREADS
+    auto peak = stats.global_peak_active_bytes.load();
+    while (active > peak && !stats.global_peak_active_bytes.compare_exchange_weak(peak, active)) {
+    }
+#else
+    if (active > stats.global_peak_active_bytes)
+        stats.global_peak_active_bytes = active;
+#endif
+}
+
+/*static*/ void MemBuffer::getStatsInfo(StatsInfo *info) noexcept {
+    info->alloc_counter = stats.global_alloc_counter;
+    info->total_bytes = stats.global_total_bytes;
+    info->peak_active_bytes = stats.global_peak_active_bytes;
+    info->reuse_counter = stats.global_reuse_counter;
+    info->reused_bytes = stats.global_reused_bytes;
+}
+
+/*static*/ void MemBuffer::resetStatsPeak() noexcept {
+    stats.global_peak_active_bytes = upx_uint64_t(stats.global_total_active_bytes);
+}
+
 #if DEBUG
 #define debug_set(var, expr) (var) = (expr)
 #else
@@ -69,6 +98,134 @@ static bool use_simple_mcheck() noexcept {
 static forceinline constexpr bool use_simple_mcheck() noexcept { return true; }
 #endif
 
+/*************************************************************************
+// pool of freed blocks
+//
+// Packing a file allocates and frees a number of large buffers, and in
+// batch mode this repeats for every file. Instead of returning these
+// blocks to malloc() we keep a few of them per size class and hand them
+// out again, so that already faulted-in memory gets reused.
+// The pool is only used together with use_simple_mcheck(), so that ASan
+// and valgrind still see every single allocation; the magic constants
+// around each block are written anew on every reuse.
+**************************************************************************/
+
+namespace {
+struct MemBufferPool final {
+    // size classes 1..NCLASSES, four per power of two, from 64 KiB to 224 MiB
+    static constexpr unsigned NCLASSES = 48;
+    static constexpr unsigned MAX_FREE_PER_CLASS = 4;
+    static constexpr size_t MAX_CACHED_BYTES = 256 * 1024 * 1024;
+    // big blocks get aligned for transparent huge pages
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    void *free_blocks[NCLASSES + 1][MAX_FREE_PER_CLASS];
+    unsigned nfree[NCLASSES + 1];
+    size_t cached_bytes;
+#if WITH_THREADS
+    std::mutex lock;
+#endif
+
+    static size_t capacity(unsigned cls) noexcept {
+        const unsigned k = cls - 1;
+        return size_t(4 + (k & 3)) << (16 + k / 4 - 2);
+    }
+    // 0 if the block is not handled by the pool
+    static unsigned sizeClass(size_t bytes) noexcept {
+        if (bytes < capacity(1) || bytes > capacity(NCLASSES))
+            return 0;
+        unsigned cls = 1;
+        while (capacity(cls) < bytes)
+            cls++;
+        return cls;
+    }
+
+    void *get(unsigned cls) noexcept {
+#if WITH_THREADS
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        if (nfree[cls] == 0)
+            return nullptr;
+        cached_bytes -= capacity(cls);
+        return free_blocks[cls][--nfree[cls]];
+    }
+    bool put(unsigned cls, void *p) noexcept {
+#if WITH_THREADS
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        if (nfree[cls] >= MAX_FREE_PER_CLASS || cached_bytes + capacity(cls) > MAX_CACHED_BYTES)
+            return false;
+        cached_bytes += capacity(cls);
+        free_blocks[cls][nfree[cls]++] = p;
+        return true;
+    }
+    void release() noexcept {
+#if WITH_THREADS
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        for (unsigned cls = 1; cls <= NCLASSES; cls++)
+            while (nfree[cls] > 0)
+                freeBlock(free_blocks[cls][--nfree[cls]], capacity(cls) + 32);
+        cached_bytes = 0;
+    }
+    ~MemBufferPool() noexcept { release(); }
+
+    // A block is the buffer plus 16 bytes in front of it and 16 bytes after it,
+    // see MemBuffer::alloc(). Blocks of at least a huge page get a mapping of
+    // their own, so that the buffer itself starts on a huge page; the 16 bytes
+    // in front of it live at the end of an extra normal page.
+#if WITH_MMAP && defined(MADV_HUGEPAGE)
+    static size_t pageSize() noexcept {
+        static const long page_size = ::sysconf(_SC_PAGESIZE);
+        return page_size > 0 ? size_t(page_size) : 4096;
+    }
+    static bool isMappedBlock(size_t bytes) noexcept { return bytes >= HUGE_PAGE_SIZE; }
+    static size_t mappingSize(size_t bytes) noexcept {
+        const size_t page = pageSize();
+        return page + ((bytes - 16 + page - 1) & ~(page - 1));
+    }
+#endif
+
+    static void *allocBlock(size_t bytes) noexcept {
+#if WITH_MMAP && defined(MADV_HUGEPAGE)
+        if (isMappedBlock(bytes)) {
+            // map one huge page more than needed, then trim to the aligned part
+            const size_t page = pageSize();
+            const size_t len = mappingSize(bytes);
+            void *const m = ::mmap(nullptr, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (m == MAP_FAILED)
+                return nullptr;
+            const upx_uintptr_t base = (upx_uintptr_t) m;
+            const upx_uintptr_t buf = (base + page + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+            const upx_uintptr_t start = buf - page;
+            const upx_uintptr_t end = start + len;
+            if (start != base)
+                (void) ::munmap(m, start - base);
+            if (end != base + len + HUGE_PAGE_SIZE)
+                (void) ::munmap((void *) end, base + len + HUGE_PAGE_SIZE - end);
+            (void) ::madvise((void *) buf, end - buf, MADV_HUGEPAGE);
+            return (void *) (buf - 16);
+        }
+#endif
+        return ::malloc(bytes);
+    }
+    static void freeBlock(void *p, size_t bytes) noexcept {
+#if WITH_MMAP && defined(MADV_HUGEPAGE)
+        if (isMappedBlock(bytes)) {
+            (void) ::munmap((byte *) p + 16 - pageSize(), mappingSize(bytes));
+            return;
+        }
+#endif
+        ::free(p); // NOLINT(clang-analyzer-unix.Malloc)
+    }
+};
+} // namespace
+
+static MemBufferPool mem_buffer_pool;
+
+/*static*/ void MemBuffer::releasePool() noexcept { mem_buffer_pool.release(); }
+
 /*************************************************************************
 //
 **************************************************************************/
@@ -154,7 +311,7 @@ void MemBuffer::checkState() const may_throw {
     if (!ptr)
         throwInternalError("block not allocated");
     assert(size_in_bytes > 0);
-    if (use_simple_mcheck()) {
+    if (use_simple_mcheck() && !mapped) {
         const byte *p = (const byte *) ptr;
         if (get_ne32(p - 4) != MAGIC1(p))
             throwInternalError("memory clobbered before allocated block 1");
@@ -173,13 +330,30 @@ void MemBuffer::alloc(upx_uint64_t bytes) may_throw {
     assert(bytes > 0);
     debug_set(debug.last_return_address_alloc, upx_return_address());
     size_t malloc_bytes = mem_size(1, bytes); // check size
-    if (use_simple_mcheck())
+    byte *p = nullptr;
+    bool reused = false;
+    if (use_simple_mcheck()) {
+        const unsigned cls = MemBufferPool::sizeClass(malloc_bytes);
+        if (cls != 0) {
+            malloc_bytes = MemBufferPool::capacity(cls);
+            p = (byte *) mem_buffer_pool.get(cls);
+            reused = (p != nullptr);
+        }
         malloc_bytes += 32;
-    byte *p = (byte *) ::malloc(malloc_bytes);
+        if (!p)
+            p = (byte *) MemBufferPool::allocBlock(malloc_bytes);
+        pool_class = upx_uint8_t(cls);
+    } else {
+        p = (byte *) ::malloc(malloc_bytes);
+    }
     NO_printf("MemBuffer::alloc %llu: %p\n", bytes, p);
     if (!p)
         throwOutOfMemoryException();
     size_in_bytes = ACC_ICONV(unsigned, bytes);
+    if (reused) {
+        stats.global_reuse_counter += 1;
+        stats.global_reused_bytes += size_in_bytes;
+    }
     if (use_simple_mcheck()) {
         p += 16;
         // store magic constants to detect buffer overruns
@@ -193,14 +367,38 @@ void MemBuffer::alloc(upx_uint64_t bytes) may_throw {
     memset(ptr, 0xfb, size_in_bytes);
     (void) VALGRIND_MAKE_MEM_UNDEFINED(ptr, size_in_bytes);
 #endif
-    stats.global_alloc_counter += 1;
-    stats.global_total_bytes += size_in_bytes;
-    stats.global_total_active_bytes += size_in_bytes;
+    statsAddAlloc(size_in_bytes);
 #if DEBUG || 1
     checkState();
 #endif
 }
 
+bool MemBuffer::allocMapped(int fd, upx_off_t offset, upx_uint64_t bytes) noexcept {
+    assert_noexcept(ptr == nullptr);
+    assert_noexcept(size_in_bytes == 0);
+#if WITH_MMAP
+    static const long page_size = ::sysconf(_SC_PAGESIZE);
+    if (fd < 0 || offset < 0 || bytes == 0 || !mem_size_valid_bytes(bytes) || page_size <= 0 ||
+        (offset % page_size) != 0)
+        return false;
+    // PROT_WRITE + MAP_PRIVATE: writes only touch private copies of the affected pages
+    void *p = ::mmap(nullptr, size_t(bytes), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+    if (p == MAP_FAILED)
+        return false;
+    debug_set(debug.last_return_address_alloc, upx_return_address());
+    ptr = upx::ptr_static_cast<pointer>(p);
+    size_in_bytes = ACC_ICONV(unsigned, bytes);
+    mapped = true;
+    statsAddAlloc(size_in_bytes);
+    return true;
+#else
+    UNUSED(fd);
+    UNUSED(offset);
+    UNUSED(bytes);
+    return false;
+#endif
+}
+
 void MemBuffer::dealloc() noexcept {
     if (ptr != nullptr) {
         debug_set(debug.last_return_address_dealloc, upx_return_address());
@@ -222,7 +420,12 @@ void MemBuffer::dealloc() noexcept {
 #endif
         stats.global_dealloc_counter += 1;
         stats.global_total_active_bytes -= size_in_bytes;
-        if (use_simple_mcheck()) {
+        if (mapped) {
+#if WITH_MMAP
+            (void) ::munmap((void *) ptr, size_in_bytes);
+#endif
+            mapped = false;
+        } else if (use_simple_mcheck()) {
             byte *p = (byte *) ptr;
             // clear magic constants
             set_ne32(p - 8, 0);
@@ -230,7 +433,11 @@ void MemBuffer::dealloc() noexcept {
             set_ne32(p + size_in_bytes, 0);
             set_ne32(p + size_in_bytes + 4, 0);
             //
-            ::free(p - 16); // NOLINT(clang-analyzer-unix.Malloc) // see NOTE above
+            const size_t block_bytes =
+                (pool_class != 0 ? MemBufferPool::capacity(pool_class) : size_in_bytes) + 32;
+            if (pool_class == 0 || !mem_buffer_pool.put(pool_class, p - 16))
+                MemBufferPool::freeBlock(p - 16, block_bytes);
+            pool_class = 0;
         } else {
             ::free(ptr); // NOLINT(clang-analyzer-unix.Malloc) // see NOTE above
         }
@@ -287,6 +494,51 @@ TEST_CASE("MemBuffer core") {
     }
 }
 
+TEST_CASE("MemBuffer pool") {
+    MemBuffer::releasePool();
+    MemBuffer::StatsInfo si1, si2;
+    MemBuffer::getStatsInfo(&si1);
+    void *p1;
+    {
+        MemBuffer mb(100000);
+        p1 = mb.getVoidPtr();
+    }
+    MemBuffer mb(110000); // same size class
+    MemBuffer::getStatsInfo(&si2);
+    if (!use_simple_mcheck())
+        return;
+    CHECK(mb.getVoidPtr() == p1);
+    CHECK(si2.reuse_counter == si1.reuse_counter + 1);
+    CHECK(si2.reused_bytes == si1.reused_bytes + 110000);
+    // the overrun checks still apply to the smaller size
+    byte *p = raw_bytes(mb, 0);
+    unsigned magic2 = get_ne32(p + 110000);
+    set_ne32(p + 110000, magic2 ^ 1);
+    CHECK_THROWS(mb.checkState());
+    set_ne32(p + 110000, magic2);
+    mb.checkState();
+    // small blocks are left to malloc()
+    {
+        MemBuffer small(1000);
+        small.checkState();
+    }
+    MemBuffer::getStatsInfo(&si1);
+    CHECK(si1.reuse_counter == si2.reuse_counter);
+    mb.dealloc();
+#if WITH_MMAP && defined(MADV_HUGEPAGE)
+    // big buffers start on a huge page, also when they get reused
+    for (size_t size : {MemBufferPool::HUGE_PAGE_SIZE, 3 * MemBufferPool::HUGE_PAGE_SIZE + 5}) {
+        for (int round = 0; round < 2; round++) {
+            MemBuffer big(size);
+            CHECK((ptr_get_address(big.getVoidPtr()) & (MemBufferPool::HUGE_PAGE_SIZE - 1)) == 0);
+            big.fill(0, big.getSize(), 0x55); // the whole buffer is accessible
+            big.checkState();
+        }
+    }
+#endif
+    MemBuffer::releasePool();
+}
+
 TEST_CASE("MemBuffer global overloads") {
     MemBuffer mb(1);
     MemBuffer mb4(4);
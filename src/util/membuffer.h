@@ -197,6 +197,11 @@ public:
     void alloc(upx_uint64_t bytes) may_throw;
     void allocForCompression(unsigned uncompressed_size, unsigned extra = 0) may_throw;
     void allocForDecompression(unsigned uncompressed_size, unsigned extra = 0) may_throw;
+    // use a private copy-on-write mapping of [offset, offset+bytes) of an open file
+    // instead of allocating and reading; returns false if this is not possible,
+    // in which case the buffer stays unallocated
+    bool allocMapped(int fd, upx_off_t offset, upx_uint64_t bytes) noexcept;
+    bool isMapped() const noexcept { return mapped; }
 
     void dealloc() noexcept;
     void checkState() const may_throw;
@@ -220,23 +225,45 @@ public:
         return (pointer) subref_impl(errfmt, skip, take);
     }
 
+    // process-wide allocation counters, see "--stats"
+    struct StatsInfo {
+        upx_uint64_t alloc_counter;
+        upx_uint64_t total_bytes;
+        upx_uint64_t peak_active_bytes;
+        upx_uint64_t reuse_counter; // allocations served from the pool of freed blocks
+        upx_uint64_t reused_bytes;
+    };
+    static void getStatsInfo(StatsInfo *info) noexcept;
+    static void resetStatsPeak() noexcept; // set the peak to the current active bytes
+    // free all cached blocks
+    static void releasePool() noexcept;
+
 private:
     void *subref_impl(const char *errfmt, size_t skip, size_t take) may_throw;
 
+    bool mapped = false;        // ptr comes from allocMapped()
+    upx_uint8_t pool_class = 0; // size class of the block, see MemBufferPool
+
     // static debug stats
     struct Stats {
         upx_std_atomic(upx_uint32_t) global_alloc_counter;
         upx_std_atomic(upx_uint32_t) global_dealloc_counter;
+        upx_std_atomic(upx_uint32_t) global_reuse_counter;
 #if WITH_THREADS
         // avoid link errors on some 32-bit platforms: undefined reference to __atomic_fetch_add_8
         upx_std_atomic(size_t) global_total_bytes; // stats may overflow on 32-bit systems
         upx_std_atomic(size_t) global_total_active_bytes;
+        upx_std_atomic(size_t) global_peak_active_bytes;
+        upx_std_atomic(size_t) global_reused_bytes;
 #else
         upx_std_atomic(upx_uint64_t) global_total_bytes;
         upx_std_atomic(upx_uint64_t) global_total_active_bytes;
+        upx_std_atomic(upx_uint64_t) global_peak_active_bytes;
+        upx_std_atomic(upx_uint64_t) global_reused_bytes;
 #endif
     };
     static Stats stats;
+    static void statsAddAlloc(unsigned bytes) noexcept;
 #if DEBUG
     // debugging aid
     struct Debug {
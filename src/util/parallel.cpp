@@ -0,0 +1,165 @@
+/* parallel.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+#include "../conf.h"
+#include "parallel.h"
+#include "stats.h"
+#if WITH_THREADS
+#include <thread>
+#endif
+
+namespace upx {
+
+/*************************************************************************
+//
+**************************************************************************/
+
+unsigned parallel_get_num_threads(int requested) noexcept {
+#if WITH_THREADS
+    if (requested == 1)
+        return 1;
+    unsigned n = requested > 0 ? unsigned(requested) : std::thread::hardware_concurrency();
+    if (n < 1)
+        n = 1;
+    return UPX_MIN(n, PARALLEL_MAX_THREADS);
+#else
+    UNUSED(requested);
+    return 1;
+#endif
+}
+
+#if WITH_THREADS
+namespace {
+struct ParallelState final {
+    unsigned n;
+    parallel_func_t func;
+    void *user;
+    Options *parent_opt; // worker threads inherit the per-thread "opt"
+    PhaseStats *parent_stats;
+    std::atomic<unsigned> next_index{0};
+    std::atomic<bool> failed{false};
+    std::mutex lock_mutex; // for "exception"
+    std::exception_ptr exception = nullptr;
+
+    void run() noexcept {
+        for (;;) {
+            if (failed.load())
+                break;
+            const unsigned index = next_index.fetch_add(1);
+            if (index >= n)
+                break;
+            try {
+                func(index, user);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(lock_mutex);
+                if (!failed.exchange(true))
+                    exception = std::current_exception();
+            }
+        }
+    }
+};
+} // namespace
+#endif // WITH_THREADS
+
+void parallel_for_impl(unsigned n, unsigned nthreads, parallel_func_t func, void *user) {
+    assert(func != nullptr);
+    nthreads = UPX_MIN(nthreads, UPX_MIN(n, PARALLEL_MAX_THREADS));
+#if WITH_THREADS
+    if (nthreads >= 2) {
+        ParallelState s;
+        s.n = n;
+        s.func = func;
+        s.user = user;
+        s.parent_opt = opt;
+        s.parent_stats = phase_stats_current;
+        std::thread threads[PARALLEL_MAX_THREADS - 1];
+        unsigned started = 0;
+        try {
+            for (; started < nthreads - 1; started++)
+                threads[started] = std::thread([&s]() noexcept {
+                    opt = s.parent_opt;
+                    phase_stats_current = s.parent_stats;
+                    s.run();
+                });
+        } catch (...) {
+            // could not start a thread; just continue with the threads we have
+        }
+        s.run(); // the calling thread participates
+        for (unsigned i = 0; i < started; i++)
+            threads[i].join();
+        if (s.exception)
+            std::rethrow_exception(s.exception);
+        return;
+    }
+#endif
+    UNUSED(nthreads);
+    for (unsigned index = 0; index < n; index++)
+        func(index, user);
+}
+
+} // namespace upx
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("upx::parallel_get_num_threads") {
+    CHECK(upx::parallel_get_num_threads(1) == 1);
+    CHECK(upx::parallel_get_num_threads(-1) >= 1);
+    CHECK(upx::parallel_get_num_threads(0) >= 1);
+    CHECK(upx::parallel_get_num_threads(100000) <= upx::PARALLEL_MAX_THREADS);
+#if !(WITH_THREADS)
+    CHECK(upx::parallel_get_num_threads(4) == 1);
+#endif
+}
+
+TEST_CASE("upx::parallel_for") {
+    constexpr unsigned N = 1000;
+    unsigned a[N];
+    for (unsigned nthreads = 1; nthreads <= 8; nthreads *= 2) {
+        memset(a, 0, sizeof(a));
+        upx::parallel_for(N, nthreads, [&a](unsigned i) { a[i] += i + 1; });
+        bool ok = true;
+        for (unsigned i = 0; i < N; i++)
+            ok = ok && (a[i] == i + 1);
+        CHECK(ok);
+    }
+    upx::parallel_for(0, 4, [](unsigned) { assert_noexcept(false); });
+    // worker threads inherit "opt"
+    const Options *const parent_opt = opt;
+    upx_std_atomic(unsigned) opt_mismatch{0};
+    upx::parallel_for(N, 4, [parent_opt, &opt_mismatch](unsigned) {
+        if (opt != parent_opt)
+            opt_mismatch++;
+    });
+    CHECK(opt_mismatch == 0);
+    CHECK_THROWS(upx::parallel_for(N, 4, [](unsigned i) {
+        if (i == 42)
+            throwInternalError("parallel_for");
+    }));
+}
+
+/* vim:set ts=4 sw=4 et: */
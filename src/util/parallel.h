@@ -0,0 +1,60 @@
+/* parallel.h --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+// A minimal worker pool: run independent jobs on a number of threads.
+// Without WITH_THREADS all jobs simply run in the calling thread.
+
+#pragma once
+
+namespace upx {
+
+// arbitrary limit, increase as needed
+static constexpr unsigned PARALLEL_MAX_THREADS = 256;
+
+// map a user request (e.g. "--threads=N") to the actual number of threads;
+// 0 means "one thread per CPU"; always returns 1 if WITH_THREADS is not enabled
+unsigned parallel_get_num_threads(int requested) noexcept;
+
+typedef void (*parallel_func_t)(unsigned index, void *user);
+
+// call func(index, user) for all index in [0, n) using up to nthreads threads;
+// the calling thread does participate; jobs are started in increasing index order;
+// if any job throws then no new jobs are started and the first exception
+// gets re-thrown in the calling thread after all threads have finished;
+// the worker threads use the same "opt" and "--stats" target as the calling thread
+void parallel_for_impl(unsigned n, unsigned nthreads, parallel_func_t func, void *user) may_throw;
+
+template <class Func>
+inline void parallel_for(unsigned n, unsigned nthreads, Func &&f) may_throw {
+    typedef std::remove_reference_t<Func> F;
+    parallel_for_impl(
+        n, nthreads, [](unsigned index, void *user) { (*static_cast<F *>(user))(index); },
+        const_cast<void *>(static_cast<const void *>(std::addressof(f))));
+}
+
+} // namespace upx
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,116 @@
+/* simd.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+
+#include "../conf.h"
+#include "simd.h"
+#if (WITH_SIMD) && (ACC_CC_MSC)
+#include <intrin.h>
+#endif
+
+namespace upx {
+
+/*************************************************************************
+//
+**************************************************************************/
+
+#if WITH_SIMD
+static int simd_detect() noexcept {
+    if (is_envvar_true("UPX_DEBUG_DISABLE_SIMD"))
+        return SIMD_NONE;
+#if (ACC_CC_CLANG || ACC_CC_GNUC)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return SIMD_SSSE3;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+#elif (ACC_CC_MSC)
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool ssse3 = (info[2] & (1 << 9)) != 0;
+    // AVX2 also needs OS support for saving the ymm registers (OSXSAVE + XCR0)
+    bool avx2 = false;
+    if (max_leaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28))) {
+        if ((_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+    }
+    if (avx2 && ssse3 && sse2)
+        return SIMD_AVX2;
+    if (ssse3 && sse2)
+        return SIMD_SSSE3;
+    if (sse2)
+        return SIMD_SSE2;
+#endif
+    return SIMD_NONE;
+}
+#endif // WITH_SIMD
+
+static upx_std_atomic(int) simd_limit{SIMD_AVX2};
+
+int simd_get_level() noexcept {
+#if WITH_SIMD
+    static const int detected = simd_detect(); // thread-safe init
+    const int limit = simd_limit;
+    return detected < limit ? detected : limit;
+#else
+    return SIMD_NONE;
+#endif
+}
+
+int simd_set_limit(int level) noexcept {
+    if (level < SIMD_NONE)
+        level = SIMD_NONE;
+    const int old_limit = simd_limit;
+    simd_limit = level;
+    return old_limit;
+}
+
+} // namespace upx
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("upx::simd_get_level") {
+    const int level = upx::simd_get_level();
+    CHECK((level >= upx::SIMD_NONE && level <= upx::SIMD_AVX2));
+#if !(WITH_SIMD)
+    CHECK(level == upx::SIMD_NONE);
+#endif
+    const int old_limit = upx::simd_set_limit(upx::SIMD_NONE);
+    CHECK(upx::simd_get_level() == upx::SIMD_NONE);
+    upx::simd_set_limit(old_limit);
+    CHECK(upx::simd_get_level() == level);
+}
+
+/* vim:set ts=4 sw=4 et: */
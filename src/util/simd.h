@@ -0,0 +1,68 @@
+/* simd.h --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+// Runtime CPU feature detection for optional SIMD code paths.
+// All SIMD code must have a portable scalar fallback that produces
+// bit-identical results.
+
+#pragma once
+
+#if !defined(WITH_SIMD)
+#if (ACC_ARCH_AMD64 || ACC_ARCH_I386) && (ACC_CC_CLANG || ACC_CC_GNUC || ACC_CC_MSC)
+#define WITH_SIMD 1
+#else
+#define WITH_SIMD 0
+#endif
+#endif
+
+// enable instruction set extensions for a single function
+#if (WITH_SIMD) && (ACC_CC_CLANG || ACC_CC_GNUC)
+#define upx_simd_target(x) __attribute__((__target__(x)))
+#else
+#define upx_simd_target(x) /*empty*/
+#endif
+
+namespace upx {
+
+enum SimdLevel : int {
+    SIMD_NONE = 0,
+    SIMD_SSE2 = 1,
+    SIMD_SSSE3 = 2,
+    SIMD_AVX2 = 3,
+};
+
+// the best supported SIMD level, limited by simd_set_limit();
+// always SIMD_NONE if WITH_SIMD is not enabled or
+// if the environment variable UPX_DEBUG_DISABLE_SIMD is set
+int simd_get_level() noexcept;
+
+// limit the SIMD level, e.g. to compare against the scalar code in
+// doctests and benchmarks; returns the previous limit
+int simd_set_limit(int level) noexcept;
+
+} // namespace upx
+
+/* vim:set ts=4 sw=4 et: */
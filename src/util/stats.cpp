@@ -0,0 +1,138 @@
+/* stats.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+#include "../conf.h"
+#include "membuffer.h"
+#include "stats.h"
+
+namespace upx {
+
+upx_thread_local PhaseStats *phase_stats_current = nullptr;
+
+const char *stats_phase_name(StatsPhase phase) noexcept {
+    static const char *const names[STATS_NUM_PHASES] = {
+        "read",   "probe",   "headers", "filter", "compress", "decompress",
+        "overlap", "loader", "verify",  "write",  "total",
+    };
+    return phase < STATS_NUM_PHASES ? names[phase] : "?";
+}
+
+void stats_begin(PhaseStats *stats) noexcept {
+    for (unsigned i = 0; i < STATS_NUM_PHASES; i++) {
+        stats->nanos[i] = 0;
+        stats->calls[i] = 0;
+    }
+    MemBuffer::StatsInfo mi;
+    // NOTE: the peak is process-wide, so this also resets it for files that are
+    //   being processed concurrently with "-j"
+    MemBuffer::resetStatsPeak();
+    MemBuffer::getStatsInfo(&mi);
+    stats->mem_alloc_counter_start = mi.alloc_counter;
+    stats->mem_total_bytes_start = mi.total_bytes;
+    stats->mem_reused_bytes_start = mi.reused_bytes;
+    phase_stats_current = stats;
+}
+
+void stats_end(FILE *f, const char *iname, PhaseStats *stats, bool json) noexcept {
+    assert_noexcept(phase_stats_current == stats);
+    phase_stats_current = nullptr;
+    MemBuffer::StatsInfo mi;
+    MemBuffer::getStatsInfo(&mi);
+    // MemBuffer counters are process-wide; with "-j" they include other files
+    const upx_uint64_t allocs = mi.alloc_counter - stats->mem_alloc_counter_start;
+    const upx_uint64_t alloc_bytes = mi.total_bytes - stats->mem_total_bytes_start;
+    const upx_uint64_t reused_bytes = mi.reused_bytes - stats->mem_reused_bytes_start;
+
+    if (json) {
+        con_fprintf(f, "{\"file\": \"");
+        for (const char *s = iname; *s; s++) {
+            const unsigned char c = (unsigned char) *s;
+            if (c == '"' || c == '\\')
+                con_fprintf(f, "\\%c", c);
+            else if (c < 0x20)
+                con_fprintf(f, "\\u%04x", c);
+            else
+                con_fprintf(f, "%c", c);
+        }
+        con_fprintf(f, "\", \"phases\": {");
+        const char *sep = "";
+        for (unsigned i = 0; i < STATS_NUM_PHASES; i++) {
+            if (stats->calls[i] == 0)
+                continue;
+            con_fprintf(f, "%s\"%s\": {\"calls\": %llu, \"ms\": %.3f}", sep,
+                        stats_phase_name(StatsPhase(i)), (unsigned long long) stats->calls[i],
+                        double(stats->nanos[i]) / 1e6);
+            sep = ", ";
+        }
+        con_fprintf(f,
+                    "}, \"mem\": {\"allocs\": %llu, \"alloc_bytes\": %llu, \"peak_bytes\": "
+                    "%llu, \"reused_bytes\": %llu}}\n",
+                    (unsigned long long) allocs, (unsigned long long) alloc_bytes,
+                    (unsigned long long) mi.peak_active_bytes, (unsigned long long) reused_bytes);
+        return;
+    }
+
+    con_fprintf(f, "stats for %s:\n", iname);
+    for (unsigned i = 0; i < STATS_NUM_PHASES; i++) {
+        if (stats->calls[i] == 0)
+            continue;
+        con_fprintf(f, "  %-12s %10.3f ms %8llu calls\n", stats_phase_name(StatsPhase(i)),
+                    double(stats->nanos[i]) / 1e6, (unsigned long long) stats->calls[i]);
+    }
+    con_fprintf(f, "  %-12s %llu allocations, %llu bytes allocated, peak %llu bytes\n", "memory",
+                (unsigned long long) allocs, (unsigned long long) alloc_bytes,
+                (unsigned long long) mi.peak_active_bytes);
+    con_fprintf(f, "  %-12s %llu bytes reused from the MemBuffer pool\n", "",
+                (unsigned long long) reused_bytes);
+}
+
+} // namespace upx
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("upx::PhaseTimer") {
+    using namespace upx;
+    PhaseStats *const saved = phase_stats_current;
+    phase_stats_current = nullptr;
+    { PhaseTimer t(STATS_COMPRESS); } // disabled: does nothing
+    PhaseStats stats;
+    phase_stats_current = &stats;
+    {
+        PhaseTimer t1(STATS_COMPRESS);
+        PhaseTimer t2(STATS_FILTER);
+    }
+    { PhaseTimer t(STATS_COMPRESS); }
+    phase_stats_current = saved;
+    CHECK(stats.calls[STATS_COMPRESS] == 2);
+    CHECK(stats.calls[STATS_FILTER] == 1);
+    CHECK(stats.calls[STATS_TOTAL] == 0);
+    CHECK(stats.nanos[STATS_TOTAL] == 0);
+    CHECK(strcmp(stats_phase_name(STATS_TOTAL), "total") == 0);
+}
+
+/* vim:set ts=4 sw=4 et: */
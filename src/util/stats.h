@@ -0,0 +1,117 @@
+/* stats.h --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+// Per-file phase timing for "--stats". A PhaseTimer adds the time of its
+// scope to the PhaseStats of the current file; if "--stats" is not in
+// effect the current PhaseStats is nullptr and a PhaseTimer does nothing.
+// Phases may nest (e.g. "verify" includes "decompress"), and phases that
+// run on several threads add up the time of all threads.
+
+#pragma once
+#include <chrono>
+
+namespace upx {
+
+enum StatsPhase : unsigned {
+    STATS_READ,       // InputFile::read()
+    STATS_PROBE,      // finding a packer: canPack() / canUnpack()
+    STATS_HEADERS,    // parsing and rebuilding imports, relocs and resources
+    STATS_FILTER,     // filter(), undo() and unfilter()
+    STATS_COMPRESS,   // upx_compress()
+    STATS_DECOMPRESS, // upx_decompress()
+    STATS_OVERLAP,    // findOverlapOverhead()
+    STATS_LOADER,     // buildLoader() and the linker
+    STATS_VERIFY,     // verifyOverlappingDecompression() and friends
+    STATS_WRITE,      // OutputFile::write()
+    STATS_TOTAL,      // the whole file
+    STATS_NUM_PHASES
+};
+
+struct PhaseStats final {
+#if WITH_THREADS && (ACC_SIZEOF_SIZE_T < 8)
+    // avoid link errors on some 32-bit platforms: undefined reference to __atomic_fetch_add_8;
+    // a 32-bit counter would wrap after 4.29 seconds, so use a lock instead
+    upx_uint64_t nanos[STATS_NUM_PHASES] = {};
+    upx_uint64_t calls[STATS_NUM_PHASES] = {};
+    std::mutex lock;
+
+    void add(StatsPhase phase, upx_uint64_t ns) noexcept {
+        std::lock_guard<std::mutex> guard(lock);
+        nanos[phase] += ns;
+        calls[phase] += 1;
+    }
+#else
+    upx_std_atomic(upx_uint64_t) nanos[STATS_NUM_PHASES] = {};
+    upx_std_atomic(upx_uint64_t) calls[STATS_NUM_PHASES] = {};
+
+    void add(StatsPhase phase, upx_uint64_t ns) noexcept {
+        nanos[phase] += ns;
+        calls[phase] += 1;
+    }
+#endif
+    // MemBuffer counters at the start of the file
+    upx_uint64_t mem_alloc_counter_start = 0;
+    upx_uint64_t mem_total_bytes_start = 0;
+    upx_uint64_t mem_reused_bytes_start = 0;
+};
+
+// the stats of the file that is being processed by this thread, or nullptr;
+// worker threads of upx::parallel_for() inherit this from the calling thread
+extern upx_thread_local PhaseStats *phase_stats_current;
+
+class PhaseTimer final {
+public:
+    explicit PhaseTimer(StatsPhase p) noexcept : stats(phase_stats_current), phase(p) {
+        if (stats != nullptr)
+            t0 = clock::now();
+    }
+    ~PhaseTimer() noexcept {
+        if (stats != nullptr)
+            stats->add(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0)
+                                  .count());
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+    PhaseStats *const stats;
+    const StatsPhase phase;
+    clock::time_point t0;
+
+    UPX_CXX_DISABLE_COPY_MOVE(PhaseTimer)
+    UPX_CXX_DISABLE_NEW_DELETE_NO_VIRTUAL(PhaseTimer)
+};
+
+const char *stats_phase_name(StatsPhase phase) noexcept;
+
+// start collecting / print the collected stats of one file;
+// the memory figures come from the process-wide MemBuffer counters, and
+// stats_begin() resets the peak, so with "-j" they are only meaningful for "-j1"
+void stats_begin(PhaseStats *stats) noexcept;
+void stats_end(FILE *f, const char *iname, PhaseStats *stats, bool json) noexcept;
+
+} // namespace upx
+
+/* vim:set ts=4 sw=4 et: */
@@ -36,6 +36,8 @@
 #undef HAVE_MKDIR
 #include "miniacc.h"
 #include "../conf.h"
+#include "../check/dt_bench.h"
+#include "../check/dt_data.h"
 
 /*************************************************************************
 // upx_rsize_t and mem_size: assert sane memory buffer sizes to protect
@@ -434,6 +436,74 @@ template void upx_std_stable_sort<56>(void *, size_t, upx_compare_func_t);
 template void upx_std_stable_sort<72>(void *, size_t, upx_compare_func_t);
 #endif // UPX_CONFIG_USE_STABLE_SORT
 
+// stable LSD radix sort; the sort key is formed by the bytes at key_offsets[],
+// given from least to most significant; one counting pass for all key bytes,
+// then one scatter pass per key byte that is not constant across all elements
+template <size_t ElementSize>
+void upx_radix_sort(void *array, size_t n, const byte *key_offsets, unsigned nkeys) {
+    static_assert(ElementSize >= 1 && ElementSize <= 16);
+    mem_size_assert(ElementSize, n); // check size
+    assert(nkeys >= 1 && nkeys <= ElementSize);
+    if (n < 2)
+        return;
+    byte *const a = (byte *) array;
+    if (n < 32) {
+        // stable insertion sort for tiny arrays
+        auto less = [key_offsets, nkeys](const byte *x, const byte *y) -> bool {
+            for (unsigned k = nkeys; k-- > 0;)
+                if (x[key_offsets[k]] != y[key_offsets[k]])
+                    return x[key_offsets[k]] < y[key_offsets[k]];
+            return false;
+        };
+        byte tmp[ElementSize];
+        for (size_t i = 1; i < n; i++) {
+            byte *p = a + ElementSize * i;
+            if (!less(p, p - ElementSize))
+                continue;
+            memcpy(tmp, p, ElementSize);
+            do {
+                memcpy(p, p - ElementSize, ElementSize);
+                p -= ElementSize;
+            } while (p != a && less(tmp, p - ElementSize));
+            memcpy(p, tmp, ElementSize);
+        }
+        return;
+    }
+    size_t counts[ElementSize][256];
+    memset(counts, 0, sizeof(counts));
+    for (const byte *p = a, *end = a + ElementSize * n; p != end; p += ElementSize)
+        for (unsigned k = 0; k < nkeys; k++)
+            counts[k][p[key_offsets[k]]] += 1;
+    byte *const buf = New(byte, ElementSize * n);
+    byte *src = a, *dst = buf;
+    for (unsigned k = 0; k < nkeys; k++) {
+        size_t *const c = counts[k];
+        const unsigned off = key_offsets[k];
+        if (c[src[off]] == n)
+            continue; // all elements share this key byte
+        size_t pos = 0;
+        for (unsigned b = 0; b < 256; b++) {
+            const size_t cnt = c[b];
+            c[b] = pos;
+            pos += cnt;
+        }
+        for (const byte *p = src, *end = src + ElementSize * n; p != end; p += ElementSize)
+            memcpy(dst + ElementSize * c[p[off]]++, p, ElementSize);
+        std::swap(src, dst);
+    }
+    if (src != a)
+        memcpy(a, src, ElementSize * n);
+    delete[] buf;
+}
+
+template void upx_radix_sort<4>(void *, size_t, const byte *, unsigned);
+template void upx_radix_sort<5>(void *, size_t, const byte *, unsigned);
+
+void upx_radix_sort_le32(void *array, size_t n) {
+    static const byte key_offsets[4] = {0, 1, 2, 3};
+    upx_radix_sort<4>(array, n, key_offsets, 4);
+}
+
 #if !defined(DOCTEST_CONFIG_DISABLE) && DEBUG
 #if __cplusplus >= 202002L // use C++20 std::next_permutation() to test all permutations
 namespace {
@@ -507,6 +577,89 @@ TEST_CASE("upx_std_stable_sort") {
 #endif // C++20
 #endif // DEBUG
 
+namespace {
+struct TestRadixSort {
+    static noinline bool test_le32(size_t n, unsigned mask, unsigned seed) {
+        LE32 *a = New(LE32, n + 1);
+        LE32 *b = New(LE32, n + 1);
+        upx::testdata::Rng rng(seed);
+        for (size_t i = 0; i < n; i++) {
+            const unsigned r = rng.next();
+            a[i] = b[i] = (r ^ (r >> 15)) & mask;
+        }
+        upx_qsort(a, n, 4, le32_compare);
+        upx_radix_sort_le32(b, n);
+        const bool ok = n == 0 || memcmp(a, b, 4 * n) == 0;
+        delete[] a;
+        delete[] b;
+        return ok;
+    }
+    // 5-byte records: ne32 position, then one type byte
+    static int __acc_cdecl_qsort compare5(const void *a, const void *b) {
+        const unsigned pos1 = get_ne32(a);
+        const unsigned pos2 = get_ne32(b);
+        if (pos1 != pos2)
+            return pos1 < pos2 ? -1 : 1;
+        return ((const byte *) a)[4] - ((const byte *) b)[4];
+    }
+    static noinline bool test_5(size_t n, unsigned seed) {
+#if (ACC_ABI_BIG_ENDIAN)
+        static const byte key_offsets[5] = {4, 3, 2, 1, 0};
+#else
+        static const byte key_offsets[5] = {4, 0, 1, 2, 3};
+#endif
+        byte *a = New(byte, 5 * n + 1);
+        byte *b = New(byte, 5 * n + 1);
+        upx::testdata::Rng rng(seed);
+        for (size_t i = 0; i < n; i++) {
+            const unsigned r = rng.next();
+            set_ne32(a + 5 * i, (r >> 8) & 0xfff0);
+            a[5 * i + 4] = byte(1 + (r & 7));
+        }
+        memcpy(b, a, 5 * n);
+        upx_qsort(a, n, 5, compare5);
+        upx_radix_sort<5>(b, n, key_offsets, 5);
+        const bool ok = n == 0 || memcmp(a, b, 5 * n) == 0;
+        delete[] a;
+        delete[] b;
+        return ok;
+    }
+};
+} // namespace
+
+TEST_CASE("upx_radix_sort") {
+    for (size_t n : {0, 1, 2, 3, 31, 32, 33, 1000, 70000}) {
+        CHECK(TestRadixSort::test_le32(n, 0xffffffff, unsigned(n)));
+        CHECK(TestRadixSort::test_le32(n, 0x000ffffc, unsigned(n) + 1)); // constant high bytes
+        CHECK(TestRadixSort::test_le32(n, 0x00000003, unsigned(n) + 2)); // many duplicates
+        CHECK(TestRadixSort::test_5(n, unsigned(n)));
+    }
+}
+
+TEST_CASE("bench upx_radix_sort" * doctest::skip()) {
+    // synthetic reloc table: 1M fixups at 4-byte aligned offsets in a 64 MiB image
+    constexpr size_t N = 1024 * 1024;
+    LE32 *relocs = New(LE32, N);
+    LE32 *work = New(LE32, N);
+    upx::testdata::Rng rng(0x12345678);
+    for (size_t i = 0; i < N; i++) {
+        const unsigned r = rng.next();
+        relocs[i] = (r ^ (r >> 15)) & 0x03fffffc;
+    }
+    const double t_qsort = upx::bench::best_time([&]() {
+        memcpy(work, relocs, 4 * N);
+        upx_qsort(work, N, 4, le32_compare);
+    });
+    const double t_radix = upx::bench::best_time([&]() {
+        memcpy(work, relocs, 4 * N);
+        upx_radix_sort_le32(work, N);
+    });
+    upx::bench::report_items("sort 1M le32 relocs", "qsort", N, t_qsort);
+    upx::bench::report_items("sort 1M le32 relocs", "radix", N, t_radix);
+    delete[] relocs;
+    delete[] work;
+}
+
 /*************************************************************************
 // qsort() util
 **************************************************************************/
@@ -178,6 +178,13 @@ void upx_std_stable_sort(void *array, size_t n, upx_compare_func_t compare);
 #define upx_qsort ::qsort
 #endif
 
+// stable LSD radix sort of fixed-size elements in O(n); the sort key consists
+// of the bytes at key_offsets[0..nkeys), from least to most significant
+template <size_t ElementSize>
+void upx_radix_sort(void *array, size_t n, const byte *key_offsets, unsigned nkeys) may_throw;
+// same result as upx_qsort(array, n, 4, le32_compare)
+void upx_radix_sort_le32(void *array, size_t n) may_throw;
+
 /*************************************************************************
 // misc support functions
 **************************************************************************/
@@ -0,0 +1,262 @@
+/* winners.cpp --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+#include "../conf.h"
+#include "../file.h"
+#include "membuffer.h"
+#include "winners.h"
+
+#if !defined(SH_DENYWR)
+#define SH_DENYWR (-1)
+#endif
+
+namespace upx {
+
+namespace {
+
+constexpr unsigned WS_MAX_ENTRIES = 64;
+constexpr unsigned WS_MAX_METHODS = 32;
+constexpr unsigned WS_MAX_FILE_SIZE = 1024 * 1024;
+
+struct Entry final {
+    char packer[32];
+    char kind[8];
+    unsigned best_ppm; // 0 means unknown
+    unsigned nmethods;
+    struct {
+        int method;
+        unsigned wins;
+    } methods[WS_MAX_METHODS];
+    unsigned filter_wins[256];
+};
+
+Entry ws_entries[WS_MAX_ENTRIES];
+unsigned ws_nentries = 0;
+#if WITH_THREADS
+std::mutex ws_mutex;
+#endif
+
+struct WsLock final {
+#if WITH_THREADS
+    std::lock_guard<std::mutex> guard{ws_mutex};
+#endif
+};
+
+Entry *ws_find(const char *packer, const char *kind, bool create) noexcept {
+    for (unsigned i = 0; i < ws_nentries; i++) {
+        Entry *e = &ws_entries[i];
+        if (strcmp(e->packer, packer) == 0 && strcmp(e->kind, kind) == 0)
+            return e;
+    }
+    if (!create || ws_nentries >= WS_MAX_ENTRIES || strlen(packer) >= sizeof(Entry::packer) ||
+        strlen(kind) >= sizeof(Entry::kind))
+        return nullptr;
+    Entry *e = &ws_entries[ws_nentries++];
+    memset(e, 0, sizeof(*e));
+    strcpy(e->packer, packer);
+    strcpy(e->kind, kind);
+    return e;
+}
+
+void ws_add_method(Entry *e, int method, unsigned wins) noexcept {
+    for (unsigned i = 0; i < e->nmethods; i++) {
+        if (e->methods[i].method == method) {
+            e->methods[i].wins += wins;
+            return;
+        }
+    }
+    if (e->nmethods < WS_MAX_METHODS) {
+        e->methods[e->nmethods].method = method;
+        e->methods[e->nmethods].wins = wins;
+        e->nmethods++;
+    }
+}
+
+void ws_add_best(Entry *e, unsigned ppm) noexcept {
+    if (ppm != 0 && (e->best_ppm == 0 || ppm < e->best_ppm))
+        e->best_ppm = ppm;
+}
+
+} // namespace
+
+/*************************************************************************
+// file i/o; errors are silently ignored
+**************************************************************************/
+
+void winner_stats_load(const char *fname) noexcept {
+    WsLock lock;
+    try {
+        InputFile fi;
+        fi.sopen(fname, O_RDONLY | O_BINARY, SH_DENYWR);
+        const upx_off_t size = fi.st_size();
+        if (size <= 0 || size > WS_MAX_FILE_SIZE)
+            return;
+        MemBuffer mb(unsigned(size) + 1);
+        fi.readx(mb, size);
+        mb[unsigned(size)] = 0;
+        char *line = (char *) mb.getVoidPtr();
+        while (*line) {
+            char *next = strchr(line, '\n');
+            if (next != nullptr)
+                *next++ = 0;
+            else
+                next = line + strlen(line);
+            char what[16], packer[32], kind[8];
+            int id = 0;
+            unsigned n = 0;
+            const int r = sscanf(line, "%15s %31s %7s %i %u", what, packer, kind, &id, &n);
+            Entry *e = r >= 4 ? ws_find(packer, kind, true) : nullptr;
+            if (e == nullptr)
+                ; // comment or bad line
+            else if (r == 4 && strcmp(what, "best") == 0 && id > 0)
+                ws_add_best(e, unsigned(id));
+            else if (r == 5 && strcmp(what, "method") == 0)
+                ws_add_method(e, id, n);
+            else if (r == 5 && strcmp(what, "filter") == 0 && id >= 0 && id < 256)
+                e->filter_wins[id] += n;
+            line = next;
+        }
+    } catch (...) {
+        // ignore errors; a missing file simply means "no stats yet"
+    }
+}
+
+void winner_stats_save(const char *fname) noexcept {
+    WsLock lock;
+    if (ws_nentries == 0)
+        return;
+    char tname[ACC_FN_PATH_MAX + 1];
+    if (strlen(fname) + 8 >= sizeof(tname))
+        return;
+    snprintf(tname, sizeof(tname), "%s.tmp", fname);
+    bool created = false;
+    try {
+        // at most 1 + WS_MAX_METHODS + 256 lines of less than 80 chars per entry
+        constexpr unsigned MAX_LINE = 80;
+        MemBuffer mb(64 + ws_nentries * (1 + WS_MAX_METHODS + 256) * MAX_LINE);
+        char *const buf = (char *) mb.getVoidPtr();
+        unsigned len = 0;
+        auto put = [&](const char *format, auto... args) {
+            len += snprintf(buf + len, MAX_LINE, format, args...);
+        };
+        put("# UPX winner stats 1\n");
+        for (unsigned i = 0; i < ws_nentries; i++) {
+            const Entry *e = &ws_entries[i];
+            if (e->best_ppm != 0)
+                put("best %s %s %u\n", e->packer, e->kind, e->best_ppm);
+            for (unsigned k = 0; k < e->nmethods; k++)
+                put("method %s %s %#x %u\n", e->packer, e->kind, e->methods[k].method,
+                    e->methods[k].wins);
+            for (unsigned k = 0; k < 256; k++)
+                if (e->filter_wins[k] != 0)
+                    put("filter %s %s %#x %u\n", e->packer, e->kind, k, e->filter_wins[k]);
+        }
+        OutputFile fo;
+        fo.open(tname, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, 0644);
+        created = true;
+        fo.write(buf, len);
+        fo.closex();
+        FileBase::rename(tname, fname);
+        created = false;
+    } catch (...) {
+        // ignore errors
+    }
+    if (created)
+        (void) FileBase::unlink_noexcept(tname);
+}
+
+/*************************************************************************
+// queries and updates
+**************************************************************************/
+
+unsigned winner_stats_method_wins(const char *packer, const char *kind, int method) noexcept {
+    WsLock lock;
+    const Entry *e = ws_find(packer, kind, false);
+    if (e != nullptr)
+        for (unsigned k = 0; k < e->nmethods; k++)
+            if (e->methods[k].method == method)
+                return e->methods[k].wins;
+    return 0;
+}
+
+unsigned winner_stats_filter_wins(const char *packer, const char *kind, int filter) noexcept {
+    WsLock lock;
+    const Entry *e = ws_find(packer, kind, false);
+    return (e != nullptr && filter >= 0 && filter < 256) ? e->filter_wins[filter] : 0;
+}
+
+unsigned winner_stats_best_ppm(const char *packer, const char *kind) noexcept {
+    WsLock lock;
+    const Entry *e = ws_find(packer, kind, false);
+    return e != nullptr ? e->best_ppm : 0;
+}
+
+void winner_stats_add(const char *packer, const char *kind, int method, int filter,
+                      unsigned u_len, unsigned c_len) noexcept {
+    WsLock lock;
+    Entry *e = ws_find(packer, kind, true);
+    if (e == nullptr || u_len == 0)
+        return;
+    ws_add_method(e, method, 1);
+    if (filter >= 0 && filter < 256)
+        e->filter_wins[filter] += 1;
+    const upx_uint64_t ppm = upx_uint64_t(c_len) * 1000000 / u_len;
+    ws_add_best(e, unsigned(UPX_MAX(UPX_MIN(ppm, upx_uint64_t(1000000)), upx_uint64_t(1))));
+}
+
+void winner_stats_clear() noexcept {
+    WsLock lock;
+    ws_nentries = 0;
+}
+
+} // namespace upx
+
+/*************************************************************************
+// doctest checks
+**************************************************************************/
+
+TEST_CASE("upx::winner_stats") {
+    using namespace upx;
+    winner_stats_clear();
+    CHECK(winner_stats_method_wins("linux/amd64", "code", M_LZMA) == 0);
+    CHECK(winner_stats_best_ppm("linux/amd64", "code") == 0);
+    winner_stats_add("linux/amd64", "code", M_LZMA, 0x49, 1000, 400);
+    winner_stats_add("linux/amd64", "code", M_LZMA, 0x49, 1000, 500);
+    winner_stats_add("linux/amd64", "code", M_NRV2E_LE32, 0x49, 1000, 300);
+    winner_stats_add("linux/amd64", "data", M_NRV2B_LE32, 0, 1000, 900);
+    CHECK(winner_stats_method_wins("linux/amd64", "code", M_LZMA) == 2);
+    CHECK(winner_stats_method_wins("linux/amd64", "code", M_NRV2E_LE32) == 1);
+    CHECK(winner_stats_method_wins("linux/amd64", "data", M_LZMA) == 0);
+    CHECK(winner_stats_filter_wins("linux/amd64", "code", 0x49) == 3);
+    CHECK(winner_stats_filter_wins("linux/amd64", "code", 0x46) == 0);
+    CHECK(winner_stats_best_ppm("linux/amd64", "code") == 300000);
+    CHECK(winner_stats_best_ppm("linux/amd64", "data") == 900000);
+    CHECK(winner_stats_best_ppm("linux/i386", "code") == 0);
+    winner_stats_clear();
+    CHECK(winner_stats_filter_wins("linux/amd64", "code", 0x49) == 0);
+}
+
+/* vim:set ts=4 sw=4 et: */
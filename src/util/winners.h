@@ -0,0 +1,57 @@
+/* winners.h --
+
+   This file is part of the UPX executable compressor.
+
+   Copyright (C) 1996-2024 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   UPX and the UCL library are free software; you can redistribute them
+   and/or modify them under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+ */
+
+
+// "--winner-stats=FILE": remember which compression methods and filters
+// won in Packer::compressWithFilters(), per packer (e.g. "linux/amd64")
+// and kind of data ("code" or "data"). compressWithFilters() uses this
+// to try the likely winners first, and with "--early-stop" to stop the
+// search as soon as the result is good enough.
+// The file is a simple text file; it gets read by do_files() before
+// the first file and written back after the last one.
+
+#pragma once
+
+namespace upx {
+
+void winner_stats_load(const char *fname) noexcept;
+void winner_stats_save(const char *fname) noexcept;
+
+// how often "method" resp. "filter" has won
+unsigned winner_stats_method_wins(const char *packer, const char *kind, int method) noexcept;
+unsigned winner_stats_filter_wins(const char *packer, const char *kind, int filter) noexcept;
+// the best c_len/u_len ratio so far in parts per million, or 0 if unknown
+unsigned winner_stats_best_ppm(const char *packer, const char *kind) noexcept;
+
+void winner_stats_add(const char *packer, const char *kind, int method, int filter,
+                      unsigned u_len, unsigned c_len) noexcept;
+
+// for testing
+void winner_stats_clear() noexcept;
+
+} // namespace upx
+
+/* vim:set ts=4 sw=4 et: */
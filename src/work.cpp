@@ -41,10 +41,14 @@
 #include <sys/stat.h>
 #endif
 #include "conf.h"
+#include "compress/compress.h"
 #include "file.h"
 #include "packmast.h"
 #include "ui.h"
 #include "util/membuffer.h"
+#include "util/parallel.h"
+#include "util/stats.h"
+#include "util/winners.h"
 
 #if USE_UTIMENSAT && defined(AT_FDCWD)
 #elif defined(_WIN32) || defined(__CYGWIN__)
@@ -253,6 +257,8 @@ void do_one_file(const char *const iname, char *const oname) may_throw {
     // open input file
     InputFile fi;
     fi.sopen(iname, get_open_flags(RO_MUST_EXIST), SH_DENYWR);
+    if (opt->use_mmap)
+        (void) fi.map(); // falls back to read() for non-regular files
 
     if (opt->preserve_timestamp) {
 #if USE_SETFILETIME
@@ -404,63 +410,171 @@ static void unlink_ofile(char *oname) noexcept {
     }
 }
 
+// process one file and handle all exceptions; returns -1 on fatal errors
+static int do_one_file_catch_impl(const char *const iname, int *ec) noexcept {
+    char oname[ACC_FN_PATH_MAX + 1];
+    oname[0] = 0;
+    *ec = EXIT_OK;
+
+    try {
+        do_one_file(iname, oname);
+    } catch (const Exception &e) {
+        unlink_ofile(oname);
+        if (opt->verbose >= 1 || (opt->verbose >= 0 && !e.isWarning()))
+            printErr(iname, e);
+        *ec = e.isWarning() ? EXIT_WARN : EXIT_ERROR;
+        // this is not fatal, continue processing more files
+    } catch (const Error &e) {
+        unlink_ofile(oname);
+        printErr(iname, e);
+        *ec = EXIT_ERROR;
+        return -1; // fatal error
+    } catch (std::bad_alloc *e) {
+        unlink_ofile(oname);
+        printErr(iname, "out of memory");
+        UNUSED(e);
+        // delete e;
+        *ec = EXIT_ERROR;
+        return -1; // fatal error
+    } catch (const std::bad_alloc &) {
+        unlink_ofile(oname);
+        printErr(iname, "out of memory");
+        *ec = EXIT_ERROR;
+        return -1; // fatal error
+    } catch (std::exception *e) {
+        unlink_ofile(oname);
+        printUnhandledException(iname, e);
+        // delete e;
+        *ec = EXIT_ERROR;
+        return -1; // fatal error
+    } catch (const std::exception &e) {
+        unlink_ofile(oname);
+        printUnhandledException(iname, &e);
+        *ec = EXIT_ERROR;
+        return -1; // fatal error
+    } catch (...) {
+        unlink_ofile(oname);
+        printUnhandledException(iname, nullptr);
+        *ec = EXIT_ERROR;
+        return -1; // fatal error
+    }
+    return 0;
+}
+
+static int do_one_file_catch(const char *const iname, int *ec) noexcept {
+    if (opt->stats == opt->STATS_OFF)
+        return do_one_file_catch_impl(iname, ec);
+    upx::PhaseStats stats;
+    upx::stats_begin(&stats);
+    int r;
+    {
+        upx::PhaseTimer timer(upx::STATS_TOTAL);
+        r = do_one_file_catch_impl(iname, ec);
+    }
+    upx::stats_end(opt->to_stdout ? stderr : stdout, iname, &stats,
+                   opt->stats == opt->STATS_JSON);
+    return r;
+}
+
+#if (USE_CONSOLE) && (WITH_THREADS)
+
+// "-j" batch mode: process files on a number of worker threads.
+// The console output and the UiPacker totals of each file are collected
+// per job and then get reported in command line order, so the output is
+// the same as in serial mode. After a fatal error no new files get started,
+// but files that have already been started by other worker threads are
+// finished and reported.
+namespace {
+struct BatchJob final {
+    ConsoleCapture output;
+    UiPacker::Totals totals;
+    int ec;
+    int r;
+    bool started;
+    bool done;
+};
+} // namespace
+
+static int do_files_parallel(int i, int argc, char *argv[], unsigned njobs) may_throw {
+    const unsigned n = argc - i;
+    MemBuffer jobs_buf(mem_size(sizeof(BatchJob), n));
+    BatchJob *const jobs = (BatchJob *) jobs_buf.getVoidPtr();
+    memset(jobs, 0, sizeof(BatchJob) * n);
+
+    std::mutex report_mutex;
+    unsigned next_report = 0;            // protected by report_mutex
+    UiPacker::Totals totals = {};        // protected by report_mutex
+    upx_std_atomic(bool) fatal{false};
+
+    upx::parallel_for(n, njobs, [&](unsigned index) {
+        BatchJob &job = jobs[index];
+        if (!fatal) {
+            job.started = true;
+            const UiPacker::Totals saved_totals = UiPacker::uiExchangeTotals(UiPacker::Totals{});
+            con_capture_begin(&job.output);
+            infoHeader();
+            job.r = do_one_file_catch(argv[i + index], &job.ec);
+            con_capture_begin(nullptr);
+            job.totals = UiPacker::uiExchangeTotals(saved_totals);
+        }
+        // report all finished jobs in order
+        std::lock_guard<std::mutex> lock(report_mutex);
+        job.done = true;
+        while (next_report < n && jobs[next_report].done) {
+            BatchJob &j = jobs[next_report++];
+            if (j.started) {
+                con_capture_flush(&j.output);
+                totals.add(j.totals);
+                main_set_exit_code(j.ec);
+                if (j.r < 0)
+                    fatal = true;
+            }
+            con_capture_free(&j.output);
+        }
+    });
+    UiPacker::uiAddTotals(totals);
+    return fatal ? -1 : 0;
+}
+
+#endif // USE_CONSOLE && WITH_THREADS
+
 int do_files(int i, int argc, char *argv[]) may_throw {
     upx_compiler_sanity_check();
     if (opt->verbose >= 1) {
         show_header();
         UiPacker::uiHeader();
     }
+    if (opt->cmd == CMD_COMPRESS && opt->winner_stats)
+        upx::winner_stats_load(opt->winner_stats);
+    if (opt->cmd == CMD_COMPRESS) {
+        // keep an idle compressor context for each thread of each concurrent file
+        unsigned context_limit = upx::parallel_get_num_threads(opt->threads);
+#if (USE_CONSOLE) && (WITH_THREADS)
+        context_limit *= upx::parallel_get_num_threads(opt->jobs);
+#endif
+        upx_compress_set_context_limit(context_limit);
+    }
 
+#if (USE_CONSOLE) && (WITH_THREADS)
+    const unsigned njobs = upx::parallel_get_num_threads(opt->jobs);
+    if (njobs >= 2 && argc - i >= 2 && !opt->to_stdout) {
+        if (do_files_parallel(i, argc, argv, njobs) < 0)
+            return -1; // fatal error
+        i = argc;
+    }
+#endif
     for (; i < argc; i++) {
         infoHeader();
-
-        const char *const iname = argv[i];
-        char oname[ACC_FN_PATH_MAX + 1];
-        oname[0] = 0;
-
-        try {
-            do_one_file(iname, oname);
-        } catch (const Exception &e) {
-            unlink_ofile(oname);
-            if (opt->verbose >= 1 || (opt->verbose >= 0 && !e.isWarning()))
-                printErr(iname, e);
-            main_set_exit_code(e.isWarning() ? EXIT_WARN : EXIT_ERROR);
-            // this is not fatal, continue processing more files
-        } catch (const Error &e) {
-            unlink_ofile(oname);
-            printErr(iname, e);
-            main_set_exit_code(EXIT_ERROR);
-            return -1; // fatal error
-        } catch (std::bad_alloc *e) {
-            unlink_ofile(oname);
-            printErr(iname, "out of memory");
-            UNUSED(e);
-            // delete e;
-            main_set_exit_code(EXIT_ERROR);
-            return -1; // fatal error
-        } catch (const std::bad_alloc &) {
-            unlink_ofile(oname);
-            printErr(iname, "out of memory");
-            main_set_exit_code(EXIT_ERROR);
+        int ec = EXIT_OK;
+        int r = do_one_file_catch(argv[i], &ec);
+        main_set_exit_code(ec);
+        if (r < 0)
             return -1; // fatal error
-        } catch (std::exception *e) {
-            unlink_ofile(oname);
-            printUnhandledException(iname, e);
-            // delete e;
-            main_set_exit_code(EXIT_ERROR);
-            return -1; // fatal error
-        } catch (const std::exception &e) {
-            unlink_ofile(oname);
-            printUnhandledException(iname, &e);
-            main_set_exit_code(EXIT_ERROR);
-            return -1; // fatal error
-        } catch (...) {
-            unlink_ofile(oname);
-            printUnhandledException(iname, nullptr);
-            main_set_exit_code(EXIT_ERROR);
-            return -1; // fatal error
-        }
     }
+    // all files are done, so free the idle compressor contexts
+    upx_compress_release_contexts();
+    if (opt->cmd == CMD_COMPRESS && opt->winner_stats)
+        upx::winner_stats_save(opt->winner_stats);
 
     if (opt->cmd == CMD_COMPRESS)
         UiPacker::uiPackTotal();